@@ -0,0 +1,74 @@
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++}
+{																			}
+{       Filename: ditherbench.c												}
+{       Copyright(c): Leon de Boer(LdB) 2020								}
+{       Version: 1.00														}
+{		Release under MIT license (https://opensource.org/licenses/MIT)     }
+{																			}
+{***************************************************************************}
+{                                                                           }
+{      Microbenchmark of dithering a 128x128 8 bit grey frame to 4bpp with	}
+{      each kernel the build and CPU support, one row at a time as			}
+{      SSD1327_DrawGrey does.												}
+{																            }
+{++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
+{  1.00 Initial version														}
+{++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+#define _DEFAULT_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "expand.h"
+
+#define FRAME_WTH ( 128 )
+#define FRAME_HT ( 128 )
+#define BENCH_FRAMES ( 2000 )					// Frames dithered per run
+#define BENCH_RUNS ( 5 )						// Best of this many runs is reported
+
+static const char* modes[3] = { "round", "bayer", "floyd" };
+
+static uint8_t frame[FRAME_HT][FRAME_WTH];		// Grey test frame
+static uint8_t out[FRAME_WTH / 2];				// One dithered row, as the SPI buffer
+static volatile uint8_t sink;					// Stops compiler discarding work
+
+static double now (void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main (void)
+{
+	for (int y = 0; y < FRAME_HT; y++)								// Gradient with some texture
+		for (int x = 0; x < FRAME_WTH; x++)
+			frame[y][x] = (x * 2 + y) ^ ((x * y) & 0x1F);
+	printf("%-8s %-6s %14s\n", "kernel", "mode", "frames/sec");
+	for (EXPANDKERNEL k = EXPAND_SCALAR; k <= EXPAND_AVX2; k++)
+	{
+		if (!Expand_SelectKernel(k)) continue;						// Kernel not supported here
+		for (int m = DITHER_NONE; m <= DITHER_FLOYD; m++)
+		{
+			double best = 1e9;
+			for (int r = 0; r < BENCH_RUNS; r++)
+			{
+				double t = now();
+				for (int f = 0; f < BENCH_FRAMES; f++)
+				{
+					DITHERSTATE ds;
+					Expand_DitherInit(&ds, m, FRAME_WTH);
+					for (int y = 0; y < FRAME_HT; y++)
+					{
+						Expand_DitherRow(&ds, &frame[y][0], &out[0]);
+						sink = out[0];
+					}
+				}
+				t = now() - t;
+				if (t < best) best = t;
+			}
+			printf("%-8s %-6s %14.0f\n", Expand_KernelName(k), modes[m], BENCH_FRAMES / best);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,141 @@
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++}
+{																			}
+{       Filename: drawqbench.c												}
+{       Copyright(c): Leon de Boer(LdB) 2020								}
+{       Version: 1.00														}
+{		Release under MIT license (https://opensource.org/licenses/MIT)     }
+{																			}
+{***************************************************************************}
+{                                                                           }
+{      Microbenchmark of posting draw commands from 1 to 16 producer		}
+{      threads to one consumer, the lock free ring against the same ring	}
+{      guarded by a semaphore as main.c shared the screen before.			}
+{																            }
+{++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
+{  1.00 Initial version														}
+{++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+#define _DEFAULT_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include "drawq.h"
+
+#define BENCH_CMDS ( 200000 )					// Commands posted by each producer
+#define BENCH_SLOTS ( 256 )						// Ring size
+#define BENCH_RUNS ( 3 )						// Best of this many runs is reported
+#define MAX_PRODUCERS ( 16 )
+
+static volatile uint32_t sink;					// Stops compiler discarding work
+
+static double now (void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* The same ring behind one semaphore, every post and take waits its turn */
+static struct {
+	sem_t lock;
+	uint32_t head, tail;
+	DRAWCMD cmd[BENCH_SLOTS];
+} locked;
+
+static bool locked_push (const DRAWCMD* cmd)
+{
+	sem_wait(&locked.lock);
+	bool ok = (locked.tail - locked.head < BENCH_SLOTS);
+	if (ok) locked.cmd[locked.tail++ % BENCH_SLOTS] = *cmd;
+	sem_post(&locked.lock);
+	return ok;
+}
+
+static bool locked_pop (DRAWCMD* cmd)
+{
+	sem_wait(&locked.lock);
+	bool ok = (locked.head != locked.tail);
+	if (ok) *cmd = locked.cmd[locked.head++ % BENCH_SLOTS];
+	sem_post(&locked.lock);
+	return ok;
+}
+
+static DRAWQ_HANDLE ring;
+static bool lockfree;
+static uint32_t producers_done;
+
+static void* producer (void* param)
+{
+	DRAWCMD c = { .op = DRAW_NUMBER, .left = (intptr_t)param * 8, .width = 5 };
+	for (int i = 0; i < BENCH_CMDS; i++)
+	{
+		c.value = i;
+		while (!(lockfree ? DrawQ_Push(ring, &c) : locked_push(&c)))
+			sched_yield();											// Full, let the consumer catch up
+	}
+	__atomic_fetch_add(&producers_done, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static void* consumer (void* param)
+{
+	uint32_t total = (uintptr_t)param, got = 0;
+	DRAWCMD c;
+	while (got < total)
+	{
+		if (lockfree ? DrawQ_Pop(ring, &c) : locked_pop(&c))
+		{
+			sink += c.value;
+			got++;
+		} else sched_yield();
+	}
+	return 0;
+}
+
+static double run (int nprod)
+{
+	pthread_t prod[MAX_PRODUCERS], cons;
+	producers_done = 0;
+	locked.head = locked.tail = 0;
+	double t = now();
+	pthread_create(&cons, NULL, consumer, (void*)(uintptr_t)(nprod * BENCH_CMDS));
+	for (intptr_t i = 0; i < nprod; i++)
+		pthread_create(&prod[i], NULL, producer, (void*)i);
+	for (int i = 0; i < nprod; i++)
+		pthread_join(prod[i], NULL);
+	pthread_join(cons, NULL);
+	return now() - t;
+}
+
+int main (void)
+{
+	ring = DrawQ_Create(BENCH_SLOTS);
+	sem_init(&locked.lock, 0, 1);
+	if (ring == 0)
+	{
+		printf("ring could not be created\n");
+		return 1;
+	}
+	printf("%-10s %16s %16s\n", "producers", "lockfree cmd/s", "semaphore cmd/s");
+	for (int n = 1; n <= MAX_PRODUCERS; n *= 2)
+	{
+		double best[2] = { 1e9, 1e9 };
+		for (int r = 0; r < BENCH_RUNS; r++)
+		{
+			for (int m = 0; m < 2; m++)
+			{
+				lockfree = (m == 0);
+				double t = run(n);
+				if (t < best[m]) best[m] = t;
+			}
+		}
+		printf("%-10d %16.0f %16.0f\n", n, n * (double)BENCH_CMDS / best[0],
+			n * (double)BENCH_CMDS / best[1]);
+	}
+	sem_destroy(&locked.lock);
+	DrawQ_Destroy(ring);
+	return 0;
+}
@@ -0,0 +1,105 @@
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++}
+{																			}
+{       Filename: fontbench.c												}
+{       Copyright(c): Leon de Boer(LdB) 2020								}
+{       Version: 1.00														}
+{		Release under MIT license (https://opensource.org/licenses/MIT)     }
+{																			}
+{***************************************************************************}
+{                                                                           }
+{      Microbenchmark of the 1bpp to 4bpp glyph expansion kernels. Reports	}
+{      glyphs per second for each font with every kernel the CPU supports	}
+{      plus the original bit at a time loop for reference.					}
+{																            }
+{++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
+{  1.00 Initial version														}
+{++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+#define _DEFAULT_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "expand.h"
+#include "font8x16.h"
+#include "font8x8.h"
+#include "font6x8.h"
+
+#define BENCH_LOOPS ( 4000 )					// Passes over all 256 glyphs
+
+static const struct {
+	const char* name;
+	const uint8_t* data;
+	uint16_t wth;
+	uint16_t ht;
+	uint16_t stride;
+} fonts[3] = {
+	{ "8x16", &font_8x16_data[0], 8, 16, 16 },
+	{ "8x8", &font_8x8_data[0], 8, 8, 8 },
+	{ "6x8", &font_6x8_data[0], 6, 8, 8 },
+};
+
+static volatile uint8_t sink;					// Stops compiler discarding work
+
+static double now (void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* The per bit loop WriteChar used before the kernels, kept as reference */
+static void expand_bitloop (const uint8_t* bp, uint8_t* buf, uint16_t fontwth, uint16_t fontht, uint8_t txt, uint8_t bk)
+{
+	uint16_t TSize = fontwth / 2 * fontht;
+	uint8_t b = *bp++;
+	uint8_t fbuc = 0;
+	for (unsigned int i = 0; i < TSize; i++)
+	{
+		buf[i] = ((b & 0x80) == 0x80) ? txt << 4 : bk << 4;
+		buf[i] |= ((b & 0x40) == 0x40) ? txt : bk;
+		b = b << 2;
+		fbuc++;
+		if ((i + 1) % (fontwth / 2) == 0 || fbuc == 4)
+		{
+			b = *bp++;
+			fbuc = 0;
+		}
+	}
+}
+
+int main (void)
+{
+	uint8_t buf[64];
+	printf("%-8s %-6s %14s\n", "kernel", "font", "glyphs/sec");
+	for (int f = 0; f < 3; f++)
+	{
+		double t = now();
+		for (int l = 0; l < BENCH_LOOPS; l++)
+			for (int ch = 0; ch < 256; ch++)
+			{
+				expand_bitloop(&fonts[f].data[ch * fonts[f].stride], &buf[0],
+					fonts[f].wth, fonts[f].ht, (l & 0xF), 0);
+				sink = buf[0];
+			}
+		t = now() - t;
+		printf("%-8s %-6s %14.0f\n", "bitloop", fonts[f].name, BENCH_LOOPS * 256.0 / t);
+	}
+	for (EXPANDKERNEL k = EXPAND_SCALAR; k <= EXPAND_AVX2; k++)
+	{
+		if (!Expand_SelectKernel(k)) continue;						// Kernel not supported here
+		for (int f = 0; f < 3; f++)
+		{
+			double t = now();
+			for (int l = 0; l < BENCH_LOOPS; l++)
+				for (int ch = 0; ch < 256; ch++)
+				{
+					Expand_1bpp(&fonts[f].data[ch * fonts[f].stride], (fonts[f].wth + 7) / 8,
+						&buf[0], fonts[f].wth / 2, fonts[f].wth, fonts[f].ht, (l & 0xF), 0);
+					sink = buf[0];
+				}
+			t = now() - t;
+			printf("%-8s %-6s %14.0f\n", Expand_KernelName(k), fonts[f].name, BENCH_LOOPS * 256.0 / t);
+		}
+	}
+	return 0;
+}
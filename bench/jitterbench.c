@@ -0,0 +1,122 @@
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++}
+{																			}
+{       Filename: jitterbench.c												}
+{       Copyright(c): Leon de Boer(LdB) 2020								}
+{       Version: 1.00														}
+{		Release under MIT license (https://opensource.org/licenses/MIT)     }
+{																			}
+{***************************************************************************}
+{                                                                           }
+{      Frame start jitter of a paced flush thread, as the compositor runs	}
+{      it, under a synthetic CPU load on the same core. It is run with the	}
+{      normal scheduler then SCHED_FIFO with locked memory. Real time		}
+{      needs root or CAP_SYS_NICE.											}
+{																            }
+{++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
+{  1.00 Initial version														}
+{++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+#define _DEFAULT_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+#include "rtsched.h"
+
+#define BENCH_FPS ( 100 )						// Frame rate of flush thread
+#define BENCH_SECONDS ( 3 )						// Run time of each mode
+#define BENCH_WORK_US ( 2000 )					// CPU time of a flush, as a 10MHz SPI frame of damage
+#define BENCH_LOAD ( 4 )						// Busy threads on the same cpu
+#define BENCH_CPU ( 0 )							// Cpu everything is pinned to
+
+static volatile bool loading;					// Load threads run while set
+static JITTER jitter;
+
+static uint64_t now_ns (void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Burns cpu like a flush pushing bytes, or a busy neighbour process */
+static void spin_us (uint32_t us)
+{
+	uint64_t end = now_ns() + us * 1000ULL;
+	while (now_ns() < end);
+}
+
+static void* load (void* param)
+{
+	while (loading) spin_us(100);
+	return 0;
+}
+
+/* The compositor_paced loop with the drawing replaced by spinning */
+static void* flusher (void* param)
+{
+	uint64_t period = 1000000000ULL / BENCH_FPS;
+	uint64_t ideal = now_ns() + period;
+	struct itimerspec its = { { 0, period }, { ideal / 1000000000ULL, ideal % 1000000000ULL } };
+	int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (tfd < 0 || timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) != 0) return 0;
+	for (uint32_t f = 0; f < BENCH_FPS * BENCH_SECONDS; f++)
+	{
+		uint64_t ticks;
+		if (read(tfd, &ticks, sizeof(ticks)) != sizeof(ticks)) break;
+		uint64_t late = now_ns() - (ideal + (ticks - 1) * period);
+		Jitter_Add(&jitter, late / 1000, ticks - 1);
+		ideal += ticks * period;
+		spin_us(BENCH_WORK_US);
+	}
+	close(tfd);
+	return 0;
+}
+
+static bool run (const char* name, uint8_t priority, uint16_t nload)
+{
+	pthread_t loader[BENCH_LOAD], flush;
+	pthread_attr_t attr;
+	JITTER_STATS s;
+	Jitter_Reset(&jitter);
+	uint16_t started = 0;
+	loading = true;
+	for (uint16_t i = 0; i < nload; i++)
+	{
+		if (!RT_ThreadAttr(&attr, 0, BENCH_CPU)) continue;
+		if (pthread_create(&loader[started], &attr, load, NULL) == 0) started++;
+		pthread_attr_destroy(&attr);
+	}
+	bool ok = false;
+	if (RT_ThreadAttr(&attr, priority, BENCH_CPU))
+	{
+		ok = (pthread_create(&flush, &attr, flusher, NULL) == 0);	// EPERM without root
+		pthread_attr_destroy(&attr);								// Attributes done with either way
+	}
+	if (ok) pthread_join(flush, NULL);
+	loading = false;
+	for (uint16_t i = 0; i < started; i++)
+		pthread_join(loader[i], NULL);
+	if (!ok)
+	{
+		printf("%-22s not permitted, run as root\n", name);
+		return false;
+	}
+	Jitter_Stats(&jitter, &s);
+	printf("%-22s %6u %6u %6u %6u %7u %7u\n", name, s.frames, s.p50, s.p99, s.p999, s.max, s.missed);
+	return true;
+}
+
+int main (void)
+{
+	printf("%d fps, %d us flush, %d load threads, all on cpu %d\n", BENCH_FPS, BENCH_WORK_US, BENCH_LOAD, BENCH_CPU);
+	printf("%-22s %6s %6s %6s %6s %7s %7s\n", "mode", "frames", "p50us", "p99us", "p999us", "maxus", "missed");
+	run("normal, idle", 0, 0);
+	run("normal, loaded", 0, BENCH_LOAD);
+	if (!RT_LockMemory()) printf("memory could not be locked\n");
+	run("SCHED_FIFO 50, loaded", 50, BENCH_LOAD);
+	return 0;
+}
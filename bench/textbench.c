@@ -0,0 +1,128 @@
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++}
+{																			}
+{       Filename: textbench.c												}
+{       Copyright(c): Leon de Boer(LdB) 2020								}
+{       Version: 1.00														}
+{		Release under MIT license (https://opensource.org/licenses/MIT)     }
+{																			}
+{***************************************************************************}
+{                                                                           }
+{      Microbenchmark of the text to glyph index path WriteText runs for	}
+{      every character. Compares the original byte per character lookup	}
+{      with UTF-8 decoding on a contiguous and a sparse font, so the ASCII	}
+{      case can be checked for regressions.									}
+{																            }
+{++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
+{  1.00 Initial version														}
+{++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+#define _DEFAULT_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "font.h"
+
+#define BENCH_LOOPS ( 200000 )					// Passes over each string
+#define BENCH_RUNS ( 7 )						// Best of this many runs is reported
+
+static const char ascii[] = "The quick brown fox jumps over the lazy dog 0123456789";
+static const char cyrillic[] = "\xD0\xA1\xD1\x8A\xD0\xB5\xD1\x88\xD1\x8C \xD0\xB6\xD0\xB5 \xD0\xB5\xD1\x89\xD1\x91 "
+	"\xD1\x8D\xD1\x82\xD0\xB8\xD1\x85 \xD0\xBC\xD1\x8F\xD0\xB3\xD0\xBA\xD0\xB8\xD1\x85";
+
+static volatile uint32_t sink;					// Stops compiler discarding work
+
+static double now (void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* The range only Font_GlyphIndex before the sparse index, kept as reference */
+static __attribute__((noinline)) uint16_t legacy_glyphindex (const FONTDESC* font, uint32_t ch)
+{
+	if (ch >= font->firstchar && ch - font->firstchar < font->numchars)
+		return ch - font->firstchar;
+	return font->defaultchar - font->firstchar;
+}
+
+/* The byte per character path WriteText used before UTF-8 */
+static uint32_t legacy_index (const FONTDESC* font, const char* txt)
+{
+	uint32_t sum = 0;
+	while (*txt)
+		sum += legacy_glyphindex(font, (uint8_t)(*txt++));
+	return sum;
+}
+
+/* Same as text_next in ssd1327.c, ASCII fast path then Font_DecodeUTF8 */
+static inline uint32_t text_next (const char** txt)
+{
+	const char* p = *txt;
+	uint8_t b = (uint8_t)(*p);
+	if (b < 0x80)
+	{
+		*txt = p + 1;
+		return b;
+	}
+	uint32_t ch = Font_DecodeUTF8(&p);
+	*txt = p;
+	return ch;
+}
+
+/* The WriteText path */
+static uint32_t utf8_index (const FONTDESC* font, const char* txt)
+{
+	uint32_t sum = 0;
+	while (*txt)
+		sum += Font_GlyphIndex(font, text_next(&txt));
+	return sum;
+}
+
+static void run (const char* name, uint32_t (*fn)(const FONTDESC*, const char*), const FONTDESC* font, const char* txt)
+{
+	size_t chars = 0;
+	for (const char* p = txt; *p; chars++) Font_DecodeUTF8(&p);		// Characters in string
+	double best = 1e9;
+	for (int r = 0; r < BENCH_RUNS; r++)							// Best run filters out scheduling noise
+	{
+		double t = now();
+		for (int l = 0; l < BENCH_LOOPS; l++)
+			sink += fn(font, txt);
+		t = now() - t;
+		if (t < best) best = t;
+	}
+	printf("%-24s %14.0f\n", name, chars * (double)BENCH_LOOPS / best);
+}
+
+int main (void)
+{
+	static FONTGLYPH glyphs[512];								// Sparse font of ASCII and Cyrillic
+	static uint16_t pagedir[FONT_PAGES];
+	static uint16_t pages[2][256];
+	static uint8_t bitmap[1] = { 0 };
+	memset(pagedir, 0xFF, sizeof(pagedir));
+	memset(pages, 0xFF, sizeof(pages));
+	pagedir[0x00] = 0;
+	pagedir[0x04] = 1;
+	for (int i = 0; i < 512; i++)
+	{
+		pages[i >> 8][i & 0xFF] = i;
+		glyphs[i] = (FONTGLYPH){ 0, 0, 0, 0, 8 };
+	}
+	uint8_t sparse = Font_RegisterSparse(FONT_FORMAT_PACKED, 8, '?', 512,
+		&glyphs[0], &bitmap[0], &pagedir[0], &pages[0][0]);
+	if (sparse == FONT_INVALID)
+	{
+		printf("sparse font did not register\n");
+		return 1;
+	}
+
+	printf("%-24s %14s\n", "lookup", "chars/sec");
+	run("legacy ascii", legacy_index, Font_Get(FONT8x16), ascii);
+	run("utf8 ascii", utf8_index, Font_Get(FONT8x16), ascii);
+	run("utf8 ascii sparse", utf8_index, Font_Get(sparse), ascii);
+	run("utf8 cyrillic sparse", utf8_index, Font_Get(sparse), cyrillic);
+	return 0;
+}
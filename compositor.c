@@ -0,0 +1,914 @@
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++}
+{																			}
+{       Filename: compositor.c												}
+{       Copyright(c): Leon de Boer(LdB) 2020								}
+{       Version: 1.00														}
+{		Release under MIT license (https://opensource.org/licenses/MIT)     }
+{																			}
+{***************************************************************************}
+{                                                                           }
+{      Defines a display compositor thread that owns the SSD1327. Tasks	}
+{      post draw commands to it through a lock free ring and never wait	}
+{      on the SPI bus or on each other.										}
+{																            }
+{++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
+{  1.00 Initial version														}
+{++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+#define _POSIX_C_SOURCE 200809L				// Needed for clock_gettime and CLOCK_MONOTONIC under -std=c11
+#include <stdbool.h>							// C standard unit for bool, true, false
+#include <stdint.h>								// C standard unit for uint32_t etc
+#include <string.h>								// C standard unit needed for strlen, memcpy
+#include <unistd.h>								// Needed for read, close
+#include <errno.h>								// Needed for EINTR
+#include <time.h>								// Needed for clock_gettime
+#include <pthread.h>							// Compositor runs as its own thread
+#include <sys/timerfd.h>						// Frame ticks come from a timerfd
+#include "font.h"								// Font registry to size numbers
+#include "drawq.h"								// Draw command ring
+#include "gpio.h"								// GPIO_HANDLE used by SSD1327 header
+#include "ssd1327.h"							// SSD1327 device and DC routines
+#include "rtsched.h"							// Real time set up and jitter stats
+#include "compositor.h"							// This units header
+
+#if COMPOSITOR_DRIVER_VERSION != 1000
+#error "Header does not match this version of file"
+#endif
+
+#define SCREEN_WTH ( 128 )						// SSD1327 screen width
+#define SCREEN_HT ( 128 )						// SSD1327 screen height
+
+/*--------------------------------------------------------------------------}
+{   Area a command may change and, if it paints every pixel of an area		}
+{   solid, that area. A command whose area lies inside the solid area of	}
+{   a later command in the same batch can never be seen so is not drawn.	}
+{--------------------------------------------------------------------------*/
+struct cmd_area
+{
+	int16_t left, top, right, bottom;			// Area command may change, right/bottom exclusive
+	int16_t sleft, stop, sright, sbottom;		// Area painted solid, empty if none
+	bool known;									// Area could be worked out
+	bool solid;									// Solid area set
+};
+
+static struct {
+	DRAWQ_HANDLE q;								// Ring of posted commands
+	SSD1327_HANDLE dev;							// Device the compositor owns
+	HDC Dc;										// Compositors own DC, styled per command
+	pthread_t thread;							// Compositor thread
+	bool running;								// Thread has been started
+	bool stop;									// Thread should finish
+	uint16_t slots;								// Ring size
+	uint16_t fps;								// Frame rate, 0 draws as commands arrive
+	uint8_t rtprio;								// SCHED_FIFO priority, 0 normal
+	int16_t cpu;								// Cpu thread runs on, -1 any
+	bool lockmem;								// Lock memory before starting
+	int tfd;									// Frame tick timerfd when paced
+	uint64_t ideal;								// Ideal time of next frame tick in ns
+	uint64_t period;							// Frame period in ns
+	uint32_t merged;							// Commands skipped as covered
+	uint32_t frames;							// Paced flushes sent
+	uint32_t superseded;						// Region contents replaced before being drawn
+	uint32_t late;								// Prioritised areas sent after their deadline
+	uint32_t tick;								// Time the current frame started in us
+	uint8_t rowprio[SCREEN_HT];					// Highest priority drawn on row this frame, 0 none
+	uint32_t rowdue[SCREEN_HT];					// Earliest deadline in us of that priority on row
+	uint8_t rowtimed[SCREEN_HT];				// Row deadline is real, not just due at once
+	JITTER jitter;								// Frame start jitter
+} comp = { .cpu = -1 };
+
+/*--------------------------------------------------------------------------}
+{   A region mailbox is a triple buffer of command frames. The producer		}
+{   fills its back frame and swaps it with ready, the compositor swaps		}
+{   ready with its front frame when ready is flagged fresh. Neither side	}
+{   ever waits and a frame published before the last was drawn is simply	}
+{   replaced, so only the newest content is ever sent.						}
+{--------------------------------------------------------------------------*/
+#define MAX_REGION ( 16 )						// Regions that can be bound at once
+#define REGION_FRESH ( 0x80 )					// Ready frame not yet drawn
+
+enum region_state { REGION_FREE, REGION_CLAIMED, REGION_LIVE, REGION_DYING };
+
+struct region_frame
+{
+	uint8_t count;								// Commands in frame
+	uint8_t priority;							// Flush priority when published
+	uint32_t due;								// Deadline in us when published
+	DRAWCMD cmd[COMPOSITOR_REGIONCMDS];			// The content
+};
+
+struct region
+{
+	RECT rc;									// Area the region draws in
+	uint8_t state;								// enum region_state
+	uint8_t back;								// Frame producer is filling, producer only
+	uint8_t front;								// Frame last drawn, compositor only
+	uint8_t ready;								// Newest published frame, REGION_FRESH until drawn
+	uint8_t priority;							// Flush priority, producer only
+	uint16_t deadline;							// Milliseconds from publish to on screen, producer only
+	struct region_frame frame[3];
+};
+
+static struct region region_table[MAX_REGION] = { 0 };
+
+/***************************************************************************}
+{                       PRIVATE INTERNAL ROUTINES                           }
+{***************************************************************************/
+
+/*-[ INTERNAL: now_us ]-----------------------------------------------------}
+. RETURN: monotonic time in microseconds, it wraps so compare differences
+.--------------------------------------------------------------------------*/
+static uint32_t now_us (void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
+
+/*-[ INTERNAL: now_ns ]-----------------------------------------------------}
+. RETURN: monotonic time in nanoseconds
+.--------------------------------------------------------------------------*/
+static uint64_t now_ns (void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*-[ INTERNAL: plan_mark ]--------------------------------------------------}
+. Marks rows top to bottom-1 as drawn this frame at the priority, a row
+. keeps the highest priority and within it the earliest deadline. Only a
+. timed deadline counts towards Compositor_Late when missed.
+.--------------------------------------------------------------------------*/
+static void plan_mark (int16_t top, int16_t bottom, uint8_t priority, uint32_t due, bool timed)
+{
+	if (priority == 0) return;										// Background is not planned
+	if (top < 0) top = 0;
+	if (bottom > SCREEN_HT) bottom = SCREEN_HT;
+	for (int16_t y = top; y < bottom; y++)
+	{
+		if (priority > comp.rowprio[y] ||
+			(priority == comp.rowprio[y] && (int32_t)(due - comp.rowdue[y]) < 0))
+		{
+			comp.rowprio[y] = priority;
+			comp.rowdue[y] = due;
+			comp.rowtimed[y] = timed;
+		} else if (priority == comp.rowprio[y] && due == comp.rowdue[y] && timed)
+			comp.rowtimed[y] = true;									// Same key now also timed
+	}
+}
+
+/*-[ INTERNAL: plan_flush ]-------------------------------------------------}
+. Sends the frame. Rows marked by plan_mark go first, highest priority
+. then earliest deadline, each band of rows with its own flush. Everything
+. else is background and is only sent if the frame is still inside its
+. budget, otherwise it waits in the shadow for a later frame.
+.--------------------------------------------------------------------------*/
+static void plan_flush (bool all)
+{
+	for (;;)
+	{
+		uint8_t prio = 0;
+		uint32_t due = 0;
+		for (uint16_t y = 0; y < SCREEN_HT; y++)						// Find most urgent left
+		{
+			if (comp.rowprio[y] > prio ||
+				(comp.rowprio[y] && comp.rowprio[y] == prio && (int32_t)(comp.rowdue[y] - due) < 0))
+			{
+				prio = comp.rowprio[y];
+				due = comp.rowdue[y];
+			}
+		}
+		if (prio == 0) break;											// No marked rows left
+		bool timed = false;
+		for (uint16_t y = 0; y < SCREEN_HT; y++)
+		{
+			if (comp.rowprio[y] != prio || comp.rowdue[y] != due) continue;
+			uint16_t top = y;
+			while (y < SCREEN_HT && comp.rowprio[y] == prio && comp.rowdue[y] == due)
+			{
+				timed |= comp.rowtimed[y];
+				comp.rowprio[y++] = 0;									// Band of the same key
+			}
+			SSD1327_FlushRows(comp.dev, top, y);
+		}
+		if (timed && (int32_t)(now_us() - due) > 0)						// Missed a real deadline
+			__atomic_fetch_add(&comp.late, 1, __ATOMIC_RELAXED);
+	}
+	uint32_t budget = 10000UL * COMPOSITOR_BUDGET / comp.fps;			// us of the frame background may start in
+	if (all || now_us() - comp.tick < budget) SSD1327_Flush(comp.dev);// Background in the time left
+}
+
+/*-[ INTERNAL: cmd_style ]--------------------------------------------------}
+. Sets the compositor DC to the colours, font and scale of the command.
+.--------------------------------------------------------------------------*/
+static void cmd_style (const DRAWCMD* c)
+{
+	SetTextColor(comp.Dc, c->txtcolor);
+	SetBkColor(comp.Dc, c->bkcolor);
+	SetDCPenColor(comp.Dc, c->pencolor);
+	SetDCBrushColor(comp.Dc, c->brushcolor);
+	if (c->op == DRAW_TEXT || c->op == DRAW_NUMBER)
+	{
+		if (GetCurrentFont(comp.Dc) != c->fontnum) SelectFont(comp.Dc, c->fontnum);
+		SetTextScale(comp.Dc, c->textscale);
+	}
+}
+
+/*-[ INTERNAL: number_chars ]-----------------------------------------------}
+. RETURN: characters DrawNumber draws for the value, width and flags
+.--------------------------------------------------------------------------*/
+static uint8_t number_chars (int32_t value, uint8_t width, uint16_t flags)
+{
+	uint8_t decimals = (flags >> 8) & 0xF;							// Same limits as DrawNumber
+	if (decimals > 9) decimals = 9;
+	if (width > DN_MAXWIDTH) width = DN_MAXWIDTH;
+	uint32_t mag = (value < 0) ? 0u - (uint32_t)value : (uint32_t)value;
+	uint8_t n = 0;
+	do {
+		mag /= 10;
+		n++;
+	} while (mag || n <= decimals);									// Digits including leading zero
+	if (decimals) n++;												// Decimal point
+	if (value < 0 || (flags & DN_SIGN)) n++;						// Sign
+	return (n > width) ? n : width;
+}
+
+/*-[ INTERNAL: cmd_area ]---------------------------------------------------}
+. Works out the area a command may change and the area it paints solid.
+. Text is solid over its cells as the background is drawn, numbers only
+. when the font is fixed width so the width is known without drawing.
+.--------------------------------------------------------------------------*/
+static void cmd_area (const DRAWCMD* c, struct cmd_area* a)
+{
+	a->known = true;
+	a->solid = false;
+	a->left = c->left;
+	a->top = c->top;
+	a->right = c->right;
+	a->bottom = c->bottom;
+	switch (c->op)
+	{
+		case DRAW_CLEAR:
+			a->left = a->top = 0;
+			a->right = SCREEN_WTH;
+			a->bottom = SCREEN_HT;
+			a->solid = true;
+			break;
+		case DRAW_RECT:
+			a->solid = ((c->left & 1) == 0 && (c->right & 1) == 0);	// Odd edges only half fill a byte
+			a->left &= ~1;
+			a->right = (a->right + 1) & ~1;
+			break;
+		case DRAW_FRAMERECT:
+		case DRAW_ELLIPSE:
+			break;
+		case DRAW_LINE:
+			a->left = (c->left < c->right) ? c->left : c->right;
+			a->right = ((c->left < c->right) ? c->right : c->left) + 1;
+			a->top = (c->top < c->bottom) ? c->top : c->bottom;
+			a->bottom = ((c->top < c->bottom) ? c->bottom : c->top) + 1;
+			break;
+		case DRAW_TEXT:
+		case DRAW_NUMBER: {
+			SIZE size = { 0 };
+			a->left = c->left & ~1;									// Text is drawn from even x
+			if (c->op == DRAW_TEXT)
+			{
+				cmd_style(c);
+				GetTextExtent(comp.Dc, c->text, &size);
+			} else {
+				const FONTDESC* font = Font_Get(c->fontnum);
+				if (font == 0 || font->format != FONT_FORMAT_FIXED)
+				{
+					a->known = false;								// Width needs the glyphs
+					return;
+				}
+				size.cx = number_chars(c->value, c->width, c->flags) * font->fixedwth * c->textscale;
+				size.cy = font->height * c->textscale;
+			}
+			a->right = a->left + (size.cx & ~1);
+			a->bottom = a->top + size.cy;
+			a->solid = (c->left < SCREEN_WTH && c->top < SCREEN_HT);// Text starting off screen draws nothing
+			break;
+		}
+		default:
+			a->known = false;
+			return;
+	}
+	if (a->solid)
+	{
+		a->sleft = a->left;
+		a->stop = a->top;
+		a->sright = a->right;
+		a->sbottom = a->bottom;
+	}
+}
+
+/*-[ INTERNAL: cmd_draw ]---------------------------------------------------}
+. Draws one command on the SSD1327.
+.--------------------------------------------------------------------------*/
+static void cmd_draw (const DRAWCMD* c)
+{
+	cmd_style(c);
+	switch (c->op)
+	{
+		case DRAW_CLEAR:
+			SSD1327_ClearScreen(comp.dev, c->brushcolor);
+			break;
+		case DRAW_RECT:
+			Rectangle(comp.Dc, c->left, c->top, c->right, c->bottom);
+			break;
+		case DRAW_FRAMERECT:
+			FrameRect(comp.Dc, c->left, c->top, c->right, c->bottom);
+			break;
+		case DRAW_LINE:
+			MoveTo(comp.Dc, c->left, c->top);
+			LineTo(comp.Dc, c->right, c->bottom);
+			break;
+		case DRAW_ELLIPSE:
+			Ellipse(comp.Dc, c->left, c->top, c->right, c->bottom);
+			break;
+		case DRAW_TEXT:
+			SSD1327_WriteText(comp.Dc, c->left, c->top, c->text);
+			break;
+		case DRAW_NUMBER:
+			DrawNumber(comp.Dc, c->left, c->top, c->value, c->width, c->flags);
+			break;
+	}
+}
+
+/*-[ INTERNAL: batch_draw ]-------------------------------------------------}
+. Draws a batch of commands in posted order, skipping any command whose
+. area a later solid command covers. A counter redrawn several times while
+. the compositor was busy only goes out once. When paced the rows of any
+. command with a priority are marked for the flush plan, due at its
+. deadline or at once if it has none.
+.--------------------------------------------------------------------------*/
+static void batch_draw (const DRAWCMD* batch, uint16_t n)
+{
+	struct cmd_area area[COMPOSITOR_BATCH];
+	for (uint16_t i = 0; i < n; i++)
+		cmd_area(&batch[i], &area[i]);
+	for (uint16_t i = 0; i < n; i++)
+	{
+		bool covered = false;
+		for (uint16_t j = i + 1; j < n && area[i].known && !covered; j++)
+			covered = (area[j].solid && area[i].left < area[i].right && area[i].top < area[i].bottom
+				&& area[j].sleft <= area[i].left && area[j].sright >= area[i].right
+				&& area[j].stop <= area[i].top && area[j].sbottom >= area[i].bottom);
+		if (covered) __atomic_fetch_add(&comp.merged, 1, __ATOMIC_RELAXED);
+		else {
+			cmd_draw(&batch[i]);
+			if (comp.fps && batch[i].priority)
+				plan_mark(area[i].top, (area[i].known) ? area[i].bottom : SCREEN_HT, batch[i].priority,
+					(batch[i].timed) ? batch[i].due : comp.tick, batch[i].timed);
+		}
+	}
+}
+
+/*-[ INTERNAL: regions_draw ]-----------------------------------------------}
+. Draws the newest content of every region published since it was last
+. drawn, highest priority then earliest deadline first, and frees regions
+. that were deleted. Unpaced each region goes out as it is drawn so this
+. order is the send order, paced its rows are marked for the flush plan.
+. RETURN: number of regions drawn
+.--------------------------------------------------------------------------*/
+static uint16_t regions_draw (void)
+{
+	struct region* order[MAX_REGION];
+	uint16_t drawn = 0;
+	for (uint16_t i = 0; i < MAX_REGION; i++)
+	{
+		struct region* r = &region_table[i];
+		uint8_t state = __atomic_load_n(&r->state, __ATOMIC_ACQUIRE);
+		if (state == REGION_DYING)									// Deleted, producer is done with it
+			__atomic_store_n(&r->state, REGION_FREE, __ATOMIC_RELEASE);
+		if (state != REGION_LIVE || (__atomic_load_n(&r->ready, __ATOMIC_ACQUIRE) & REGION_FRESH) == 0)
+			continue;												// Nothing new
+		r->front = __atomic_exchange_n(&r->ready, r->front, __ATOMIC_ACQ_REL) & 3;// Take newest frame
+		const struct region_frame* f = &r->frame[r->front];
+		uint16_t j = drawn++;
+		while (j > 0 && (order[j-1]->frame[order[j-1]->front].priority < f->priority ||
+			(order[j-1]->frame[order[j-1]->front].priority == f->priority &&
+			(int32_t)(f->due - order[j-1]->frame[order[j-1]->front].due) < 0)))
+		{
+			order[j] = order[j-1];									// Insert in send order
+			j--;
+		}
+		order[j] = r;
+	}
+	for (uint16_t i = 0; i < drawn; i++)
+	{
+		const struct region_frame* f = &order[i]->frame[order[i]->front];
+		for (uint8_t j = 0; j < f->count; j++)
+			cmd_draw(&f->cmd[j]);
+		if (comp.fps) plan_mark(order[i]->rc.top, order[i]->rc.bottom, f->priority, f->due, true);
+		else if (f->priority && (int32_t)(now_us() - f->due) > 0)	// Sent after its deadline
+			__atomic_fetch_add(&comp.late, 1, __ATOMIC_RELAXED);
+	}
+	return drawn;
+}
+
+/*-[ INTERNAL: compositor_task ]--------------------------------------------}
+. The compositor thread, takes commands off the ring a batch at a time
+. then draws any newly published regions, and sleeps when there are none.
+. On stop it drains the ring first.
+.--------------------------------------------------------------------------*/
+static void* compositor_task (void* param)
+{
+	DRAWCMD batch[COMPOSITOR_BATCH];
+	for (;;)
+	{
+		uint16_t n = 0;
+		while (n < COMPOSITOR_BATCH && DrawQ_Pop(comp.q, &batch[n])) n++;
+		if (n) batch_draw(&batch[0], n);
+		if (regions_draw() || n) continue;							// Look again before sleeping
+		if (__atomic_load_n(&comp.stop, __ATOMIC_ACQUIRE)) break;	// Nothing left and asked to stop
+		DrawQ_Wait(comp.q);											// Sleep until something posted
+	}
+	return 0;
+}
+
+/*-[ INTERNAL: compositor_paced ]-------------------------------------------}
+. The compositor thread with a frame rate. Each timerfd tick it draws what
+. was posted since the last tick and the newest content of each region
+. into the shadow only, then sends it by the flush plan. Values changed
+. several times in a tick are only sent as the last one, so bus traffic
+. per tick is bounded whatever the producers do. Ticks missed while
+. flushing are not made up. On stop it drains the ring into a last flush.
+.--------------------------------------------------------------------------*/
+static void* compositor_paced (void* param)
+{
+	DRAWCMD batch[COMPOSITOR_BATCH];
+	SSD1327_SetDeferred(comp.dev, true);							// Drawing only damages the shadow
+	for (;;)
+	{
+		uint64_t ticks;
+		if (read(comp.tfd, &ticks, sizeof(ticks)) != sizeof(ticks)) // Wait for the frame tick
+		{
+			if (errno == EINTR) continue;
+			break;													// Timer failed
+		}
+		uint64_t late = now_ns() - (comp.ideal + (ticks - 1) * comp.period);// Against the newest tick
+		Jitter_Add(&comp.jitter, late / 1000, ticks - 1);			// Earlier ticks were missed
+		comp.ideal += ticks * comp.period;
+		bool stop = __atomic_load_n(&comp.stop, __ATOMIC_ACQUIRE);	// Read before draining so nothing is missed
+		comp.tick = now_us();											// Frame starts
+		uint32_t taken = 0;
+		uint16_t n;
+		do {
+			n = 0;
+			while (n < COMPOSITOR_BATCH && DrawQ_Pop(comp.q, &batch[n])) n++;
+			if (n) batch_draw(&batch[0], n);
+			taken += n;
+		} while (n == COMPOSITOR_BATCH && taken < comp.slots);		// At most one ring of commands a tick
+		regions_draw();												// Newest region contents over the top
+		stop = (stop && taken < comp.slots);						// Ring empty and asked to stop
+		plan_flush(stop);											// Urgent first, background if time left
+		__atomic_fetch_add(&comp.frames, 1, __ATOMIC_RELAXED);
+		if (stop) break;
+	}
+	SSD1327_SetDeferred(comp.dev, false);							// Back to drawing straight out
+	return 0;
+}
+
+/*-[ INTERNAL: cmd_fill ]---------------------------------------------------}
+. Fills the style of a command from the DC.
+.--------------------------------------------------------------------------*/
+static void cmd_fill (HDC Dc, DRAWCMD* c)
+{
+	if (Dc)
+	{
+		c->txtcolor = GetTextColor(Dc);
+		c->bkcolor = GetBkColor(Dc);
+		c->pencolor = GetDCPenColor(Dc);
+		c->brushcolor = GetDCBrushColor(Dc);
+		c->fontnum = GetCurrentFont(Dc);
+		c->textscale = GetTextScale(Dc);
+		c->priority = GetDCPriority(Dc);
+	}
+}
+
+/*-[ INTERNAL: cmd_post ]---------------------------------------------------}
+. Fills the style of a command from the DC and posts it, stamping when it
+. is due if the DC has a deadline.
+. RETURN: true for success, false if not running or the ring was full
+.--------------------------------------------------------------------------*/
+static bool cmd_post (HDC Dc, DRAWCMD* c)
+{
+	cmd_fill(Dc, c);
+	uint16_t deadline = GetDCDeadline(Dc);
+	c->timed = (deadline != 0);
+	c->due = (deadline) ? now_us() + deadline * 1000UL : 0;
+	return Compositor_Post(c);
+}
+
+/*-[ INTERNAL: text_copy ]--------------------------------------------------}
+. Copies text into a command.
+. RETURN: true for success, false if it does not fit
+.--------------------------------------------------------------------------*/
+static bool text_copy (DRAWCMD* c, const char* txt)
+{
+	if (txt == 0) return false;
+	size_t len = strlen(txt);
+	if (len >= DRAWQ_MAXTEXT) return false;							// Will not fit in command
+	memcpy(&c->text[0], txt, len + 1);
+	return true;
+}
+
+/*-[ INTERNAL: region_contains ]--------------------------------------------}
+. RETURN: true if the command stays in the region, text only has to start
+. in it as its width depends on the font
+.--------------------------------------------------------------------------*/
+static bool region_contains (const RECT* rc, const DRAWCMD* c)
+{
+	switch (c->op)
+	{
+		case DRAW_RECT:
+		case DRAW_FRAMERECT:
+		case DRAW_ELLIPSE:
+			return (c->left >= rc->left && c->right <= rc->right && c->left < c->right
+				&& c->top >= rc->top && c->bottom <= rc->bottom && c->top < c->bottom);
+		case DRAW_LINE:
+			return (c->left >= rc->left && c->left < rc->right && c->right >= rc->left && c->right < rc->right
+				&& c->top >= rc->top && c->top < rc->bottom && c->bottom >= rc->top && c->bottom < rc->bottom);
+		case DRAW_TEXT:
+		case DRAW_NUMBER:
+			return (c->left >= rc->left && c->left < rc->right && c->top >= rc->top && c->top < rc->bottom);
+		default:
+			return false;
+	}
+}
+
+/***************************************************************************}
+{                       PUBLIC INTERFACE ROUTINES                           }
+{***************************************************************************/
+
+/*-[ Compositor_Start ]-----------------------------------------------------}
+. Starts the compositor thread with a ring of slots commands. The SSD1327
+. must already be open and from here on only the compositor may draw on it
+. until Compositor_Stop. There is one compositor, other devices are drawn
+. on directly.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Compositor_Start (SSD1327_HANDLE dev, uint16_t slots)
+{
+	if (comp.running) return false;									// Already running
+	comp.dev = dev;
+	comp.Dc = GetDC(dev);											// Compositor draws with its own DC
+	if (comp.Dc == 0) return false;
+	comp.q = DrawQ_Create(slots);
+	comp.slots = slots;
+	comp.stop = false;
+	comp.merged = 0;
+	comp.frames = 0;
+	comp.late = 0;
+	comp.superseded = 0;
+	Jitter_Reset(&comp.jitter);
+	memset(comp.rowprio, 0, sizeof(comp.rowprio));					// No rows planned
+	comp.tfd = -1;
+	if (comp.q && comp.fps)											// Paced, start the frame tick
+	{
+		comp.period = 1000000000ULL / comp.fps;						// Frame period
+		comp.ideal = now_ns() + comp.period;						// Absolute so jitter is against true ticks
+		struct itimerspec its = { { comp.period / 1000000000ULL, comp.period % 1000000000ULL },
+			{ comp.ideal / 1000000000ULL, comp.ideal % 1000000000ULL } };
+		comp.tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+		if (comp.tfd >= 0 && timerfd_settime(comp.tfd, TFD_TIMER_ABSTIME, &its, NULL) != 0)
+		{
+			close(comp.tfd);
+			comp.tfd = -1;
+		}
+	}
+	pthread_attr_t attr;
+	if (comp.q && (comp.fps == 0 || comp.tfd >= 0) && (!comp.lockmem || RT_LockMemory()) &&
+		RT_ThreadAttr(&attr, comp.rtprio, comp.cpu))
+	{
+		bool ok = (pthread_create(&comp.thread, &attr, (comp.fps) ? compositor_paced : compositor_task, NULL) == 0);
+		pthread_attr_destroy(&attr);
+		if (ok)
+		{
+			__atomic_store_n(&comp.running, true, __ATOMIC_RELEASE);// Producers may now post
+			return true;
+		}
+	}
+	if (comp.tfd >= 0) close(comp.tfd);
+	DrawQ_Destroy(comp.q);
+	comp.q = 0;
+	ReleaseDC(comp.Dc);
+	return false;
+}
+
+/*-[ Compositor_Stop ]------------------------------------------------------}
+. Draws whatever is still in the ring then stops the compositor thread.
+. Tasks must have stopped posting before it is called.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Compositor_Stop (void)
+{
+	if (!comp.running) return false;								// Not running
+	__atomic_store_n(&comp.running, false, __ATOMIC_RELEASE);		// No more posts
+	__atomic_store_n(&comp.stop, true, __ATOMIC_RELEASE);
+	DrawQ_Wake(comp.q);												// Thread may be asleep
+	pthread_join(comp.thread, NULL);
+	if (comp.tfd >= 0) close(comp.tfd);
+	comp.tfd = -1;
+	DrawQ_Destroy(comp.q);
+	comp.q = 0;
+	ReleaseDC(comp.Dc);
+	return true;
+}
+
+/*-[ Compositor_SetFrameRate ]----------------------------------------------}
+. Sets the frame rate the next Compositor_Start runs at. With a rate the
+. compositor sends one flush per frame of everything posted in the frame,
+. 0 (the default) draws each command as it arrives.
+. RETURN: true for success, false if running or the rate is over 1000
+.--------------------------------------------------------------------------*/
+bool Compositor_SetFrameRate (uint16_t fps)
+{
+	if (comp.running || fps > 1000) return false;
+	comp.fps = fps;
+	return true;
+}
+
+/*-[ Compositor_SetRealtime ]-----------------------------------------------}
+. Sets how the next Compositor_Start runs its thread, at SCHED_FIFO
+. priority 1 to 99 (0 the normal scheduler, the default), only on cpu (-1
+. any cpu, the default) and with all process memory locked if lockmem. A
+. real time priority needs CAP_SYS_NICE or the start fails.
+. RETURN: true for success, false if running or the values are invalid
+.--------------------------------------------------------------------------*/
+bool Compositor_SetRealtime (uint8_t priority, int16_t cpu, bool lockmem)
+{
+	if (comp.running || priority > 99 || cpu < -1) return false;
+	comp.rtprio = priority;
+	comp.cpu = cpu;
+	comp.lockmem = lockmem;
+	return true;
+}
+
+/*-[ Compositor_Post ]------------------------------------------------------}
+. Posts a draw command, safe from any thread and never blocks.
+. RETURN: true for success, false if not running or the ring was full
+.--------------------------------------------------------------------------*/
+bool Compositor_Post (const DRAWCMD* cmd)
+{
+	if (!__atomic_load_n(&comp.running, __ATOMIC_ACQUIRE)) return false;// Compositor not running
+	return DrawQ_Push(comp.q, cmd);
+}
+
+/*-[ Compositor_Dropped ]---------------------------------------------------}
+. RETURN: count of commands dropped because the ring was full
+.--------------------------------------------------------------------------*/
+uint32_t Compositor_Dropped (void)
+{
+	return DrawQ_Dropped(comp.q);
+}
+
+/*-[ Compositor_Merged ]----------------------------------------------------}
+. RETURN: count of commands not drawn as a later command covered them
+.--------------------------------------------------------------------------*/
+uint32_t Compositor_Merged (void)
+{
+	return __atomic_load_n(&comp.merged, __ATOMIC_RELAXED);
+}
+
+/*-[ Compositor_Late ]------------------------------------------------------}
+. RETURN: count of prioritised areas sent after their deadline, regions and
+. DCs given a deadline with SetDCPriority
+.--------------------------------------------------------------------------*/
+uint32_t Compositor_Late (void)
+{
+	return __atomic_load_n(&comp.late, __ATOMIC_RELAXED);
+}
+
+/*-[ Compositor_Frames ]----------------------------------------------------}
+. RETURN: count of frame flushes sent when running with a frame rate
+.--------------------------------------------------------------------------*/
+uint32_t Compositor_Frames (void)
+{
+	return __atomic_load_n(&comp.frames, __ATOMIC_RELAXED);
+}
+
+/*-[ Compositor_Jitter ]----------------------------------------------------}
+. Gets the frame start jitter percentiles when running with a frame rate,
+. how late each frame tick was acted on and how many ticks were missed.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Compositor_Jitter (JITTER_STATS* stats)
+{
+	return Jitter_Stats(&comp.jitter, stats);
+}
+
+/*-[ Compositor_ClearScreen ]-----------------------------------------------}
+. Posts SSD1327_ClearScreen with the colour.
+. RETURN: true for success, false if not running or the ring was full
+.--------------------------------------------------------------------------*/
+bool Compositor_ClearScreen (uint8_t colour)
+{
+	DRAWCMD c = { .op = DRAW_CLEAR, .brushcolor = colour };
+	return Compositor_Post(&c);
+}
+
+/*-[ Compositor_Rectangle ]-------------------------------------------------}
+. Posts Rectangle in the current brush colour of the DC.
+. RETURN: true for success, false if not running or the ring was full
+.--------------------------------------------------------------------------*/
+bool Compositor_Rectangle (HDC Dc, uint16_t left, uint16_t top, uint16_t right, uint16_t bottom)
+{
+	DRAWCMD c = { .op = DRAW_RECT, .left = left, .top = top, .right = right, .bottom = bottom };
+	return cmd_post(Dc, &c);
+}
+
+/*-[ Compositor_FrameRect ]-------------------------------------------------}
+. Posts FrameRect in the current pen colour of the DC.
+. RETURN: true for success, false if not running or the ring was full
+.--------------------------------------------------------------------------*/
+bool Compositor_FrameRect (HDC Dc, uint16_t left, uint16_t top, uint16_t right, uint16_t bottom)
+{
+	DRAWCMD c = { .op = DRAW_FRAMERECT, .left = left, .top = top, .right = right, .bottom = bottom };
+	return cmd_post(Dc, &c);
+}
+
+/*-[ Compositor_Line ]------------------------------------------------------}
+. Posts a MoveTo (x1,y1) LineTo (x2,y2) in the current pen colour of the DC.
+. RETURN: true for success, false if not running or the ring was full
+.--------------------------------------------------------------------------*/
+bool Compositor_Line (HDC Dc, int16_t x1, int16_t y1, int16_t x2, int16_t y2)
+{
+	DRAWCMD c = { .op = DRAW_LINE, .left = x1, .top = y1, .right = x2, .bottom = y2 };
+	return cmd_post(Dc, &c);
+}
+
+/*-[ Compositor_Ellipse ]---------------------------------------------------}
+. Posts Ellipse in the current pen and brush colours of the DC.
+. RETURN: true for success, false if not running or the ring was full
+.--------------------------------------------------------------------------*/
+bool Compositor_Ellipse (HDC Dc, int16_t left, int16_t top, int16_t right, int16_t bottom)
+{
+	DRAWCMD c = { .op = DRAW_ELLIPSE, .left = left, .top = top, .right = right, .bottom = bottom };
+	return cmd_post(Dc, &c);
+}
+
+/*-[ Compositor_WriteText ]-------------------------------------------------}
+. Posts SSD1327_WriteText with the font, scale and text colours of the DC.
+. The text must fit in DRAWQ_MAXTEXT bytes with its terminator.
+. RETURN: true for success, false if not running, text too long or the
+. ring was full
+.--------------------------------------------------------------------------*/
+bool Compositor_WriteText (HDC Dc, uint16_t x, uint16_t y, const char* txt)
+{
+	DRAWCMD c = { .op = DRAW_TEXT, .left = x, .top = y };
+	return text_copy(&c, txt) && cmd_post(Dc, &c);
+}
+
+/*-[ Compositor_DrawNumber ]------------------------------------------------}
+. Posts DrawNumber with the font, scale and text colours of the DC.
+. RETURN: true for success, false if not running or the ring was full
+.--------------------------------------------------------------------------*/
+bool Compositor_DrawNumber (HDC Dc, uint16_t x, uint16_t y, int32_t value, uint8_t width, uint16_t flags)
+{
+	DRAWCMD c = { .op = DRAW_NUMBER, .left = x, .top = y, .width = width, .value = value, .flags = flags };
+	return cmd_post(Dc, &c);
+}
+
+/*-[ Compositor_CreateRegion ]----------------------------------------------}
+. Binds a region mailbox to the rectangle, right and bottom exclusive.
+. RETURN: valid HREGION for success, NULL if none free or rectangle empty
+.--------------------------------------------------------------------------*/
+HREGION Compositor_CreateRegion (uint16_t left, uint16_t top, uint16_t right, uint16_t bottom)
+{
+	if (left >= right || top >= bottom) return 0;					// Empty rectangle
+	for (uint16_t i = 0; i < MAX_REGION; i++)
+	{
+		struct region* r = &region_table[i];
+		uint8_t expect = REGION_FREE;
+		if (__atomic_compare_exchange_n(&r->state, &expect, REGION_CLAIMED, false,
+			__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))					// We got this entry
+		{
+			r->rc = (RECT){ left, top, right, bottom };
+			r->back = 0;											// Producer fills frame 0 first
+			r->front = 1;
+			r->ready = 2;											// Nothing fresh yet
+			r->priority = 0;										// Background until set
+			r->deadline = 0;
+			r->frame[0].count = 0;
+			__atomic_store_n(&r->state, REGION_LIVE, __ATOMIC_RELEASE);// Compositor may now look at it
+			return r;
+		}
+	}
+	return 0;														// No region free
+}
+
+/*-[ Compositor_SetRegionPriority ]-----------------------------------------}
+. Sets the flush priority of content published to the region from here on,
+. 0 (the default) is background and higher is more urgent. The deadline is
+. milliseconds from publish the content should be on the screen by. With a
+. frame rate each frame sends higher priority areas first, earliest
+. deadline first within a priority, and background only if the frame has
+. bus time left. Only the thread that publishes may set it.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Compositor_SetRegionPriority (HREGION rgn, uint8_t priority, uint16_t deadline)
+{
+	if (rgn == 0 || __atomic_load_n(&rgn->state, __ATOMIC_ACQUIRE) != REGION_LIVE) return false;
+	rgn->priority = priority;
+	rgn->deadline = deadline;
+	return true;
+}
+
+/*-[ Compositor_DeleteRegion ]----------------------------------------------}
+. Unbinds the region, what it last drew stays on the screen. Content not
+. yet drawn is dropped.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Compositor_DeleteRegion (HREGION rgn)
+{
+	if (rgn == 0 || __atomic_load_n(&rgn->state, __ATOMIC_ACQUIRE) != REGION_LIVE) return false;
+	if (__atomic_load_n(&comp.running, __ATOMIC_ACQUIRE))
+		__atomic_store_n(&rgn->state, REGION_DYING, __ATOMIC_RELEASE);// Compositor frees it once not drawing it
+	else __atomic_store_n(&rgn->state, REGION_FREE, __ATOMIC_RELEASE);
+	return true;
+}
+
+/*-[ Compositor_RegionAdd ]-------------------------------------------------}
+. Adds a command to the content being built for the region, styled from
+. the DC if one is given. Only the thread that publishes may add.
+. RETURN: true for success, false if the frame is full or the command
+. goes outside the region
+.--------------------------------------------------------------------------*/
+bool Compositor_RegionAdd (HREGION rgn, HDC Dc, const DRAWCMD* cmd)
+{
+	if (rgn == 0 || cmd == 0 || !region_contains(&rgn->rc, cmd)) return false;
+	struct region_frame* f = &rgn->frame[rgn->back];
+	if (f->count >= COMPOSITOR_REGIONCMDS) return false;			// Frame full
+	f->cmd[f->count] = *cmd;
+	cmd_fill(Dc, &f->cmd[f->count]);
+	f->count++;
+	return true;
+}
+
+/*-[ Compositor_RegionRectangle ]-------------------------------------------}
+. Adds a Rectangle in the brush colour of the DC to the region content.
+. RETURN: true for success, false if the frame is full or the rectangle
+. goes outside the region
+.--------------------------------------------------------------------------*/
+bool Compositor_RegionRectangle (HREGION rgn, HDC Dc, uint16_t left, uint16_t top, uint16_t right, uint16_t bottom)
+{
+	DRAWCMD c = { .op = DRAW_RECT, .left = left, .top = top, .right = right, .bottom = bottom };
+	return Compositor_RegionAdd(rgn, Dc, &c);
+}
+
+/*-[ Compositor_RegionText ]------------------------------------------------}
+. Adds SSD1327_WriteText with the font and colours of the DC to the region
+. content, the text must start inside the region.
+. RETURN: true for success, false if the frame is full, text too long or
+. it starts outside the region
+.--------------------------------------------------------------------------*/
+bool Compositor_RegionText (HREGION rgn, HDC Dc, uint16_t x, uint16_t y, const char* txt)
+{
+	DRAWCMD c = { .op = DRAW_TEXT, .left = x, .top = y };
+	return text_copy(&c, txt) && Compositor_RegionAdd(rgn, Dc, &c);
+}
+
+/*-[ Compositor_RegionNumber ]----------------------------------------------}
+. Adds DrawNumber with the font and colours of the DC to the region
+. content, the number must start inside the region.
+. RETURN: true for success, false if the frame is full or it starts outside
+. the region
+.--------------------------------------------------------------------------*/
+bool Compositor_RegionNumber (HREGION rgn, HDC Dc, uint16_t x, uint16_t y, int32_t value, uint8_t width, uint16_t flags)
+{
+	DRAWCMD c = { .op = DRAW_NUMBER, .left = x, .top = y, .width = width, .value = value, .flags = flags };
+	return Compositor_RegionAdd(rgn, Dc, &c);
+}
+
+/*-[ Compositor_PublishRegion ]---------------------------------------------}
+. Publishes the content built for the region, replacing any earlier
+. content not yet drawn, and starts building new content from empty.
+. Never blocks.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Compositor_PublishRegion (HREGION rgn)
+{
+	if (rgn == 0 || __atomic_load_n(&rgn->state, __ATOMIC_ACQUIRE) != REGION_LIVE) return false;
+	rgn->frame[rgn->back].priority = rgn->priority;					// Frame carries its priority
+	rgn->frame[rgn->back].due = now_us() + rgn->deadline * 1000UL;	// and when it is due on screen
+	uint8_t old = __atomic_exchange_n(&rgn->ready, rgn->back | REGION_FRESH, __ATOMIC_ACQ_REL);
+	if (old & REGION_FRESH)											// Compositor never drew the last one
+		__atomic_fetch_add(&comp.superseded, 1, __ATOMIC_RELAXED);
+	rgn->back = old & 3;											// Old ready frame is ours now
+	rgn->frame[rgn->back].count = 0;								// Start new content from empty
+	if (__atomic_load_n(&comp.running, __ATOMIC_ACQUIRE))
+		DrawQ_Wake(comp.q);											// Compositor may be asleep
+	return true;
+}
+
+/*-[ Compositor_Superseded ]------------------------------------------------}
+. RETURN: count of region contents replaced before they were drawn
+.--------------------------------------------------------------------------*/
+uint32_t Compositor_Superseded (void)
+{
+	return __atomic_load_n(&comp.superseded, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,228 @@
+#ifndef _COMPOSITOR_H_
+#define _COMPOSITOR_H_
+
+#ifdef __cplusplus								// If we are including to a C++
+extern "C" {									// Put extern C directive wrapper around
+#endif
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++}
+{																			}
+{       Filename: compositor.h												}
+{       Copyright: Leon de Boer(LdB) 2020									}
+{       Version: 1.00														}
+{		Release under MIT license (https://opensource.org/licenses/MIT)     }
+{																			}
+{***************************************************************************}
+{                                                                           }
+{      Defines a display compositor thread that owns the SSD1327. Tasks	}
+{      post draw commands to it through a lock free ring and never wait	}
+{      on the SPI bus or on each other.										}
+{																            }
+{++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
+{  1.00 Initial version														}
+{++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#include <stdbool.h>							// C standard unit for bool, true, false
+#include <stdint.h>								// C standard unit for uint32_t etc
+#include "drawq.h"								// Draw command ring
+#include "gpio.h"								// GPIO_HANDLE used by SSD1327 header
+#include "ssd1327.h"							// SSD1327 device and DC routines
+#include "rtsched.h"							// Real time set up and jitter stats
+
+#define COMPOSITOR_DRIVER_VERSION 1000			// Version number 1.00 build 0
+
+#define COMPOSITOR_BATCH ( 32 )					// Commands taken off the ring and merged at a time
+#define COMPOSITOR_REGIONCMDS ( 4 )				// Most commands in one region content
+#define COMPOSITOR_BUDGET ( 75 )				// Percent of a frame background flushing may start within
+
+/*--------------------------------------------------------------------------}
+{   HREGION is an opaque struct ptr to a latest value wins mailbox bound	}
+{   to a rectangle. A task builds the whole content of its rectangle and	}
+{   publishes it, the compositor only ever draws the newest published.		}
+{--------------------------------------------------------------------------*/
+typedef struct region* HREGION;
+
+/*-[ Compositor_SetFrameRate ]----------------------------------------------}
+. Sets the frame rate the next Compositor_Start runs at. With a rate the
+. compositor sends one flush per frame of everything posted in the frame,
+. 0 (the default) draws each command as it arrives.
+. RETURN: true for success, false if running or the rate is over 1000
+.--------------------------------------------------------------------------*/
+bool Compositor_SetFrameRate (uint16_t fps);
+
+/*-[ Compositor_SetRealtime ]-----------------------------------------------}
+. Sets how the next Compositor_Start runs its thread, at SCHED_FIFO
+. priority 1 to 99 (0 the normal scheduler, the default), only on cpu (-1
+. any cpu, the default) and with all process memory locked if lockmem. A
+. real time priority needs CAP_SYS_NICE or the start fails.
+. RETURN: true for success, false if running or the values are invalid
+.--------------------------------------------------------------------------*/
+bool Compositor_SetRealtime (uint8_t priority, int16_t cpu, bool lockmem);
+
+/*-[ Compositor_Start ]-----------------------------------------------------}
+. Starts the compositor thread with a ring of slots commands. The SSD1327
+. must already be open and from here on only the compositor may draw on it
+. until Compositor_Stop. There is one compositor, other devices are drawn
+. on directly.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Compositor_Start (SSD1327_HANDLE dev, uint16_t slots);
+
+/*-[ Compositor_Stop ]------------------------------------------------------}
+. Draws whatever is still in the ring then stops the compositor thread.
+. Tasks must have stopped posting before it is called.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Compositor_Stop (void);
+
+/*-[ Compositor_Post ]------------------------------------------------------}
+. Posts a draw command, safe from any thread and never blocks.
+. RETURN: true for success, false if not running or the ring was full
+.--------------------------------------------------------------------------*/
+bool Compositor_Post (const DRAWCMD* cmd);
+
+/*-[ Compositor_Dropped ]---------------------------------------------------}
+. RETURN: count of commands dropped because the ring was full
+.--------------------------------------------------------------------------*/
+uint32_t Compositor_Dropped (void);
+
+/*-[ Compositor_Merged ]----------------------------------------------------}
+. RETURN: count of commands not drawn as a later command covered them
+.--------------------------------------------------------------------------*/
+uint32_t Compositor_Merged (void);
+
+/*-[ Compositor_Late ]------------------------------------------------------}
+. RETURN: count of prioritised areas sent after their deadline, regions and
+. DCs given a deadline with SetDCPriority
+.--------------------------------------------------------------------------*/
+uint32_t Compositor_Late (void);
+
+/*-[ Compositor_Frames ]----------------------------------------------------}
+. RETURN: count of frame flushes sent when running with a frame rate
+.--------------------------------------------------------------------------*/
+uint32_t Compositor_Frames (void);
+
+/*-[ Compositor_Jitter ]----------------------------------------------------}
+. Gets the frame start jitter percentiles when running with a frame rate,
+. how late each frame tick was acted on and how many ticks were missed.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Compositor_Jitter (JITTER_STATS* stats);
+
+/*-[ Compositor_ClearScreen ]-----------------------------------------------}
+. Posts SSD1327_ClearScreen with the colour.
+. RETURN: true for success, false if not running or the ring was full
+.--------------------------------------------------------------------------*/
+bool Compositor_ClearScreen (uint8_t colour);
+
+/*-[ Compositor_Rectangle ]-------------------------------------------------}
+. Posts Rectangle in the current brush colour of the DC.
+. RETURN: true for success, false if not running or the ring was full
+.--------------------------------------------------------------------------*/
+bool Compositor_Rectangle (HDC Dc, uint16_t left, uint16_t top, uint16_t right, uint16_t bottom);
+
+/*-[ Compositor_FrameRect ]-------------------------------------------------}
+. Posts FrameRect in the current pen colour of the DC.
+. RETURN: true for success, false if not running or the ring was full
+.--------------------------------------------------------------------------*/
+bool Compositor_FrameRect (HDC Dc, uint16_t left, uint16_t top, uint16_t right, uint16_t bottom);
+
+/*-[ Compositor_Line ]------------------------------------------------------}
+. Posts a MoveTo (x1,y1) LineTo (x2,y2) in the current pen colour of the DC.
+. RETURN: true for success, false if not running or the ring was full
+.--------------------------------------------------------------------------*/
+bool Compositor_Line (HDC Dc, int16_t x1, int16_t y1, int16_t x2, int16_t y2);
+
+/*-[ Compositor_Ellipse ]---------------------------------------------------}
+. Posts Ellipse in the current pen and brush colours of the DC.
+. RETURN: true for success, false if not running or the ring was full
+.--------------------------------------------------------------------------*/
+bool Compositor_Ellipse (HDC Dc, int16_t left, int16_t top, int16_t right, int16_t bottom);
+
+/*-[ Compositor_WriteText ]-------------------------------------------------}
+. Posts SSD1327_WriteText with the font, scale and text colours of the DC.
+. The text must fit in DRAWQ_MAXTEXT bytes with its terminator.
+. RETURN: true for success, false if not running, text too long or the
+. ring was full
+.--------------------------------------------------------------------------*/
+bool Compositor_WriteText (HDC Dc, uint16_t x, uint16_t y, const char* txt);
+
+/*-[ Compositor_DrawNumber ]------------------------------------------------}
+. Posts DrawNumber with the font, scale and text colours of the DC.
+. RETURN: true for success, false if not running or the ring was full
+.--------------------------------------------------------------------------*/
+bool Compositor_DrawNumber (HDC Dc, uint16_t x, uint16_t y, int32_t value, uint8_t width, uint16_t flags);
+
+/*-[ Compositor_CreateRegion ]----------------------------------------------}
+. Binds a region mailbox to the rectangle, right and bottom exclusive.
+. RETURN: valid HREGION for success, NULL if none free or rectangle empty
+.--------------------------------------------------------------------------*/
+HREGION Compositor_CreateRegion (uint16_t left, uint16_t top, uint16_t right, uint16_t bottom);
+
+/*-[ Compositor_SetRegionPriority ]-----------------------------------------}
+. Sets the flush priority of content published to the region from here on,
+. 0 (the default) is background and higher is more urgent. The deadline is
+. milliseconds from publish the content should be on the screen by. With a
+. frame rate each frame sends higher priority areas first, earliest
+. deadline first within a priority, and background only if the frame has
+. bus time left. Only the thread that publishes may set it.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Compositor_SetRegionPriority (HREGION rgn, uint8_t priority, uint16_t deadline);
+
+/*-[ Compositor_DeleteRegion ]----------------------------------------------}
+. Unbinds the region, what it last drew stays on the screen. Content not
+. yet drawn is dropped.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Compositor_DeleteRegion (HREGION rgn);
+
+/*-[ Compositor_RegionAdd ]-------------------------------------------------}
+. Adds a command to the content being built for the region, styled from
+. the DC if one is given. Only the thread that publishes may add.
+. RETURN: true for success, false if the frame is full or the command
+. goes outside the region
+.--------------------------------------------------------------------------*/
+bool Compositor_RegionAdd (HREGION rgn, HDC Dc, const DRAWCMD* cmd);
+
+/*-[ Compositor_RegionRectangle ]-------------------------------------------}
+. Adds a Rectangle in the brush colour of the DC to the region content.
+. RETURN: true for success, false if the frame is full or the rectangle
+. goes outside the region
+.--------------------------------------------------------------------------*/
+bool Compositor_RegionRectangle (HREGION rgn, HDC Dc, uint16_t left, uint16_t top, uint16_t right, uint16_t bottom);
+
+/*-[ Compositor_RegionText ]------------------------------------------------}
+. Adds SSD1327_WriteText with the font and colours of the DC to the region
+. content, the text must start inside the region.
+. RETURN: true for success, false if the frame is full, text too long or
+. it starts outside the region
+.--------------------------------------------------------------------------*/
+bool Compositor_RegionText (HREGION rgn, HDC Dc, uint16_t x, uint16_t y, const char* txt);
+
+/*-[ Compositor_RegionNumber ]----------------------------------------------}
+. Adds DrawNumber with the font and colours of the DC to the region
+. content, the number must start inside the region.
+. RETURN: true for success, false if the frame is full or it starts outside
+. the region
+.--------------------------------------------------------------------------*/
+bool Compositor_RegionNumber (HREGION rgn, HDC Dc, uint16_t x, uint16_t y, int32_t value, uint8_t width, uint16_t flags);
+
+/*-[ Compositor_PublishRegion ]---------------------------------------------}
+. Publishes the content built for the region, replacing any earlier
+. content not yet drawn, and starts building new content from empty.
+. Never blocks.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Compositor_PublishRegion (HREGION rgn);
+
+/*-[ Compositor_Superseded ]------------------------------------------------}
+. RETURN: count of region contents replaced before they were drawn
+.--------------------------------------------------------------------------*/
+uint32_t Compositor_Superseded (void);
+
+#ifdef __cplusplus								// If we are including to a C++ file
+}												// Close the extern C directive wrapper
+#endif
+
+#endif
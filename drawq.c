@@ -0,0 +1,186 @@
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++}
+{																			}
+{       Filename: drawq.c													}
+{       Copyright(c): Leon de Boer(LdB) 2020								}
+{       Version: 1.00														}
+{		Release under MIT license (https://opensource.org/licenses/MIT)     }
+{																			}
+{***************************************************************************}
+{                                                                           }
+{      Defines a lock free multi producer single consumer ring of draw		}
+{      commands. Any number of threads can post without ever blocking and	}
+{      one thread takes the commands off in the order they were posted.	}
+{																            }
+{++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
+{  1.00 Initial version														}
+{++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#include <stdbool.h>							// C standard unit for bool, true, false
+#include <stdint.h>								// C standard unit for uint32_t etc
+#include <stdlib.h>								// C standard unit needed for aligned_alloc, free
+#include <errno.h>								// Needed for EINTR
+#include <semaphore.h>							// Sleeping consumer waits on a semaphore
+#include "drawq.h"								// This units header
+
+#if DRAWQ_DRIVER_VERSION != 1000
+#error "Header does not match this version of file"
+#endif
+
+#define CACHE_LINE ( 64 )						// Bytes in a cache line
+
+/*--------------------------------------------------------------------------}
+{   Each slot has a sequence number saying whose turn it is. A slot at		}
+{   position pos is free for the producer that claims pos when seq == pos,	}
+{   holds a command for the consumer when seq == pos + 1 and is handed		}
+{   back for the next lap by setting seq to pos + slots.					}
+{--------------------------------------------------------------------------*/
+struct draw_slot
+{
+	uint32_t seq;								// Sequence number of slot
+	DRAWCMD cmd;								// Command held
+} __attribute__((aligned(CACHE_LINE)));
+
+_Static_assert(sizeof(struct draw_slot) == CACHE_LINE, "draw slot should be one cache line");
+
+struct draw_queue
+{
+	uint32_t tail __attribute__((aligned(CACHE_LINE)));// Next position producers claim
+	uint32_t dropped;							// Commands dropped as ring was full
+	uint32_t head __attribute__((aligned(CACHE_LINE)));// Next position consumer takes, consumer only
+	uint32_t mask;								// Slots - 1
+	uint32_t sleeping;							// Consumer is asleep in DrawQ_Wait
+	uint32_t kicked;							// DrawQ_Wake called since consumer last woke
+	sem_t wake;									// Posted to wake sleeping consumer
+	struct draw_slot* slots;					// The ring
+};
+
+/*-[ DrawQ_Create ]---------------------------------------------------------}
+. Creates a ring of slots draw commands, slots is rounded up to a power of
+. two (at least 2).
+. RETURN: valid DRAWQ_HANDLE for success, NULL for any failure
+.--------------------------------------------------------------------------*/
+DRAWQ_HANDLE DrawQ_Create (uint16_t slots)
+{
+	uint32_t n = 2;
+	while (n < slots) n <<= 1;										// Round up to power of two
+	struct draw_queue* q = aligned_alloc(CACHE_LINE, sizeof(struct draw_queue));
+	if (q == 0) return 0;											// Allocation failed
+	q->slots = aligned_alloc(CACHE_LINE, n * sizeof(struct draw_slot));
+	if (q->slots == 0 || sem_init(&q->wake, 0, 0) != 0)				// Ring or semaphore failed
+	{
+		free(q->slots);
+		free(q);
+		return 0;
+	}
+	for (uint32_t i = 0; i < n; i++)
+		q->slots[i].seq = i;										// Every slot free for first lap
+	q->tail = 0;
+	q->head = 0;
+	q->dropped = 0;
+	q->mask = n - 1;
+	q->sleeping = 0;
+	q->kicked = 0;
+	return q;
+}
+
+/*-[ DrawQ_Destroy ]--------------------------------------------------------}
+. Frees the ring, no thread may be using it.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool DrawQ_Destroy (DRAWQ_HANDLE q)
+{
+	if (q == 0) return false;
+	sem_destroy(&q->wake);
+	free(q->slots);
+	free(q);
+	return true;
+}
+
+/*-[ DrawQ_Push ]-----------------------------------------------------------}
+. Copies the command into the ring, safe from any number of threads. It
+. never blocks, if the ring is full the command is dropped and counted.
+. RETURN: true for success, false if the ring was full
+.--------------------------------------------------------------------------*/
+bool DrawQ_Push (DRAWQ_HANDLE q, const DRAWCMD* cmd)
+{
+	if (q == 0 || cmd == 0) return false;
+	struct draw_slot* s;
+	uint32_t pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+	for (;;)
+	{
+		s = &q->slots[pos & q->mask];
+		int32_t dif = (int32_t)(__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) - pos);
+		if (dif == 0)												// Slot free, try to claim position
+		{
+			if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, true,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;			// Claimed, on failure pos is reloaded
+		} else if (dif < 0) {										// Slot not yet taken by consumer
+			__atomic_fetch_add(&q->dropped, 1, __ATOMIC_RELAXED);
+			return false;											// Ring full
+		} else pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);	// Another producer got there first
+	}
+	s->cmd = *cmd;													// Fill our slot
+	__atomic_store_n(&s->seq, pos + 1, __ATOMIC_RELEASE);			// Hand it to the consumer
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);						// Publish before looking for sleeper
+	if (__atomic_load_n(&q->sleeping, __ATOMIC_RELAXED)
+		&& __atomic_exchange_n(&q->sleeping, 0, __ATOMIC_ACQ_REL))	// We are the one to wake it
+		sem_post(&q->wake);
+	return true;
+}
+
+/*-[ DrawQ_Pop ]------------------------------------------------------------}
+. Takes the oldest command off the ring, only one thread may pop.
+. RETURN: true and cmd set if there was a command, false if ring empty
+.--------------------------------------------------------------------------*/
+bool DrawQ_Pop (DRAWQ_HANDLE q, DRAWCMD* cmd)
+{
+	if (q == 0 || cmd == 0) return false;
+	struct draw_slot* s = &q->slots[q->head & q->mask];
+	if (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != q->head + 1)
+		return false;												// Nothing posted yet
+	*cmd = s->cmd;													// Copy command out
+	__atomic_store_n(&s->seq, q->head + q->mask + 1, __ATOMIC_RELEASE);// Slot free for next lap
+	q->head++;
+	return true;
+}
+
+/*-[ DrawQ_Wait ]-----------------------------------------------------------}
+. Called by the popping thread, sleeps until a command is posted or
+. DrawQ_Wake is called. Returns at once if a command is waiting or there
+. was a DrawQ_Wake since the last return.
+.--------------------------------------------------------------------------*/
+void DrawQ_Wait (DRAWQ_HANDLE q)
+{
+	if (q == 0) return;
+	__atomic_store_n(&q->sleeping, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);						// Flag seen before we look at ring
+	if ((__atomic_load_n(&q->slots[q->head & q->mask].seq, __ATOMIC_ACQUIRE) == q->head + 1
+		|| __atomic_load_n(&q->kicked, __ATOMIC_RELAXED))			// Command or wake already there
+		&& __atomic_exchange_n(&q->sleeping, 0, __ATOMIC_ACQ_REL))	// and nobody is going to post
+	{
+		__atomic_store_n(&q->kicked, 0, __ATOMIC_SEQ_CST);
+		return;
+	}
+	while (sem_wait(&q->wake) != 0 && errno == EINTR);				// Whoever cleared the flag posts
+	__atomic_store_n(&q->kicked, 0, __ATOMIC_SEQ_CST);				// Caller looks for the work next
+}
+
+/*-[ DrawQ_Wake ]-----------------------------------------------------------}
+. Wakes the popping thread if it is sleeping in DrawQ_Wait, if it is not
+. its next DrawQ_Wait returns at once.
+.--------------------------------------------------------------------------*/
+void DrawQ_Wake (DRAWQ_HANDLE q)
+{
+	if (q == 0) return;
+	__atomic_store_n(&q->kicked, 1, __ATOMIC_SEQ_CST);				// Seen by a consumer about to sleep
+	if (__atomic_exchange_n(&q->sleeping, 0, __ATOMIC_SEQ_CST))		// Consumer was asleep
+		sem_post(&q->wake);
+}
+
+/*-[ DrawQ_Dropped ]--------------------------------------------------------}
+. RETURN: count of commands dropped because the ring was full
+.--------------------------------------------------------------------------*/
+uint32_t DrawQ_Dropped (DRAWQ_HANDLE q)
+{
+	return (q) ? __atomic_load_n(&q->dropped, __ATOMIC_RELAXED) : 0;
+}
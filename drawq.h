@@ -0,0 +1,120 @@
+#ifndef _DRAWQ_H_
+#define _DRAWQ_H_
+
+#ifdef __cplusplus								// If we are including to a C++
+extern "C" {									// Put extern C directive wrapper around
+#endif
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++}
+{																			}
+{       Filename: drawq.h													}
+{       Copyright: Leon de Boer(LdB) 2020									}
+{       Version: 1.00														}
+{		Release under MIT license (https://opensource.org/licenses/MIT)     }
+{																			}
+{***************************************************************************}
+{                                                                           }
+{      Defines a lock free multi producer single consumer ring of draw		}
+{      commands. Any number of threads can post without ever blocking and	}
+{      one thread takes the commands off in the order they were posted.	}
+{																            }
+{++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
+{  1.00 Initial version														}
+{++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#include <stdbool.h>							// C standard unit for bool, true, false
+#include <stdint.h>								// C standard unit for uint32_t etc
+
+#define DRAWQ_DRIVER_VERSION 1000				// Version number 1.00 build 0
+
+typedef enum {
+	DRAW_NONE = 0,								// Does nothing
+	DRAW_CLEAR = 1,								// Clear screen to brush colour
+	DRAW_RECT = 2,								// Rectangle filled in brush colour
+	DRAW_FRAMERECT = 3,							// Rectangle outlined in pen colour
+	DRAW_LINE = 4,								// Line in pen colour from (left,top) to (right,bottom)
+	DRAW_ELLIPSE = 5,							// Ellipse in pen and brush colours
+	DRAW_TEXT = 6,								// Text at (left,top)
+	DRAW_NUMBER = 7,							// DrawNumber of value at (left,top)
+} DRAWOP;
+
+#define DRAWQ_MAXTEXT ( 32 )					// Longest DRAW_TEXT string including terminator
+
+/*--------------------------------------------------------------------------}
+{   A draw command carries everything needed to draw it, the colours, font	}
+{   and scale are copied from the posting threads DC so the DC can change	}
+{   straight after posting. It is sized so a ring slot is one cache line.	}
+{--------------------------------------------------------------------------*/
+typedef struct draw_cmd
+{
+	uint8_t op;									// DRAWOP
+	uint8_t fontnum;							// Font for DRAW_TEXT and DRAW_NUMBER
+	uint8_t textscale;							// Text scale 1 to 4
+	uint8_t width;								// DRAW_NUMBER width in characters
+	uint8_t txtcolor;							// Text colour
+	uint8_t bkcolor;							// Text background colour
+	uint8_t pencolor;							// Pen colour
+	uint8_t brushcolor;							// Brush colour
+	int16_t left;								// Left or x, also x1 of DRAW_LINE
+	int16_t top;								// Top or y, also y1 of DRAW_LINE
+	int16_t right;								// Right exclusive, also x2 of DRAW_LINE
+	int16_t bottom;								// Bottom exclusive, also y2 of DRAW_LINE
+	int32_t value;								// DRAW_NUMBER value
+	uint16_t flags;								// DRAW_NUMBER DN_ flags
+	uint8_t priority;							// Flush priority, 0 is background
+	uint8_t timed;								// Has a deadline, due is valid
+	uint32_t due;								// Deadline in us of the compositor clock
+	char text[DRAWQ_MAXTEXT];					// DRAW_TEXT UTF-8 string
+} DRAWCMD;
+
+typedef struct draw_queue* DRAWQ_HANDLE;		// Define a DRAWQ_HANDLE pointer to opaque internal struct
+
+/*-[ DrawQ_Create ]---------------------------------------------------------}
+. Creates a ring of slots draw commands, slots is rounded up to a power of
+. two (at least 2).
+. RETURN: valid DRAWQ_HANDLE for success, NULL for any failure
+.--------------------------------------------------------------------------*/
+DRAWQ_HANDLE DrawQ_Create (uint16_t slots);
+
+/*-[ DrawQ_Destroy ]--------------------------------------------------------}
+. Frees the ring, no thread may be using it.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool DrawQ_Destroy (DRAWQ_HANDLE q);
+
+/*-[ DrawQ_Push ]-----------------------------------------------------------}
+. Copies the command into the ring, safe from any number of threads. It
+. never blocks, if the ring is full the command is dropped and counted.
+. RETURN: true for success, false if the ring was full
+.--------------------------------------------------------------------------*/
+bool DrawQ_Push (DRAWQ_HANDLE q, const DRAWCMD* cmd);
+
+/*-[ DrawQ_Pop ]------------------------------------------------------------}
+. Takes the oldest command off the ring, only one thread may pop.
+. RETURN: true and cmd set if there was a command, false if ring empty
+.--------------------------------------------------------------------------*/
+bool DrawQ_Pop (DRAWQ_HANDLE q, DRAWCMD* cmd);
+
+/*-[ DrawQ_Wait ]-----------------------------------------------------------}
+. Called by the popping thread, sleeps until a command is posted or
+. DrawQ_Wake is called. Returns at once if a command is waiting or there
+. was a DrawQ_Wake since the last return.
+.--------------------------------------------------------------------------*/
+void DrawQ_Wait (DRAWQ_HANDLE q);
+
+/*-[ DrawQ_Wake ]-----------------------------------------------------------}
+. Wakes the popping thread if it is sleeping in DrawQ_Wait, if it is not
+. its next DrawQ_Wait returns at once.
+.--------------------------------------------------------------------------*/
+void DrawQ_Wake (DRAWQ_HANDLE q);
+
+/*-[ DrawQ_Dropped ]--------------------------------------------------------}
+. RETURN: count of commands dropped because the ring was full
+.--------------------------------------------------------------------------*/
+uint32_t DrawQ_Dropped (DRAWQ_HANDLE q);
+
+#ifdef __cplusplus								// If we are including to a C++ file
+}												// Close the extern C directive wrapper
+#endif
+
+#endif
@@ -0,0 +1,430 @@
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++}
+{																			}
+{       Filename: eventloop.c												}
+{       Copyright(c): Leon de Boer(LdB) 2020								}
+{       Version: 1.00														}
+{		Release under MIT license (https://opensource.org/licenses/MIT)     }
+{																			}
+{***************************************************************************}
+{                                                                           }
+{      Defines a single threaded event loop on one epoll fd. Periodic		}
+{      timers, GPIO events, any file descriptor and the SSD1327 frame		}
+{      flush are all run from the one thread with no sleeps.				}
+{																            }
+{++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
+{  1.00 Initial version														}
+{++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+#define _POSIX_C_SOURCE 200809L				// Needed for clock_gettime and CLOCK_MONOTONIC under -std=c11
+#include <stdbool.h>							// C standard unit for bool, true, false
+#include <stdint.h>								// C standard unit for uint32_t etc
+#include <stdlib.h>								// C standard unit needed for calloc, free
+#include <unistd.h>								// Needed for read, write, close
+#include <errno.h>								// Needed for EINTR
+#include <time.h>								// Needed for clock_gettime
+#include <sys/epoll.h>							// Every source is waited on with one epoll
+#include <sys/timerfd.h>						// Timers are timerfds
+#include <sys/eventfd.h>						// Quit from another thread is an eventfd
+#include "gpio.h"								// GPIO events can be watched
+#include "ssd1327.h"							// Frame flush of the SSD1327
+#include "eventloop.h"							// This units header
+
+#if EVENTLOOP_DRIVER_VERSION != 1000
+#error "Header does not match this version of file"
+#endif
+
+enum event_kind { EV_TIMER, EV_FD, EV_GPIO, EV_FRAMETICK, EV_FRAME };
+
+struct event_source
+{
+	struct event_loop* loop;					// Loop source belongs to
+	struct event_source* next;					// Next source of loop
+	EVENT_HANDLER handler;						// Handler to call
+	void* arg;									// Handler arg
+	int fd;										// Descriptor in epoll, -1 for a frame handler
+	uint8_t kind;								// enum event_kind
+	bool dead;									// Removed, freed once no handler can be using it
+	bool ownfd;									// fd is ours to close
+	uint8_t pin;								// GPIO pin watched
+	GPIO_HANDLE gpio;							// GPIO watched
+};
+
+struct event_loop
+{
+	int epfd;									// The one epoll fd
+	int quitfd;									// eventfd written by EventLoop_Quit
+	bool quit;									// Run should return
+	bool running;								// Run is running
+	bool dead;									// A source was removed, sweep after dispatch
+	struct event_source* frametick;				// Frame timer when a frame rate is set
+	uint8_t ndev;								// Devices flushed each frame
+	SSD1327_HANDLE dev[EVENTLOOP_MAXDEV];		// The devices
+	HFLUSHGROUP group;							// Flushes the devices in parallel
+	struct event_source* sources;				// Every source of the loop
+};
+
+/***************************************************************************}
+{                       PRIVATE INTERNAL ROUTINES                           }
+{***************************************************************************/
+
+/*-[ INTERNAL: timer_arm ]--------------------------------------------------}
+. Arms a timerfd to first expire first_ns from now then every period_ns,
+. as absolute times so the period never drifts.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+static bool timer_arm (int fd, uint64_t first_ns, uint64_t period_ns)
+{
+	struct itimerspec its;
+	clock_gettime(CLOCK_MONOTONIC, &its.it_value);
+	first_ns += its.it_value.tv_nsec;								// Absolute first expiry
+	its.it_value.tv_sec += first_ns / 1000000000ULL;
+	its.it_value.tv_nsec = first_ns % 1000000000ULL;
+	its.it_interval.tv_sec = period_ns / 1000000000ULL;
+	its.it_interval.tv_nsec = period_ns % 1000000000ULL;
+	return (timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL) == 0);
+}
+
+/*-[ INTERNAL: timer_ticks ]------------------------------------------------}
+. RETURN: expiries of a timerfd since last read, 0 if none
+.--------------------------------------------------------------------------*/
+static uint32_t timer_ticks (int fd)
+{
+	uint64_t ticks;
+	if (read(fd, &ticks, sizeof(ticks)) != sizeof(ticks)) return 0;// Nothing or rearmed since epoll said so
+	return (ticks > UINT32_MAX) ? UINT32_MAX : (uint32_t)ticks;
+}
+
+/*-[ INTERNAL: source_add ]-------------------------------------------------}
+. Creates a source, adds its fd to epoll and links it into the loop. On
+. failure an owned fd is closed.
+. RETURN: valid HEVENT for success, NULL for any failure
+.--------------------------------------------------------------------------*/
+static HEVENT source_add (EVLOOP_HANDLE loop, uint8_t kind, int fd, bool ownfd, uint32_t events, EVENT_HANDLER handler, void* arg)
+{
+	struct event_source* ev = calloc(1, sizeof(struct event_source));
+	if (ev && fd >= 0)
+	{
+		struct epoll_event ee = { .events = events, .data.ptr = ev };
+		if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ee) != 0)		// Epoll would not take it
+		{
+			free(ev);
+			ev = 0;
+		}
+	}
+	if (ev == 0)
+	{
+		if (ownfd && fd >= 0) close(fd);
+		return 0;
+	}
+	ev->loop = loop;
+	ev->kind = kind;
+	ev->fd = fd;
+	ev->ownfd = ownfd;
+	ev->handler = handler;
+	ev->arg = arg;
+	ev->next = loop->sources;										// Newest first, so not run by a dispatch already going
+	loop->sources = ev;
+	return ev;
+}
+
+/*-[ INTERNAL: timer_add ]--------------------------------------------------}
+. Creates an armed timerfd source.
+. RETURN: valid HEVENT for success, NULL for any failure
+.--------------------------------------------------------------------------*/
+static HEVENT timer_add (EVLOOP_HANDLE loop, uint8_t kind, uint64_t first_ns, uint64_t period_ns, EVENT_HANDLER handler, void* arg)
+{
+	if (loop == 0) return 0;
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (fd < 0) return 0;
+	if (!timer_arm(fd, first_ns, period_ns))
+	{
+		close(fd);
+		return 0;
+	}
+	return source_add(loop, kind, fd, true, EPOLLIN, handler, arg);
+}
+
+/*-[ INTERNAL: source_sweep ]-----------------------------------------------}
+. Frees removed sources, only called when no handler is running.
+.--------------------------------------------------------------------------*/
+static void source_sweep (EVLOOP_HANDLE loop)
+{
+	struct event_source** p = &loop->sources;
+	while (*p)
+	{
+		struct event_source* ev = *p;
+		if (ev->dead)
+		{
+			*p = ev->next;											// Unlink and free
+			free(ev);
+		} else p = &ev->next;
+	}
+	loop->dead = false;
+}
+
+/*-[ INTERNAL: frame_run ]--------------------------------------------------}
+. A frame tick, runs every frame handler then sends the frame to each
+. device, in parallel on their buses when there is a flush group.
+.--------------------------------------------------------------------------*/
+static void frame_run (EVLOOP_HANDLE loop, uint32_t ticks)
+{
+	for (struct event_source* ev = loop->sources; ev; ev = ev->next)
+		if (ev->kind == EV_FRAME && !ev->dead) ev->handler(ev, ev->arg, ticks);
+	if (loop->group) SSD1327_FlushGroup(loop->group);				// The one flush of the frame
+	else for (uint8_t i = 0; i < loop->ndev; i++)
+		SSD1327_Flush(loop->dev[i]);
+}
+
+/*-[ INTERNAL: frame_regroup ]----------------------------------------------}
+. Makes a new flush group for the devices of the loop, without one each
+. device is flushed in turn.
+.--------------------------------------------------------------------------*/
+static void frame_regroup (EVLOOP_HANDLE loop)
+{
+	SSD1327_DestroyFlushGroup(loop->group);
+	loop->group = (loop->ndev > 1) ? SSD1327_CreateFlushGroup(&loop->dev[0], loop->ndev) : 0;
+}
+
+/*-[ INTERNAL: source_run ]-------------------------------------------------}
+. Runs the source epoll says is ready.
+.--------------------------------------------------------------------------*/
+static void source_run (struct event_source* ev, uint32_t events)
+{
+	uint32_t ticks;
+	switch (ev->kind)
+	{
+		case EV_TIMER:
+			if ((ticks = timer_ticks(ev->fd))) ev->handler(ev, ev->arg, ticks);
+			break;
+		case EV_FD:
+			ev->handler(ev, ev->arg, events);
+			break;
+		case EV_GPIO:
+			if (timer_ticks(ev->fd) && GPIO_CheckEvent(ev->gpio, ev->pin))
+			{
+				GPIO_ClearEvent(ev->gpio, ev->pin);					// Ready for the next edge
+				ev->handler(ev, ev->arg, 1);
+			}
+			break;
+		case EV_FRAMETICK:
+			if ((ticks = timer_ticks(ev->fd))) frame_run(ev->loop, ticks);
+			break;
+	}
+}
+
+/***************************************************************************}
+{                       PUBLIC INTERFACE ROUTINES                           }
+{***************************************************************************/
+
+/*-[ EventLoop_Create ]-----------------------------------------------------}
+. Creates an empty event loop.
+. RETURN: valid EVLOOP_HANDLE for success, NULL for any failure
+.--------------------------------------------------------------------------*/
+EVLOOP_HANDLE EventLoop_Create (void)
+{
+	struct event_loop* loop = calloc(1, sizeof(struct event_loop));
+	if (loop == 0) return 0;
+	loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+	loop->quitfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	struct epoll_event ee = { .events = EPOLLIN, .data.ptr = 0 };	// Quit is the only source with no ptr
+	if (loop->epfd < 0 || loop->quitfd < 0 ||
+		epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->quitfd, &ee) != 0)
+	{
+		if (loop->epfd >= 0) close(loop->epfd);
+		if (loop->quitfd >= 0) close(loop->quitfd);
+		free(loop);
+		return 0;
+	}
+	return loop;
+}
+
+/*-[ EventLoop_Destroy ]----------------------------------------------------}
+. Removes every source and frees the loop, it must not be running.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool EventLoop_Destroy (EVLOOP_HANDLE loop)
+{
+	if (loop == 0 || loop->running) return false;
+	while (loop->ndev)												// Screens back to drawing straight out
+		EventLoop_SetFrameRate(loop, loop->dev[loop->ndev - 1], 0);
+	for (struct event_source* ev = loop->sources; ev; ev = ev->next)
+		EventLoop_Remove(ev);
+	source_sweep(loop);
+	close(loop->quitfd);
+	close(loop->epfd);
+	free(loop);
+	return true;
+}
+
+/*-[ EventLoop_Run ]--------------------------------------------------------}
+. Runs handlers as their events happen on the calling thread until
+. EventLoop_Quit is called.
+. RETURN: true when quit, false for any failure
+.--------------------------------------------------------------------------*/
+bool EventLoop_Run (EVLOOP_HANDLE loop)
+{
+	if (loop == 0 || loop->running) return false;
+	struct epoll_event ee[EVENTLOOP_BATCH];
+	loop->running = true;
+	loop->quit = false;
+	while (!loop->quit)
+	{
+		int n = epoll_wait(loop->epfd, ee, EVENTLOOP_BATCH, -1);	// Sleep until something is ready
+		if (n < 0)
+		{
+			if (errno == EINTR) continue;
+			break;													// Epoll failed
+		}
+		for (int i = 0; i < n && !loop->quit; i++)
+		{
+			struct event_source* ev = ee[i].data.ptr;
+			if (ev == 0)											// Quit from another thread
+			{
+				uint64_t v;
+				if (read(loop->quitfd, &v, sizeof(v)) == sizeof(v)) loop->quit = true;
+			} else if (!ev->dead) source_run(ev, ee[i].events);	// Removed earlier in this batch is skipped
+		}
+		if (loop->dead) source_sweep(loop);							// No handler running, safe to free
+	}
+	loop->running = false;
+	return loop->quit;
+}
+
+/*-[ EventLoop_Quit ]-------------------------------------------------------}
+. Makes EventLoop_Run return once the handler running finishes, safe from
+. any thread.
+.--------------------------------------------------------------------------*/
+void EventLoop_Quit (EVLOOP_HANDLE loop)
+{
+	uint64_t one = 1;
+	if (loop && write(loop->quitfd, &one, sizeof(one)) != sizeof(one)) return;
+}
+
+/*-[ EventLoop_AddTimer ]---------------------------------------------------}
+. Adds a timer that first fires first_us microseconds from now then every
+. period_us, 0 fires only once. Ticks are absolute CLOCK_MONOTONIC times
+. so a late handler never makes the timer drift.
+. RETURN: valid HEVENT for success, NULL for any failure
+.--------------------------------------------------------------------------*/
+HEVENT EventLoop_AddTimer (EVLOOP_HANDLE loop, uint32_t first_us, uint32_t period_us, EVENT_HANDLER handler, void* arg)
+{
+	if (handler == 0) return 0;
+	return timer_add(loop, EV_TIMER, first_us * 1000ULL, period_us * 1000ULL, handler, arg);
+}
+
+/*-[ EventLoop_SetTimer ]---------------------------------------------------}
+. Rearms a timer to first fire first_us microseconds from now then every
+. period_us, 0 fires only once.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool EventLoop_SetTimer (HEVENT ev, uint32_t first_us, uint32_t period_us)
+{
+	if (ev == 0 || ev->dead || ev->kind != EV_TIMER) return false;
+	timer_ticks(ev->fd);											// Drop any tick of the old setting
+	return timer_arm(ev->fd, first_us * 1000ULL, period_us * 1000ULL);
+}
+
+/*-[ EventLoop_AddFd ]------------------------------------------------------}
+. Adds a file descriptor watched for the epoll events (EPOLLIN etc). The
+. caller still owns the descriptor and must remove it before closing it.
+. RETURN: valid HEVENT for success, NULL for any failure
+.--------------------------------------------------------------------------*/
+HEVENT EventLoop_AddFd (EVLOOP_HANDLE loop, int fd, uint32_t events, EVENT_HANDLER handler, void* arg)
+{
+	if (loop == 0 || fd < 0 || handler == 0) return 0;
+	return source_add(loop, EV_FD, fd, false, events, handler, arg);
+}
+
+/*-[ EventLoop_AddGpio ]----------------------------------------------------}
+. Adds a GPIO event watch. The GPIO registers are memory mapped with no fd
+. to wait on, so the event flag is checked every poll_us and cleared when
+. the handler is called. Edge detection must already be set on the pin.
+. RETURN: valid HEVENT for success, NULL for any failure
+.--------------------------------------------------------------------------*/
+HEVENT EventLoop_AddGpio (EVLOOP_HANDLE loop, GPIO_HANDLE gpio, uint8_t pin, uint32_t poll_us, EVENT_HANDLER handler, void* arg)
+{
+	if (gpio == 0 || poll_us == 0 || handler == 0) return 0;
+	GPIO_ClearEvent(gpio, pin);										// Only edges from now on
+	HEVENT ev = timer_add(loop, EV_GPIO, poll_us * 1000ULL, poll_us * 1000ULL, handler, arg);
+	if (ev)
+	{
+		ev->gpio = gpio;
+		ev->pin = pin;
+	}
+	return ev;
+}
+
+/*-[ EventLoop_SetFrameRate ]-----------------------------------------------}
+. Drives the SSD1327 device from the loop. With a rate drawing only goes
+. to the shadow and each frame the frame handlers are run then each device
+. of the loop is sent with one flush, devices on different SPI buses in
+. parallel. The rate is the loops, setting it for one device sets it for
+. all. 0 (the default) takes the device off the loop and back to drawing
+. straight out. The device must be open and not owned by a compositor.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool EventLoop_SetFrameRate (EVLOOP_HANDLE loop, SSD1327_HANDLE dev, uint16_t fps)
+{
+	if (loop == 0 || dev == 0 || fps > 1000) return false;
+	uint8_t i = 0;
+	while (i < loop->ndev && loop->dev[i] != dev) i++;				// Is it already on the loop
+	if (fps == 0)													// Stop frames for the device
+	{
+		if (i == loop->ndev) return false;							// Not on this loop
+		loop->dev[i] = loop->dev[--loop->ndev];
+		frame_regroup(loop);
+		if (loop->ndev == 0 && loop->frametick)						// Last device, no more frames
+		{
+			EventLoop_Remove(loop->frametick);
+			loop->frametick = 0;
+		}
+		return SSD1327_SetDeferred(dev, false);						// Sends anything still in the shadow
+	}
+	bool added = (i == loop->ndev);
+	if (added)														// New device
+	{
+		if (i == EVENTLOOP_MAXDEV || !SSD1327_SetDeferred(dev, true)) return false;
+		loop->dev[loop->ndev++] = dev;
+		frame_regroup(loop);
+	}
+	uint64_t ns = 1000000000ULL / fps;								// Frame period
+	if (loop->frametick) return timer_arm(loop->frametick->fd, ns, ns);// Just a new rate
+	loop->frametick = timer_add(loop, EV_FRAMETICK, ns, ns, 0, 0);
+	if (loop->frametick) return true;
+	if (added)														// No timer, undo the device
+	{
+		loop->ndev--;
+		frame_regroup(loop);
+		SSD1327_SetDeferred(dev, false);
+	}
+	return false;
+}
+
+/*-[ EventLoop_AddFrame ]---------------------------------------------------}
+. Adds a handler run every frame just before the flush.
+. RETURN: valid HEVENT for success, NULL for any failure
+.--------------------------------------------------------------------------*/
+HEVENT EventLoop_AddFrame (EVLOOP_HANDLE loop, EVENT_HANDLER handler, void* arg)
+{
+	if (loop == 0 || handler == 0) return 0;
+	return source_add(loop, EV_FRAME, -1, false, 0, handler, arg);
+}
+
+/*-[ EventLoop_Remove ]-----------------------------------------------------}
+. Removes a source, it will not fire again. Safe from any handler,
+. including its own.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool EventLoop_Remove (HEVENT ev)
+{
+	if (ev == 0 || ev->dead) return false;
+	if (ev->fd >= 0)
+	{
+		epoll_ctl(ev->loop->epfd, EPOLL_CTL_DEL, ev->fd, NULL);		// No more events from it
+		if (ev->ownfd) close(ev->fd);
+		ev->fd = -1;
+	}
+	if (ev == ev->loop->frametick) ev->loop->frametick = 0;
+	ev->dead = true;												// Freed by the next sweep
+	ev->loop->dead = true;
+	return true;
+}
@@ -0,0 +1,129 @@
+#ifndef _EVENTLOOP_H_
+#define _EVENTLOOP_H_
+
+#ifdef __cplusplus								// If we are including to a C++
+extern "C" {									// Put extern C directive wrapper around
+#endif
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++}
+{																			}
+{       Filename: eventloop.h												}
+{       Copyright: Leon de Boer(LdB) 2020									}
+{       Version: 1.00														}
+{		Release under MIT license (https://opensource.org/licenses/MIT)     }
+{																			}
+{***************************************************************************}
+{                                                                           }
+{      Defines a single threaded event loop on one epoll fd. Periodic		}
+{      timers, GPIO events, any file descriptor and the SSD1327 frame		}
+{      flush are all run from the one thread with no sleeps.				}
+{																            }
+{++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
+{  1.00 Initial version														}
+{++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#include <stdbool.h>							// C standard unit for bool, true, false
+#include <stdint.h>								// C standard unit for uint32_t etc
+#include "gpio.h"								// GPIO events can be watched
+#include "ssd1327.h"							// SSD1327 devices are flushed each frame
+
+#define EVENTLOOP_DRIVER_VERSION 1000			// Version number 1.00 build 0
+
+#define EVENTLOOP_BATCH ( 16 )					// Most ready events taken from epoll at a time
+#define EVENTLOOP_MAXDEV ( 4 )					// Most SSD1327 devices one loop flushes
+
+typedef struct event_loop* EVLOOP_HANDLE;		// Define a EVLOOP_HANDLE pointer to opaque internal struct
+typedef struct event_source* HEVENT;			// Define a HEVENT pointer to opaque internal struct
+
+/*--------------------------------------------------------------------------}
+{   An event handler is called on the loop thread with the source that		}
+{   fired, the arg it was added with and a count. For timers and frames	}
+{   count is the ticks since the last call, more than 1 if the loop was	}
+{   late. For a file descriptor it is the epoll event bits.					}
+{--------------------------------------------------------------------------*/
+typedef void (*EVENT_HANDLER) (HEVENT ev, void* arg, uint32_t count);
+
+/*-[ EventLoop_Create ]-----------------------------------------------------}
+. Creates an empty event loop.
+. RETURN: valid EVLOOP_HANDLE for success, NULL for any failure
+.--------------------------------------------------------------------------*/
+EVLOOP_HANDLE EventLoop_Create (void);
+
+/*-[ EventLoop_Destroy ]----------------------------------------------------}
+. Removes every source and frees the loop, it must not be running.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool EventLoop_Destroy (EVLOOP_HANDLE loop);
+
+/*-[ EventLoop_Run ]--------------------------------------------------------}
+. Runs handlers as their events happen on the calling thread until
+. EventLoop_Quit is called.
+. RETURN: true when quit, false for any failure
+.--------------------------------------------------------------------------*/
+bool EventLoop_Run (EVLOOP_HANDLE loop);
+
+/*-[ EventLoop_Quit ]-------------------------------------------------------}
+. Makes EventLoop_Run return once the handler running finishes, safe from
+. any thread.
+.--------------------------------------------------------------------------*/
+void EventLoop_Quit (EVLOOP_HANDLE loop);
+
+/*-[ EventLoop_AddTimer ]---------------------------------------------------}
+. Adds a timer that first fires first_us microseconds from now then every
+. period_us, 0 fires only once. Ticks are absolute CLOCK_MONOTONIC times
+. so a late handler never makes the timer drift.
+. RETURN: valid HEVENT for success, NULL for any failure
+.--------------------------------------------------------------------------*/
+HEVENT EventLoop_AddTimer (EVLOOP_HANDLE loop, uint32_t first_us, uint32_t period_us, EVENT_HANDLER handler, void* arg);
+
+/*-[ EventLoop_SetTimer ]---------------------------------------------------}
+. Rearms a timer to first fire first_us microseconds from now then every
+. period_us, 0 fires only once.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool EventLoop_SetTimer (HEVENT ev, uint32_t first_us, uint32_t period_us);
+
+/*-[ EventLoop_AddFd ]------------------------------------------------------}
+. Adds a file descriptor watched for the epoll events (EPOLLIN etc). The
+. caller still owns the descriptor and must remove it before closing it.
+. RETURN: valid HEVENT for success, NULL for any failure
+.--------------------------------------------------------------------------*/
+HEVENT EventLoop_AddFd (EVLOOP_HANDLE loop, int fd, uint32_t events, EVENT_HANDLER handler, void* arg);
+
+/*-[ EventLoop_AddGpio ]----------------------------------------------------}
+. Adds a GPIO event watch. The GPIO registers are memory mapped with no fd
+. to wait on, so the event flag is checked every poll_us and cleared when
+. the handler is called. Edge detection must already be set on the pin.
+. RETURN: valid HEVENT for success, NULL for any failure
+.--------------------------------------------------------------------------*/
+HEVENT EventLoop_AddGpio (EVLOOP_HANDLE loop, GPIO_HANDLE gpio, uint8_t pin, uint32_t poll_us, EVENT_HANDLER handler, void* arg);
+
+/*-[ EventLoop_SetFrameRate ]-----------------------------------------------}
+. Drives the SSD1327 device from the loop. With a rate drawing only goes
+. to the shadow and each frame the frame handlers are run then each device
+. of the loop is sent with one flush, devices on different SPI buses in
+. parallel. The rate is the loops, setting it for one device sets it for
+. all. 0 (the default) takes the device off the loop and back to drawing
+. straight out. The device must be open and not owned by a compositor.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool EventLoop_SetFrameRate (EVLOOP_HANDLE loop, SSD1327_HANDLE dev, uint16_t fps);
+
+/*-[ EventLoop_AddFrame ]---------------------------------------------------}
+. Adds a handler run every frame just before the flush.
+. RETURN: valid HEVENT for success, NULL for any failure
+.--------------------------------------------------------------------------*/
+HEVENT EventLoop_AddFrame (EVLOOP_HANDLE loop, EVENT_HANDLER handler, void* arg);
+
+/*-[ EventLoop_Remove ]-----------------------------------------------------}
+. Removes a source, it will not fire again. Safe from any handler,
+. including its own.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool EventLoop_Remove (HEVENT ev);
+
+#ifdef __cplusplus								// If we are including to a C++ file
+}												// Close the extern C directive wrapper
+#endif
+
+#endif
@@ -0,0 +1,272 @@
+#ifndef _EVENTLOOP_HPP_
+#define _EVENTLOOP_HPP_
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++}
+{																			}
+{       Filename: eventloop.hpp												}
+{       Copyright: Leon de Boer(LdB) 2020									}
+{       Version: 1.00														}
+{		Release under MIT license (https://opensource.org/licenses/MIT)     }
+{																			}
+{***************************************************************************}
+{                                                                           }
+{      C++20 coroutines over the event loop. A widget is written as one	}
+{      straight line coroutine that awaits the next frame or a time, all	}
+{      of them run on the loop thread with the flush and each costs only	}
+{      its coroutine frame. Needs -std=c++20.								}
+{																            }
+{++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
+{  1.00 Initial version														}
+{++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#include <stdint.h>								// C standard unit for uint32_t etc
+#include <chrono>								// Waits are std::chrono durations and time points
+#include <coroutine>							// C++20 coroutine support
+#include <exception>							// std::terminate
+#include <functional>							// std::greater
+#include <queue>								// Timed waits are a priority queue
+#include <utility>								// std::swap
+#include <vector>								// Frame waits are a vector
+#include "gpio.h"								// GPIO_HANDLE used by SSD1327 and loop headers
+#include "ssd1327.h"							// SSD1327 device and DC routines
+#include "eventloop.h"							// The C event loop
+
+namespace ldb {
+
+/*--------------------------------------------------------------------------}
+{   Task is the return type of a widget coroutine. It starts running at	}
+{   once and its frame frees itself when it returns, nobody awaits it.		}
+{--------------------------------------------------------------------------*/
+struct Task
+{
+	struct promise_type
+	{
+		Task get_return_object () noexcept { return {}; }
+		std::suspend_never initial_suspend () noexcept { return {}; }
+		std::suspend_never final_suspend () noexcept { return {}; }
+		void return_void () noexcept {}
+		void unhandled_exception () noexcept { std::terminate(); }
+	};
+};
+
+/*--------------------------------------------------------------------------}
+{   Display runs the SSD1327 at a frame rate on an event loop and resumes	}
+{   the coroutines waiting on it. One loop timer serves every timed wait	}
+{   and one frame handler every frame wait, so hundreds of widgets add no	}
+{   fds or threads. Only one Display per thread, free after() and until()	}
+{   wait on it. A widget looks like												}
+{																			}
+{	ldb::Task bar (HDC Dc)													}
+{	{																		}
+{		for (uint16_t i = 2, dir = 1;; i += 2*dir)							}
+{		{																	}
+{			Rectangle(Dc, 0, 96, i, 110);									}
+{			co_await ldb::after(33ms);										}
+{			if (i == 126 || i == 2) dir = -dir;								}
+{		}																	}
+{	}																		}
+{--------------------------------------------------------------------------*/
+class Display
+{
+public:
+	using clock = std::chrono::steady_clock;	// CLOCK_MONOTONIC as the loop timers use
+
+	/*-[ Display ]----------------------------------------------------------}
+	. Starts the loop flushing the SSD1327 device at fps, which must be
+	. open. ok() says if it could.
+	.----------------------------------------------------------------------*/
+	Display (EVLOOP_HANDLE loop, SSD1327_HANDLE dev, uint16_t fps) : loop_(loop), dev_(dev)
+	{
+		if (EventLoop_SetFrameRate(loop, dev, fps))					// Screen now flushed by the loop
+		{
+			frame_ = EventLoop_AddFrame(loop, on_frame, this);
+			timer_ = EventLoop_AddTimer(loop, UINT32_MAX, 0, on_timer, this);// Armed when something waits
+		}
+		if (current() == nullptr) current() = this;
+	}
+
+	/*-[ ~Display ]---------------------------------------------------------}
+	. Stops the frames and destroys any coroutine still waiting, the loop
+	. must not be running.
+	.----------------------------------------------------------------------*/
+	~Display ()
+	{
+		if (current() == this) current() = nullptr;
+		EventLoop_Remove(frame_);
+		EventLoop_Remove(timer_);
+		EventLoop_SetFrameRate(loop_, dev_, 0);						// Last frame goes out
+		for (auto h : frames_) h.destroy();
+		while (!timed_.empty())
+		{
+			timed_.top().h.destroy();
+			timed_.pop();
+		}
+	}
+
+	Display (const Display&) = delete;
+	Display& operator= (const Display&) = delete;
+
+	/*-[ ok ]---------------------------------------------------------------}
+	. RETURN: true if the display is running on the loop
+	.----------------------------------------------------------------------*/
+	bool ok () const { return frame_ && timer_; }
+
+	/*-[ loop ]-------------------------------------------------------------}
+	. RETURN: the event loop the display runs on
+	.----------------------------------------------------------------------*/
+	EVLOOP_HANDLE loop () const { return loop_; }
+
+	/*-[ device ]-----------------------------------------------------------}
+	. RETURN: the SSD1327 device the display flushes
+	.----------------------------------------------------------------------*/
+	SSD1327_HANDLE device () const { return dev_; }
+
+	/*-[ current ]----------------------------------------------------------}
+	. RETURN: the display free after() and until() wait on for this thread
+	.----------------------------------------------------------------------*/
+	static Display*& current ()
+	{
+		static thread_local Display* d = nullptr;
+		return d;
+	}
+
+	/*-[ next_frame ]-------------------------------------------------------}
+	. co_await resumes the coroutine just before the next flush, so what it
+	. draws then goes out in that frame.
+	.----------------------------------------------------------------------*/
+	auto next_frame ()
+	{
+		struct awaiter
+		{
+			Display* d;
+			bool await_ready () const noexcept { return false; }
+			void await_suspend (std::coroutine_handle<> h) { d->frames_.push_back(h); }
+			void await_resume () const noexcept {}
+		};
+		return awaiter{ this };
+	}
+
+	/*-[ until ]------------------------------------------------------------}
+	. co_await resumes the coroutine at the time point. Adding a period to
+	. the last time point each time makes a periodic widget that never
+	. drifts.
+	.----------------------------------------------------------------------*/
+	auto until (clock::time_point when)
+	{
+		struct awaiter
+		{
+			Display* d;
+			clock::time_point when;
+			bool await_ready () const noexcept { return when <= clock::now(); }
+			void await_suspend (std::coroutine_handle<> h) { d->wait_until(when, h); }
+			void await_resume () const noexcept {}
+		};
+		return awaiter{ this, when };
+	}
+
+	/*-[ after ]------------------------------------------------------------}
+	. co_await resumes the coroutine once the time has passed.
+	.----------------------------------------------------------------------*/
+	template <class Rep, class Period>
+	auto after (std::chrono::duration<Rep, Period> d)
+	{
+		return until(clock::now() + std::chrono::duration_cast<clock::duration>(d));
+	}
+
+private:
+	struct timed
+	{
+		clock::time_point when;					// Time to resume
+		std::coroutine_handle<> h;				// Coroutine to resume
+		bool operator> (const timed& o) const { return when > o.when; }
+	};
+
+	/*-[ INTERNAL: wait_until ]---------------------------------------------}
+	. Queues a timed wait, rearming the loop timer if it is now the first.
+	.----------------------------------------------------------------------*/
+	void wait_until (clock::time_point when, std::coroutine_handle<> h)
+	{
+		bool first = timed_.empty() || when < timed_.top().when;
+		timed_.push({ when, h });
+		if (first) arm();
+	}
+
+	/*-[ INTERNAL: arm ]----------------------------------------------------}
+	. Sets the loop timer for the earliest timed wait.
+	.----------------------------------------------------------------------*/
+	void arm ()
+	{
+		if (timed_.empty()) return;									// Left to run out unarmed
+		auto us = std::chrono::ceil<std::chrono::microseconds>(timed_.top().when - clock::now()).count();
+		if (us < 0) us = 0;											// Already due, fires at once
+		if (us > UINT32_MAX) us = UINT32_MAX;						// Fires early and is rearmed
+		EventLoop_SetTimer(timer_, (uint32_t)us, 0);
+	}
+
+	/*-[ INTERNAL: on_timer ]-----------------------------------------------}
+	. Resumes every timed wait that is due then rearms for the next.
+	.----------------------------------------------------------------------*/
+	static void on_timer (HEVENT ev, void* arg, uint32_t count)
+	{
+		Display* d = static_cast<Display*>(arg);
+		auto now = clock::now();
+		while (!d->timed_.empty() && d->timed_.top().when <= now)
+		{
+			auto h = d->timed_.top().h;
+			d->timed_.pop();										// Off the queue before it can requeue
+			h.resume();
+		}
+		d->arm();
+	}
+
+	/*-[ INTERNAL: on_frame ]-----------------------------------------------}
+	. Resumes every coroutine waiting for this frame, ones that wait again
+	. go to the next frame.
+	.----------------------------------------------------------------------*/
+	static void on_frame (HEVENT ev, void* arg, uint32_t count)
+	{
+		Display* d = static_cast<Display*>(arg);
+		std::swap(d->frames_, d->resuming_);
+		for (auto h : d->resuming_) h.resume();
+		d->resuming_.clear();										// Keeps its capacity for next frame
+	}
+
+	EVLOOP_HANDLE loop_;						// Loop the display runs on
+	SSD1327_HANDLE dev_;						// Device the display flushes
+	HEVENT frame_ = nullptr;					// Frame handler
+	HEVENT timer_ = nullptr;					// One timer for every timed wait
+	std::vector<std::coroutine_handle<>> frames_;	// Waiting for next frame
+	std::vector<std::coroutine_handle<>> resuming_;	// Being resumed this frame
+	std::priority_queue<timed, std::vector<timed>, std::greater<timed>> timed_;// Timed waits, earliest on top
+};
+
+/*-[ next_frame ]-----------------------------------------------------------}
+. co_await resumes the coroutine just before the next flush of the
+. current display.
+.--------------------------------------------------------------------------*/
+inline auto next_frame ()
+{
+	return Display::current()->next_frame();
+}
+
+/*-[ until ]----------------------------------------------------------------}
+. co_await resumes the coroutine at the time point on the current display.
+.--------------------------------------------------------------------------*/
+inline auto until (Display::clock::time_point when)
+{
+	return Display::current()->until(when);
+}
+
+/*-[ after ]----------------------------------------------------------------}
+. co_await resumes the coroutine once the time has passed on the current
+. display.
+.--------------------------------------------------------------------------*/
+template <class Rep, class Period>
+inline auto after (std::chrono::duration<Rep, Period> d)
+{
+	return Display::current()->after(d);
+}
+
+}	// namespace ldb
+
+#endif
@@ -0,0 +1,691 @@
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++}
+{																			}
+{       Filename: expand.c													}
+{       Copyright(c): Leon de Boer(LdB) 2020								}
+{       Version: 1.00														}
+{		Release under MIT license (https://opensource.org/licenses/MIT)     }
+{																			}
+{***************************************************************************}
+{                                                                           }
+{      Defines kernels that expand 1bpp bitmaps and dither 8 bit grey		}
+{      images to packed 4bpp pixels											}
+{																            }
+{++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
+{  1.00 Initial version														}
+{++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#include <stdbool.h>							// C standard unit for bool, true, false
+#include <stdint.h>								// C standard unit for uint32_t etc
+#include <string.h>								// C standard unit needed for memcpy
+#include <pthread.h>							// Posix thread unit for pthread_once
+#include "expand.h"								// This units header
+
+#if defined(__x86_64__) || defined(__i386__)
+#define EXPAND_HAVE_X86 1						// SSE2 and AVX2 kernels compiled in
+#include <immintrin.h>							// x86 intrinsics
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define EXPAND_HAVE_NEON 1						// NEON kernel compiled in
+#include <arm_neon.h>							// ARM NEON intrinsics
+#if !defined(__aarch64__)
+#include <sys/auxv.h>							// getauxval to check CPU has NEON
+#include <asm/hwcap.h>							// HWCAP_NEON
+#endif
+#endif
+
+#if EXPAND_DRIVER_VERSION != 1000
+#error "Header does not match this version of file"
+#endif
+
+typedef void (*EXPANDFUNC) (const uint8_t*, uint16_t, uint8_t*, uint16_t, uint16_t, uint16_t, uint8_t, uint8_t);
+typedef void (*DITHERFUNC) (const uint8_t*, uint8_t*, uint16_t, const uint8_t*);
+
+static void expand_resolve (const uint8_t* src, uint16_t srcstride, uint8_t* dst, uint16_t dststride, uint16_t wth, uint16_t ht, uint8_t txtcolor, uint8_t bkcolor);
+static void dither_resolve (const uint8_t* grey, uint8_t* dst, uint16_t wth, const uint8_t* th);
+
+static EXPANDFUNC expand_func = expand_resolve;	// Current kernel, first call resolves it
+static DITHERFUNC dither_func = dither_resolve;	// Current ordered dither kernel, first call resolves it
+static EXPANDKERNEL expand_kernel = EXPAND_AUTO;// Current kernel id
+
+/*--------------------------------------------------------------------------}
+{  Each font byte gives 4 output bytes. The mask table holds those 4 bytes	}
+{  in memory order with a nibble of 0xF for every set bit, which makes the	}
+{  table independent of colour so it is built once and shared by all DCs.	}
+{--------------------------------------------------------------------------*/
+static uint32_t expand_mask[256] = { 0 };
+static pthread_once_t expand_mask_once = PTHREAD_ONCE_INIT;
+
+static void expand_build_mask (void)
+{
+	for (unsigned int b = 0; b < 256; b++)							// For each possible font byte
+	{
+		uint8_t out[4];
+		for (unsigned int k = 0; k < 4; k++)						// For each output byte
+		{
+			out[k] = ((b & (0x80 >> (2 * k))) ? 0xF0 : 0x00)		// High pixel from bit 7-2k
+				| ((b & (0x40 >> (2 * k))) ? 0x0F : 0x00);			// Low pixel from bit 6-2k
+		}
+		memcpy(&expand_mask[b], &out[0], 4);						// Hold in memory order
+	}
+}
+
+/*-[ INTERNAL: expand_scalar ]----------------------------------------------}
+. Table driven kernel, one lookup and three logic ops per 8 pixels.
+.--------------------------------------------------------------------------*/
+static void expand_scalar (const uint8_t* src, uint16_t srcstride, uint8_t* dst, uint16_t dststride, uint16_t wth, uint16_t ht, uint8_t txtcolor, uint8_t bkcolor)
+{
+	uint32_t txt = (txtcolor & 0xF) * 0x11111111u;					// Text colour in every nibble
+	uint32_t bk = (bkcolor & 0xF) * 0x11111111u;					// Background colour in every nibble
+	for (uint16_t y = 0; y < ht; y++)								// For each row
+	{
+		const uint8_t* s = src;
+		uint8_t* d = dst;
+		uint16_t w = wth / 2;										// Output bytes in row
+		while (w >= 4)												// Whole font bytes
+		{
+			uint32_t m = expand_mask[*s++];							// Pixel mask of font byte
+			uint32_t v = (txt & m) | (bk & ~m);						// Select colour per pixel
+			memcpy(d, &v, 4);										// Write 4 bytes = 8 pixels
+			d += 4;
+			w -= 4;
+		}
+		if (w)														// Partial font byte at end of row
+		{
+			uint32_t m = expand_mask[*s];
+			uint32_t v = (txt & m) | (bk & ~m);
+			memcpy(d, &v, w);										// Write the bytes needed
+		}
+		src += srcstride;											// Next source row
+		dst += dststride;											// Next destination row
+	}
+}
+
+/*--------------------------------------------------------------------------}
+{  Ordered dither. A grey value v becomes level (v * 15 + t) / 255 where	}
+{  the threshold t comes from a 4 entry pattern for the row, the Bayer		}
+{  matrix scaled to 8..248 or 127 for plain rounding. The divide by 255 is	}
+{  (x + 1 + (x >> 8)) >> 8 which is exact for the range and needs only		}
+{  adds and shifts so every kernel gives the same result.					}
+{--------------------------------------------------------------------------*/
+static const uint8_t dither_bayer[4][4] = {
+	{   8, 136,  40, 168 },
+	{ 200,  72, 232, 104 },
+	{  56, 184,  24, 152 },
+	{ 248, 120, 216,  88 },
+};
+static const uint8_t dither_round[4] = { 127, 127, 127, 127 };
+
+static inline uint8_t dither_level (uint32_t x)
+{
+	return (x + 1 + (x >> 8)) >> 8;									// x / 255 for x < 65535
+}
+
+/*-[ INTERNAL: dither_scalar ]----------------------------------------------}
+. Ordered dither of wth grey pixels to packed 4bpp, th is the row pattern.
+.--------------------------------------------------------------------------*/
+static void dither_scalar (const uint8_t* grey, uint8_t* dst, uint16_t wth, const uint8_t* th)
+{
+	uint16_t i;
+	for (i = 0; i + 1 < wth; i += 2)								// Each pixel pair
+		dst[i / 2] = (dither_level(grey[i] * 15 + th[i & 3]) << 4)
+			| dither_level(grey[i + 1] * 15 + th[(i + 1) & 3]);
+	if (i < wth) dst[i / 2] = dither_level(grey[i] * 15 + th[i & 3]) << 4;// Odd last pixel
+}
+
+/*--------------------------------------------------------------------------}
+{  The SIMD kernels work on whole font bytes (8 pixels -> 4 bytes). When	}
+{  rows are contiguous in source and destination (8/16 wide glyphs into a	}
+{  glyph buffer) the bitmap is one stream and goes through in wide blocks.	}
+{  Otherwise they gather N font bytes across rows and columns, expand them	}
+{  together and scatter the results. Partial bytes use the mask table.		}
+{--------------------------------------------------------------------------*/
+#define EXPAND_STREAM(STREAMFUNC)												\
+	if ((wth & 7) == 0 && srcstride == wth / 8 && dststride == wth / 2)			\
+	{																			\
+		uint32_t count = (uint32_t)srcstride * ht;								\
+		uint32_t done = STREAMFUNC(src, dst, count, txtcolor, bkcolor);			\
+		uint32_t txt = (txtcolor & 0xF) * 0x11111111u;							\
+		uint32_t bk = (bkcolor & 0xF) * 0x11111111u;							\
+		for (; done < count; done++)											\
+		{																		\
+			uint32_t m = expand_mask[src[done]];								\
+			uint32_t v = (txt & m) | (bk & ~m);									\
+			memcpy(&dst[done * 4], &v, 4);										\
+		}																		\
+		return;																	\
+	}
+
+#define EXPAND_GATHER(N, VECFUNC)												\
+	uint8_t sb[N];																\
+	uint8_t* dp[N];																\
+	unsigned int n = 0;															\
+	uint32_t txt = (txtcolor & 0xF) * 0x11111111u;								\
+	uint32_t bk = (bkcolor & 0xF) * 0x11111111u;								\
+	for (uint16_t y = 0; y < ht; y++)											\
+	{																			\
+		const uint8_t* s = src + (uint32_t)y * srcstride;						\
+		uint8_t* d = dst + (uint32_t)y * dststride;								\
+		uint16_t w = wth / 2;													\
+		while (w >= 4)															\
+		{																		\
+			sb[n] = *s++;														\
+			dp[n] = d;															\
+			d += 4;																\
+			w -= 4;																\
+			if (++n == N)														\
+			{																	\
+				VECFUNC(sb, dp, txtcolor, bkcolor);								\
+				n = 0;															\
+			}																	\
+		}																		\
+		if (w)																	\
+		{																		\
+			uint32_t m = expand_mask[*s];										\
+			uint32_t v = (txt & m) | (bk & ~m);									\
+			memcpy(d, &v, w);													\
+		}																		\
+	}																			\
+	for (unsigned int i = 0; i < n; i++)										\
+	{																			\
+		uint32_t m = expand_mask[sb[i]];										\
+		uint32_t v = (txt & m) | (bk & ~m);										\
+		memcpy(dp[i], &v, 4);													\
+	}
+
+#ifdef EXPAND_HAVE_NEON
+static const uint8_t neon_bits[16] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+									   0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
+
+/*-[ INTERNAL: neon_expand2 ]-----------------------------------------------}
+. Expands 2 font bytes (16 pixels) to 8 bytes. Colours are pre shifted to
+. high nibble in even lanes so a 16 bit lane becomes one output byte.
+.--------------------------------------------------------------------------*/
+static inline void neon_expand2 (const uint8_t* sb, uint8_t** dp, uint8_t txtcolor, uint8_t bkcolor)
+{
+	uint8_t out[8];
+	uint16x8_t txt = vdupq_n_u16(((txtcolor & 0xF) << 4) | ((txtcolor & 0xF) << 8));// Text colour hi nibble even, lo nibble odd lanes
+	uint16x8_t bk = vdupq_n_u16(((bkcolor & 0xF) << 4) | ((bkcolor & 0xF) << 8));// Background colour the same way
+	uint8x16_t v = vcombine_u8(vdup_n_u8(sb[0]), vdup_n_u8(sb[1]));// Font byte in each of 8 lanes
+	uint8x16_t m = vtstq_u8(v, vld1q_u8(&neon_bits[0]));			// 0xFF in lanes where pixel bit set
+	uint16x8_t p = vreinterpretq_u16_u8(vbslq_u8(m, vreinterpretq_u8_u16(txt), vreinterpretq_u8_u16(bk)));
+	vst1_u8(&out[0], vmovn_u16(vorrq_u16(p, vshrq_n_u16(p, 8))));	// Merge pixel pairs and narrow to bytes
+	memcpy(dp[0], &out[0], 4);										// First font byte result
+	memcpy(dp[1], &out[4], 4);										// Second font byte result
+}
+
+/*-[ INTERNAL: neon_stream ]------------------------------------------------}
+. Contiguous rows case, every 4 font bytes give 16 output bytes in order.
+. RETURN: number of font bytes processed
+.--------------------------------------------------------------------------*/
+static uint32_t neon_stream (const uint8_t* src, uint8_t* dst, uint32_t count, uint8_t txtcolor, uint8_t bkcolor)
+{
+	uint8x16_t txt = vreinterpretq_u8_u16(vdupq_n_u16(((txtcolor & 0xF) << 4) | ((txtcolor & 0xF) << 8)));
+	uint8x16_t bk = vreinterpretq_u8_u16(vdupq_n_u16(((bkcolor & 0xF) << 4) | ((bkcolor & 0xF) << 8)));
+	uint8x16_t bits = vld1q_u8(&neon_bits[0]);
+	uint32_t i;
+	for (i = 0; i + 4 <= count; i += 4, src += 4, dst += 16)
+	{
+		uint8x16_t v0 = vcombine_u8(vdup_n_u8(src[0]), vdup_n_u8(src[1]));
+		uint8x16_t v1 = vcombine_u8(vdup_n_u8(src[2]), vdup_n_u8(src[3]));
+		uint16x8_t p0 = vreinterpretq_u16_u8(vbslq_u8(vtstq_u8(v0, bits), txt, bk));
+		uint16x8_t p1 = vreinterpretq_u16_u8(vbslq_u8(vtstq_u8(v1, bits), txt, bk));
+		vst1q_u8(dst, vcombine_u8(vmovn_u16(vorrq_u16(p0, vshrq_n_u16(p0, 8))),
+			vmovn_u16(vorrq_u16(p1, vshrq_n_u16(p1, 8)))));			// Merge pixel pairs, narrow and store 16 bytes
+	}
+	return i;
+}
+
+static void expand_neon (const uint8_t* src, uint16_t srcstride, uint8_t* dst, uint16_t dststride, uint16_t wth, uint16_t ht, uint8_t txtcolor, uint8_t bkcolor)
+{
+	EXPAND_STREAM(neon_stream)
+	EXPAND_GATHER(2, neon_expand2)
+}
+
+/*-[ INTERNAL: dither_neon ]------------------------------------------------}
+. Ordered dither of 16 pixels at a time. The load splits even and odd
+. pixels so each result pair is one shift insert.
+.--------------------------------------------------------------------------*/
+static void dither_neon (const uint8_t* grey, uint8_t* dst, uint16_t wth, const uint8_t* th)
+{
+	const uint16_t tev[8] = { th[0], th[2], th[0], th[2], th[0], th[2], th[0], th[2] };
+	const uint16_t tod[8] = { th[1], th[3], th[1], th[3], th[1], th[3], th[1], th[3] };
+	uint16x8_t te = vld1q_u16(&tev[0]);								// Thresholds of even pixels
+	uint16x8_t to = vld1q_u16(&tod[0]);								// Thresholds of odd pixels
+	uint16x8_t one = vdupq_n_u16(1);
+	uint16_t i;
+	for (i = 0; i + 16 <= wth; i += 16)
+	{
+		uint8x8x2_t v = vld2_u8(&grey[i]);							// Even pixels, odd pixels
+		uint16x8_t e = vmlaq_n_u16(te, vmovl_u8(v.val[0]), 15);		// v * 15 + t
+		uint16x8_t o = vmlaq_n_u16(to, vmovl_u8(v.val[1]), 15);
+		uint8x8_t qe = vshrn_n_u16(vaddq_u16(vaddq_u16(e, one), vshrq_n_u16(e, 8)), 8);// Divide by 255
+		uint8x8_t qo = vshrn_n_u16(vaddq_u16(vaddq_u16(o, one), vshrq_n_u16(o, 8)), 8);
+		vst1_u8(&dst[i / 2], vsli_n_u8(qo, qe, 4));					// Even level in high nibble
+	}
+	if (i < wth) dither_scalar(&grey[i], &dst[i / 2], wth - i, th);	// Rest of row
+}
+#endif
+
+#ifdef EXPAND_HAVE_X86
+/*-[ INTERNAL: sse2_expand2 ]-----------------------------------------------}
+. Expands 2 font bytes (16 pixels) to 8 bytes using SSE2.
+.--------------------------------------------------------------------------*/
+__attribute__((target("sse2")))
+static inline void sse2_expand2 (const uint8_t* sb, uint8_t** dp, uint8_t txtcolor, uint8_t bkcolor)
+{
+	const __m128i bits = _mm_setr_epi8(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+		0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+	__m128i txt = _mm_set1_epi16(((txtcolor & 0xF) << 4) | ((txtcolor & 0xF) << 8));
+	__m128i bk = _mm_set1_epi16(((bkcolor & 0xF) << 4) | ((bkcolor & 0xF) << 8));
+	__m128i v = _mm_unpacklo_epi64(_mm_set1_epi8(sb[0]), _mm_set1_epi8(sb[1]));
+	__m128i m = _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits);		// 0xFF in lanes where pixel bit set
+	__m128i p = _mm_or_si128(_mm_and_si128(m, txt), _mm_andnot_si128(m, bk));
+	p = _mm_and_si128(_mm_or_si128(p, _mm_srli_epi16(p, 8)), _mm_set1_epi16(0xFF));
+	p = _mm_packus_epi16(p, p);										// Narrow to 8 bytes
+	uint32_t lo = (uint32_t)_mm_cvtsi128_si32(p);
+	uint32_t hi = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(p, 4));
+	memcpy(dp[0], &lo, 4);											// First font byte result
+	memcpy(dp[1], &hi, 4);											// Second font byte result
+}
+
+/*-[ INTERNAL: sse2_stream ]------------------------------------------------}
+. Contiguous rows case, every 4 font bytes give 16 output bytes in order.
+. The bytes are spread to 8 lanes each by unpacking against themselves.
+. RETURN: number of font bytes processed
+.--------------------------------------------------------------------------*/
+__attribute__((target("sse2")))
+static uint32_t sse2_stream (const uint8_t* src, uint8_t* dst, uint32_t count, uint8_t txtcolor, uint8_t bkcolor)
+{
+	const __m128i bits = _mm_setr_epi8(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+		0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+	const __m128i lomask = _mm_set1_epi16(0xFF);
+	__m128i txt = _mm_set1_epi16(((txtcolor & 0xF) << 4) | ((txtcolor & 0xF) << 8));
+	__m128i bk = _mm_set1_epi16(((bkcolor & 0xF) << 4) | ((bkcolor & 0xF) << 8));
+	uint32_t i;
+	for (i = 0; i + 4 <= count; i += 4, src += 4, dst += 16)
+	{
+		int32_t w;
+		memcpy(&w, src, 4);											// Fetch 4 font bytes
+		__m128i x = _mm_cvtsi32_si128(w);
+		x = _mm_unpacklo_epi8(x, x);								// b0 b0 b1 b1 ..
+		x = _mm_unpacklo_epi16(x, x);								// b0 x4, b1 x4 ..
+		__m128i v0 = _mm_unpacklo_epi32(x, x);						// b0 x8, b1 x8
+		__m128i v1 = _mm_unpackhi_epi32(x, x);						// b2 x8, b3 x8
+		__m128i m0 = _mm_cmpeq_epi8(_mm_and_si128(v0, bits), bits);
+		__m128i m1 = _mm_cmpeq_epi8(_mm_and_si128(v1, bits), bits);
+		__m128i p0 = _mm_or_si128(_mm_and_si128(m0, txt), _mm_andnot_si128(m0, bk));
+		__m128i p1 = _mm_or_si128(_mm_and_si128(m1, txt), _mm_andnot_si128(m1, bk));
+		p0 = _mm_and_si128(_mm_or_si128(p0, _mm_srli_epi16(p0, 8)), lomask);
+		p1 = _mm_and_si128(_mm_or_si128(p1, _mm_srli_epi16(p1, 8)), lomask);
+		_mm_storeu_si128((__m128i*)dst, _mm_packus_epi16(p0, p1));	// Narrow and store 16 bytes
+	}
+	return i;
+}
+
+__attribute__((target("sse2")))
+static void expand_sse2 (const uint8_t* src, uint16_t srcstride, uint8_t* dst, uint16_t dststride, uint16_t wth, uint16_t ht, uint8_t txtcolor, uint8_t bkcolor)
+{
+	EXPAND_STREAM(sse2_stream)
+	EXPAND_GATHER(2, sse2_expand2)
+}
+
+/*-[ INTERNAL: dither_sse2 ]------------------------------------------------}
+. Ordered dither of 16 pixels at a time in 16 bit lanes, the levels are
+. packed to bytes then each even/odd pair merged to one output byte.
+.--------------------------------------------------------------------------*/
+__attribute__((target("sse2")))
+static void dither_sse2 (const uint8_t* grey, uint8_t* dst, uint16_t wth, const uint8_t* th)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i fifteen = _mm_set1_epi16(15);
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i lomask = _mm_set1_epi16(0xFF);
+	__m128i t = _mm_setr_epi16(th[0], th[1], th[2], th[3], th[0], th[1], th[2], th[3]);
+	uint16_t i;
+	for (i = 0; i + 16 <= wth; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)&grey[i]);		// 16 grey pixels
+		__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), fifteen), t);// v * 15 + t
+		__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), fifteen), t);
+		lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo, one), _mm_srli_epi16(lo, 8)), 8);// Divide by 255
+		hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(hi, one), _mm_srli_epi16(hi, 8)), 8);
+		__m128i p = _mm_packus_epi16(lo, hi);						// 16 levels, pairs in 16 bit lanes
+		p = _mm_and_si128(_mm_or_si128(_mm_slli_epi16(p, 4), _mm_srli_epi16(p, 8)), lomask);// Even << 4 | odd
+		_mm_storel_epi64((__m128i*)&dst[i / 2], _mm_packus_epi16(p, p));// Store 8 bytes
+	}
+	if (i < wth) dither_scalar(&grey[i], &dst[i / 2], wth - i, th);	// Rest of row
+}
+
+/*-[ INTERNAL: avx2_expand4 ]-----------------------------------------------}
+. Expands 4 font bytes (32 pixels) to 16 bytes using AVX2.
+.--------------------------------------------------------------------------*/
+__attribute__((target("avx2")))
+static inline void avx2_expand4 (const uint8_t* sb, uint8_t** dp, uint8_t txtcolor, uint8_t bkcolor)
+{
+	const __m256i bits = _mm256_set1_epi64x(0x0102040810204080ll);	// 0x80..0x01 in byte order
+	__m256i txt = _mm256_set1_epi16(((txtcolor & 0xF) << 4) | ((txtcolor & 0xF) << 8));
+	__m256i bk = _mm256_set1_epi16(((bkcolor & 0xF) << 4) | ((bkcolor & 0xF) << 8));
+	__m256i v = _mm256_setr_epi64x(sb[0] * 0x0101010101010101ll, sb[1] * 0x0101010101010101ll,
+		sb[2] * 0x0101010101010101ll, sb[3] * 0x0101010101010101ll);
+	__m256i m = _mm256_cmpeq_epi8(_mm256_and_si256(v, bits), bits);// 0xFF in lanes where pixel bit set
+	__m256i p = _mm256_blendv_epi8(bk, txt, m);
+	p = _mm256_and_si256(_mm256_or_si256(p, _mm256_srli_epi16(p, 8)), _mm256_set1_epi16(0xFF));
+	p = _mm256_packus_epi16(p, p);									// Narrow, 8 bytes in each 128 bit lane
+	uint64_t lo = (uint64_t)_mm_cvtsi128_si64(_mm256_castsi256_si128(p));
+	uint64_t hi = (uint64_t)_mm_cvtsi128_si64(_mm256_extracti128_si256(p, 1));
+	memcpy(dp[0], &lo, 4);
+	memcpy(dp[1], (uint8_t*)&lo + 4, 4);
+	memcpy(dp[2], &hi, 4);
+	memcpy(dp[3], (uint8_t*)&hi + 4, 4);
+}
+
+/*-[ INTERNAL: avx2_stream ]------------------------------------------------}
+. Contiguous rows case, every 8 font bytes give 32 output bytes in order.
+. RETURN: number of font bytes processed
+.--------------------------------------------------------------------------*/
+__attribute__((target("avx2")))
+static uint32_t avx2_stream (const uint8_t* src, uint8_t* dst, uint32_t count, uint8_t txtcolor, uint8_t bkcolor)
+{
+	const __m256i bits = _mm256_set1_epi64x(0x0102040810204080ll);
+	const __m256i lomask = _mm256_set1_epi16(0xFF);
+	const __m256i idx0 = _mm256_setr_epi64x(0, 0x0101010101010101ll,
+		0x0202020202020202ll, 0x0303030303030303ll);				// Spread bytes 0..3 to 8 lanes each
+	const __m256i idx1 = _mm256_setr_epi64x(0x0404040404040404ll, 0x0505050505050505ll,
+		0x0606060606060606ll, 0x0707070707070707ll);				// Spread bytes 4..7 to 8 lanes each
+	__m256i txt = _mm256_set1_epi16(((txtcolor & 0xF) << 4) | ((txtcolor & 0xF) << 8));
+	__m256i bk = _mm256_set1_epi16(((bkcolor & 0xF) << 4) | ((bkcolor & 0xF) << 8));
+	uint32_t i;
+	for (i = 0; i + 8 <= count; i += 8, src += 8, dst += 32)
+	{
+		int64_t w;
+		memcpy(&w, src, 8);											// Fetch 8 font bytes
+		__m256i x = _mm256_set1_epi64x(w);							// In every 64 bit slot
+		__m256i v0 = _mm256_shuffle_epi8(x, idx0);
+		__m256i v1 = _mm256_shuffle_epi8(x, idx1);
+		__m256i p0 = _mm256_blendv_epi8(bk, txt, _mm256_cmpeq_epi8(_mm256_and_si256(v0, bits), bits));
+		__m256i p1 = _mm256_blendv_epi8(bk, txt, _mm256_cmpeq_epi8(_mm256_and_si256(v1, bits), bits));
+		p0 = _mm256_and_si256(_mm256_or_si256(p0, _mm256_srli_epi16(p0, 8)), lomask);
+		p1 = _mm256_and_si256(_mm256_or_si256(p1, _mm256_srli_epi16(p1, 8)), lomask);
+		__m256i r = _mm256_packus_epi16(p0, p1);					// Order is 01 45 23 67 in 64 bit slots
+		_mm256_storeu_si256((__m256i*)dst, _mm256_permute4x64_epi64(r, 0xD8));// Restore order and store 32 bytes
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static void expand_avx2 (const uint8_t* src, uint16_t srcstride, uint8_t* dst, uint16_t dststride, uint16_t wth, uint16_t ht, uint8_t txtcolor, uint8_t bkcolor)
+{
+	EXPAND_STREAM(avx2_stream)
+	EXPAND_GATHER(4, avx2_expand4)
+}
+#endif
+
+/*-[ Expand_KernelSupported ]-----------------------------------------------}
+. RETURN: true if the kernel is compiled in and the CPU supports it
+.--------------------------------------------------------------------------*/
+bool Expand_KernelSupported (EXPANDKERNEL kernel)
+{
+	switch (kernel)
+	{
+		case EXPAND_AUTO:
+		case EXPAND_SCALAR:
+			return true;											// Always available
+#ifdef EXPAND_HAVE_NEON
+		case EXPAND_NEON:
+#if defined(__aarch64__)
+			return true;											// NEON is mandatory on AArch64
+#else
+			return ((getauxval(AT_HWCAP) & HWCAP_NEON) != 0);		// Ask kernel if CPU has NEON
+#endif
+#endif
+#ifdef EXPAND_HAVE_X86
+		case EXPAND_SSE2:
+			return __builtin_cpu_supports("sse2");					// Check CPU has SSE2
+		case EXPAND_AVX2:
+			return __builtin_cpu_supports("avx2");					// Check CPU has AVX2
+#endif
+		default:
+			return false;											// Not compiled in
+	}
+}
+
+/*-[ Expand_SelectKernel ]--------------------------------------------------}
+. Selects the kernel used by Expand_1bpp and the ordered dither, EXPAND_AUTO
+. picks the fastest the CPU supports which is also what happens if this is
+. never called. Safe from any thread, expansions already running on other
+. threads finish with the old kernel.
+. RETURN: true for success, false if the CPU/build does not support kernel
+.--------------------------------------------------------------------------*/
+bool Expand_SelectKernel (EXPANDKERNEL kernel)
+{
+	if (!Expand_KernelSupported(kernel)) return false;				// Kernel not available
+	pthread_once(&expand_mask_once, expand_build_mask);				// All kernels use mask table for partial bytes
+	if (kernel == EXPAND_AUTO)										// Pick best available
+	{
+		if (Expand_KernelSupported(EXPAND_AVX2)) kernel = EXPAND_AVX2;
+		else if (Expand_KernelSupported(EXPAND_SSE2)) kernel = EXPAND_SSE2;
+		else if (Expand_KernelSupported(EXPAND_NEON)) kernel = EXPAND_NEON;
+		else kernel = EXPAND_SCALAR;
+	}
+	switch (kernel)
+	{
+#ifdef EXPAND_HAVE_NEON
+		case EXPAND_NEON:
+			__atomic_store_n(&expand_func, expand_neon, __ATOMIC_RELEASE);
+			__atomic_store_n(&dither_func, dither_neon, __ATOMIC_RELEASE);
+			break;
+#endif
+#ifdef EXPAND_HAVE_X86
+		case EXPAND_SSE2:
+			__atomic_store_n(&expand_func, expand_sse2, __ATOMIC_RELEASE);
+			__atomic_store_n(&dither_func, dither_sse2, __ATOMIC_RELEASE);
+			break;
+		case EXPAND_AVX2:
+			__atomic_store_n(&expand_func, expand_avx2, __ATOMIC_RELEASE);
+			__atomic_store_n(&dither_func, dither_sse2, __ATOMIC_RELEASE);	// Ordered dither has no AVX2 kernel
+			break;
+#endif
+		default:
+			__atomic_store_n(&expand_func, expand_scalar, __ATOMIC_RELEASE);
+			__atomic_store_n(&dither_func, dither_scalar, __ATOMIC_RELEASE);
+			break;
+	}
+	__atomic_store_n(&expand_kernel, kernel, __ATOMIC_RELAXED);		// Hold current kernel id
+	return true;
+}
+
+/*-[ Expand_KernelName ]----------------------------------------------------}
+. RETURN: printable name of the kernel
+.--------------------------------------------------------------------------*/
+const char* Expand_KernelName (EXPANDKERNEL kernel)
+{
+	switch (kernel)
+	{
+		case EXPAND_SCALAR: return "scalar";
+		case EXPAND_NEON: return "neon";
+		case EXPAND_SSE2: return "sse2";
+		case EXPAND_AVX2: return "avx2";
+		default:
+		{
+			EXPANDKERNEL cur = __atomic_load_n(&expand_kernel, __ATOMIC_RELAXED);
+			return (cur != EXPAND_AUTO) ? Expand_KernelName(cur) : "auto";
+		}
+	}
+}
+
+/*-[ INTERNAL: expand_resolve ]---------------------------------------------}
+. First call runtime dispatch, selects the best kernel and runs it.
+.--------------------------------------------------------------------------*/
+static void expand_resolve (const uint8_t* src, uint16_t srcstride, uint8_t* dst, uint16_t dststride, uint16_t wth, uint16_t ht, uint8_t txtcolor, uint8_t bkcolor)
+{
+	Expand_SelectKernel(EXPAND_AUTO);								// Select fastest kernel
+	__atomic_load_n(&expand_func, __ATOMIC_ACQUIRE)(src, srcstride, dst, dststride, wth, ht, txtcolor, bkcolor);
+}
+
+/*-[ INTERNAL: dither_resolve ]---------------------------------------------}
+. First call runtime dispatch, selects the best kernel and runs it.
+.--------------------------------------------------------------------------*/
+static void dither_resolve (const uint8_t* grey, uint8_t* dst, uint16_t wth, const uint8_t* th)
+{
+	Expand_SelectKernel(EXPAND_AUTO);								// Select fastest kernel
+	__atomic_load_n(&dither_func, __ATOMIC_ACQUIRE)(grey, dst, wth, th);
+}
+
+/*--------------------------------------------------------------------------}
+{  Blend tables for anti-aliased glyphs, one 256 entry table per colour	}
+{  pair mapping two coverage nibbles to two pixels. They are only built		}
+{  when a pair is first used so untouched tables never occupy real memory.	}
+{--------------------------------------------------------------------------*/
+static uint8_t blend_lut[256][256] = { { 0 } };	// [txt << 4 | bk][coverage byte]
+static uint8_t blend_built[256] = { 0 };		// Table has been built flag
+
+/*-[ INTERNAL: blend_table ]------------------------------------------------}
+. RETURN: the blend table of the colour pair, building it if required
+.--------------------------------------------------------------------------*/
+static const uint8_t* blend_table (uint8_t txtcolor, uint8_t bkcolor)
+{
+	uint8_t pair = ((txtcolor & 0xF) << 4) | (bkcolor & 0xF);		// Table index of the colour pair
+	if (!__atomic_load_n(&blend_built[pair], __ATOMIC_ACQUIRE))		// Table not yet built
+	{
+		uint8_t lvl[16];
+		for (unsigned int c = 0; c < 16; c++)						// Grey level for each coverage
+			lvl[c] = ((bkcolor & 0xF) * (15 - c) + (txtcolor & 0xF) * c + 7) / 15;
+		for (unsigned int b = 0; b < 256; b++)						// Every pair of coverage nibbles
+			blend_lut[pair][b] = (lvl[b >> 4] << 4) | lvl[b & 0xF];
+		__atomic_store_n(&blend_built[pair], 1, __ATOMIC_RELEASE);	// Table is now valid
+	}
+	return &blend_lut[pair][0];
+}
+
+/*-[ Expand_Blend4bpp ]-----------------------------------------------------}
+. Blends a wth x ht 4bpp coverage bitmap (two pixels per byte, high nibble
+. leftmost, rows srcstride bytes apart) between bkcolor at coverage 0 and
+. txtcolor at coverage 15 into packed 4bpp pixels at dst. Each coverage byte
+. goes through a 256 entry table for the colour pair, built on first use, so
+. there is no per pixel maths. The width must be even.
+.--------------------------------------------------------------------------*/
+void Expand_Blend4bpp (const uint8_t* src, uint16_t srcstride, uint8_t* dst, uint16_t dststride, uint16_t wth, uint16_t ht, uint8_t txtcolor, uint8_t bkcolor)
+{
+	if (src == 0 || dst == 0) return;								// Invalid pointers
+	const uint8_t* lut = blend_table(txtcolor, bkcolor);			// Table for the colour pair
+	for (uint16_t y = 0; y < ht; y++, src += srcstride, dst += dststride)
+		for (uint16_t i = 0; i < wth / 2; i++)						// Each pixel pair
+			dst[i] = lut[src[i]];
+}
+
+/*--------------------------------------------------------------------------}
+{  Pixel replication tables for scaled text. Entry [scale - 2][b] is the	}
+{  scale bytes the pixel pair b becomes, built once on first use.			}
+{--------------------------------------------------------------------------*/
+static uint8_t scale_lut[3][256][4] = { { { 0 } } };	// [scale - 2][pixel pair][output bytes]
+static uint8_t scale_built = 0;					// Tables have been built flag
+
+/*-[ Expand_ScaleRow4bpp ]--------------------------------------------------}
+. Scales one row of packed 4bpp pixels up by scale (1 to 4) replicating
+. each pixel scale times across through a byte table, writing dstbytes of
+. the result at dst. The row is then copied down so it fills rows rows,
+. dststride bytes apart, which gives the vertical replication.
+.--------------------------------------------------------------------------*/
+void Expand_ScaleRow4bpp (const uint8_t* src, uint8_t* dst, uint16_t dststride, uint16_t dstbytes, uint16_t rows, uint8_t scale)
+{
+	if (src == 0 || dst == 0 || rows == 0 || scale == 0 || scale > 4) return;// Invalid parameters
+	if (scale == 1) memcpy(dst, src, dstbytes);						// No scaling is a straight copy
+	else {
+		if (!__atomic_load_n(&scale_built, __ATOMIC_ACQUIRE))		// Tables not yet built
+		{
+			for (unsigned int b = 0; b < 256; b++)					// Every pixel pair
+			{
+				uint8_t hi = (b >> 4) * 0x11, lo = (b & 0xF) * 0x11;// Each pixel doubled up in a byte
+				scale_lut[0][b][0] = hi;							// 2x  .. AA BB
+				scale_lut[0][b][1] = lo;
+				scale_lut[1][b][0] = hi;							// 3x  .. AA AB BB
+				scale_lut[1][b][1] = b;
+				scale_lut[1][b][2] = lo;
+				scale_lut[2][b][0] = hi;							// 4x  .. AA AA BB BB
+				scale_lut[2][b][1] = hi;
+				scale_lut[2][b][2] = lo;
+				scale_lut[2][b][3] = lo;
+			}
+			__atomic_store_n(&scale_built, 1, __ATOMIC_RELEASE);	// Tables are now valid
+		}
+		const uint8_t (*lut)[4] = scale_lut[scale - 2];				// Table for this scale
+		uint16_t full = dstbytes / scale;							// Source bytes that fit whole
+		uint8_t* dp = dst;
+		for (uint16_t i = 0; i < full; i++, dp += scale)			// Each whole replicated pixel pair
+			memcpy(dp, lut[src[i]], scale);
+		if (dstbytes > full * scale)								// Clipped last pixel pair
+			memcpy(dp, lut[src[full]], dstbytes - full * scale);
+	}
+	for (uint16_t r = 1; r < rows; r++)								// Replicate the row down
+		memcpy(&dst[r * dststride], dst, dstbytes);
+}
+
+/*-[ Expand_1bpp ]----------------------------------------------------------}
+. Expands a wth x ht 1bpp bitmap (MSB is leftmost pixel, rows srcstride
+. bytes apart) into packed 4bpp pixel pairs at dst (rows dststride bytes
+. apart). Set bits become txtcolor, clear bits become bkcolor. The width
+. must be even as two pixels are packed per byte.
+.--------------------------------------------------------------------------*/
+void Expand_1bpp (const uint8_t* src, uint16_t srcstride, uint8_t* dst, uint16_t dststride, uint16_t wth, uint16_t ht, uint8_t txtcolor, uint8_t bkcolor)
+{
+	if (src && dst) __atomic_load_n(&expand_func, __ATOMIC_ACQUIRE)(src, srcstride, dst, dststride, wth, ht, txtcolor, bkcolor);
+}
+
+/*-[ Expand_DitherInit ]----------------------------------------------------}
+. Starts dithering an image wth pixels wide with the given mode.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Expand_DitherInit (DITHERSTATE* ds, DITHERMODE mode, uint16_t wth)
+{
+	if (ds == 0 || wth == 0 || wth > EXPAND_DITHER_MAXWTH || mode > DITHER_FLOYD)
+		return false;												// Invalid parameters
+	ds->mode = mode;
+	ds->wth = wth;
+	ds->row = 0;
+	memset(&ds->err[0][0], 0, sizeof(ds->err));						// No error carried into first row
+	return true;
+}
+
+/*-[ INTERNAL: dither_floyd ]-----------------------------------------------}
+. Floyd-Steinberg error diffusion of one row. Error is kept in 1/16ths, 7
+. go right to the next pixel and 3, 5 and 1 to the row below. The error
+. rows have a guard entry at each end so the edges need no tests.
+.--------------------------------------------------------------------------*/
+static void dither_floyd (DITHERSTATE* ds, const uint8_t* grey, uint8_t* dst)
+{
+	int16_t* cur = &ds->err[ds->row & 1][1];						// Error from row above
+	int16_t* nxt = &ds->err[(ds->row + 1) & 1][1];					// Error for row below
+	memset(nxt - 1, 0, (ds->wth + 2) * sizeof(int16_t));
+	int carry = 0;													// Error from pixel to the left
+	for (uint16_t x = 0; x < ds->wth; x++)
+	{
+		int v = grey[x] + ((cur[x] + carry + 8) >> 4);				// Pixel with error added
+		if (v < 0) v = 0;
+		if (v > 255) v = 255;
+		int q = (v * 15 + 127) / 255;								// Nearest level
+		int e = v - q * 17;											// What the level misses by
+		carry = 7 * e;
+		nxt[x - 1] += 3 * e;
+		nxt[x] += 5 * e;
+		nxt[x + 1] += e;
+		if (x & 1) dst[x / 2] |= q;									// Odd pixel in low nibble
+		else dst[x / 2] = q << 4;									// Even pixel in high nibble
+	}
+}
+
+/*-[ Expand_DitherRow ]-----------------------------------------------------}
+. Dithers the next row of 8 bit grey pixels (0 black .. 255 white) to 16
+. grey levels packed two per byte at dst, (wth+1)/2 bytes. Rows are taken
+. one at a time so they can go straight into a transfer buffer or bitmap.
+. Bayer and plain rounding use the SIMD kernel, error diffusion carries
+. from pixel to pixel so always runs scalar.
+.--------------------------------------------------------------------------*/
+void Expand_DitherRow (DITHERSTATE* ds, const uint8_t* grey, uint8_t* dst)
+{
+	if (ds == 0 || grey == 0 || dst == 0) return;					// Invalid pointers
+	if (ds->mode == DITHER_FLOYD) dither_floyd(ds, grey, dst);
+	else __atomic_load_n(&dither_func, __ATOMIC_ACQUIRE)(grey, dst, ds->wth, (ds->mode == DITHER_BAYER) ?
+		&dither_bayer[ds->row & 3][0] : &dither_round[0]);			// Row of the threshold pattern
+	ds->row++;
+}
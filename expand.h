@@ -0,0 +1,120 @@
+#ifndef _EXPAND_H_
+#define _EXPAND_H_
+
+#ifdef __cplusplus								// If we are including to a C++
+extern "C" {									// Put extern C directive wrapper around
+#endif
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++}
+{																			}
+{       Filename: expand.h													}
+{       Copyright: Leon de Boer(LdB) 2020									}
+{       Version: 1.00														}
+{		Release under MIT license (https://opensource.org/licenses/MIT)     }
+{																			}
+{***************************************************************************}
+{                                                                           }
+{      Defines kernels that expand 1bpp bitmaps and dither 8 bit grey		}
+{      images to packed 4bpp pixels											}
+{																            }
+{++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
+{  1.00 Initial version														}
+{++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#include <stdbool.h>							// C standard unit for bool, true, false
+#include <stdint.h>								// C standard unit for uint32_t etc
+
+#define EXPAND_DRIVER_VERSION 1000				// Version number 1.00 build 0
+
+typedef enum {
+	EXPAND_AUTO = 0,							// Pick the fastest kernel the CPU supports
+	EXPAND_SCALAR = 1,							// Table driven C kernel, always available
+	EXPAND_NEON = 2,							// ARM NEON kernel (Pi2, Pi3)
+	EXPAND_SSE2 = 3,							// x86 SSE2 kernel
+	EXPAND_AVX2 = 4,							// x86 AVX2 kernel
+} EXPANDKERNEL;
+
+typedef enum {
+	DITHER_NONE = 0,							// Each pixel rounded to the nearest level
+	DITHER_BAYER = 1,							// Ordered dither with a 4x4 Bayer matrix
+	DITHER_FLOYD = 2,							// Floyd-Steinberg error diffusion
+} DITHERMODE;
+
+#define EXPAND_DITHER_MAXWTH ( 256 )			// Widest row Expand_DitherRow takes
+
+/*--------------------------------------------------------------------------}
+{   State carried between the rows of an image being dithered, the error	}
+{   diffusion needs the error the row above left for this row.				}
+{--------------------------------------------------------------------------*/
+typedef struct dither_state
+{
+	uint8_t mode;								// DITHERMODE in use
+	uint8_t _reserved;
+	uint16_t wth;								// Pixels in each row
+	uint16_t row;								// Rows done so far
+	int16_t err[2][EXPAND_DITHER_MAXWTH + 2];	// Error in 1/16ths for this and next row
+} DITHERSTATE;
+
+/*-[ Expand_1bpp ]----------------------------------------------------------}
+. Expands a wth x ht 1bpp bitmap (MSB is leftmost pixel, rows srcstride
+. bytes apart) into packed 4bpp pixel pairs at dst (rows dststride bytes
+. apart). Set bits become txtcolor, clear bits become bkcolor. The width
+. must be even as two pixels are packed per byte.
+.--------------------------------------------------------------------------*/
+void Expand_1bpp (const uint8_t* src, uint16_t srcstride, uint8_t* dst, uint16_t dststride, uint16_t wth, uint16_t ht, uint8_t txtcolor, uint8_t bkcolor);
+
+/*-[ Expand_Blend4bpp ]-----------------------------------------------------}
+. Blends a wth x ht 4bpp coverage bitmap (two pixels per byte, high nibble
+. leftmost, rows srcstride bytes apart) between bkcolor at coverage 0 and
+. txtcolor at coverage 15 into packed 4bpp pixels at dst. Each coverage byte
+. goes through a 256 entry table for the colour pair, built on first use, so
+. there is no per pixel maths. The width must be even.
+.--------------------------------------------------------------------------*/
+void Expand_Blend4bpp (const uint8_t* src, uint16_t srcstride, uint8_t* dst, uint16_t dststride, uint16_t wth, uint16_t ht, uint8_t txtcolor, uint8_t bkcolor);
+
+/*-[ Expand_ScaleRow4bpp ]--------------------------------------------------}
+. Scales one row of packed 4bpp pixels up by scale (1 to 4) replicating
+. each pixel scale times across through a byte table, writing dstbytes of
+. the result at dst. The row is then copied down so it fills rows rows,
+. dststride bytes apart, which gives the vertical replication.
+.--------------------------------------------------------------------------*/
+void Expand_ScaleRow4bpp (const uint8_t* src, uint8_t* dst, uint16_t dststride, uint16_t dstbytes, uint16_t rows, uint8_t scale);
+
+/*-[ Expand_DitherInit ]----------------------------------------------------}
+. Starts dithering an image wth pixels wide with the given mode.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Expand_DitherInit (DITHERSTATE* ds, DITHERMODE mode, uint16_t wth);
+
+/*-[ Expand_DitherRow ]-----------------------------------------------------}
+. Dithers the next row of 8 bit grey pixels (0 black .. 255 white) to 16
+. grey levels packed two per byte at dst, (wth+1)/2 bytes. Rows are taken
+. one at a time so they can go straight into a transfer buffer or bitmap.
+. Bayer and plain rounding use the SIMD kernel, error diffusion carries
+. from pixel to pixel so always runs scalar.
+.--------------------------------------------------------------------------*/
+void Expand_DitherRow (DITHERSTATE* ds, const uint8_t* grey, uint8_t* dst);
+
+/*-[ Expand_SelectKernel ]--------------------------------------------------}
+. Selects the kernel used by Expand_1bpp and the ordered dither, EXPAND_AUTO
+. picks the fastest the CPU supports which is also what happens if this is
+. never called.
+. RETURN: true for success, false if the CPU/build does not support kernel
+.--------------------------------------------------------------------------*/
+bool Expand_SelectKernel (EXPANDKERNEL kernel);
+
+/*-[ Expand_KernelSupported ]-----------------------------------------------}
+. RETURN: true if the kernel is compiled in and the CPU supports it
+.--------------------------------------------------------------------------*/
+bool Expand_KernelSupported (EXPANDKERNEL kernel);
+
+/*-[ Expand_KernelName ]----------------------------------------------------}
+. RETURN: printable name of the kernel
+.--------------------------------------------------------------------------*/
+const char* Expand_KernelName (EXPANDKERNEL kernel);
+
+#ifdef __cplusplus								// If we are including to a C++ file
+}												// Close the extern C directive wrapper
+#endif
+
+#endif
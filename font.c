@@ -0,0 +1,399 @@
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++}
+{																			}
+{       Filename: font.c													}
+{       Copyright(c): Leon de Boer(LdB) 2020								}
+{       Version: 1.00														}
+{		Release under MIT license (https://opensource.org/licenses/MIT)     }
+{																			}
+{***************************************************************************}
+{                                                                           }
+{      Defines a runtime registry of fixed, packed and anti-aliased fonts	}
+{																            }
+{++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
+{  1.00 Initial version														}
+{++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#include <stdbool.h>							// C standard unit for bool, true, false
+#include <stdint.h>								// C standard unit for uint32_t etc
+#include <stddef.h>								// C standard unit for offsetof
+#include <string.h>								// C standard unit needed for memset
+#include <fcntl.h>								// Needed for font file access
+#include <sys/mman.h>							// Needed to map font files
+#include <sys/stat.h>							// Needed for font file size
+#include <unistd.h>								// Need for file definitions
+#include "font8x16.h"							// Font 16x8 bitmap data
+#include "font8x8.h"							// Font 8x8 bitmap data
+#include "font6x8.h"							// Font 6x8 bitmap data
+#include "font.h"								// This units header
+
+#if FONT_DRIVER_VERSION != 1000
+#error "Header does not match this version of file"
+#endif
+
+/* Global table of registered fonts, compiled in fonts occupy first entries */
+static FONTDESC fonttab[MAX_FONTS] = {
+	[FONT8x16] = { .format = FONT_FORMAT_FIXED, .height = 16, .fixedwth = 8, .stride = 16,
+		.firstchar = 0, .numchars = 256, .defaultchar = '?', .defaultglyph = '?', .bitmap = &font_8x16_data[0] },
+	[FONT8x8] = { .format = FONT_FORMAT_FIXED, .height = 8, .fixedwth = 8, .stride = 8,
+		.firstchar = 0, .numchars = 256, .defaultchar = '?', .defaultglyph = '?', .bitmap = &font_8x8_data[0] },
+	[FONT6x8] = { .format = FONT_FORMAT_FIXED, .height = 8, .fixedwth = 6, .stride = 8,
+		.firstchar = 0, .numchars = 256, .defaultchar = '?', .defaultglyph = '?', .bitmap = &font_6x8_data[0] },
+};
+#define FONT_BUILTIN ( 3 )						// Number of compiled in fonts
+
+static uint32_t font_generation = 0;			// Changes whenever a font is removed
+
+/* Mapping of fonts loaded from file, indexed by font id */
+static struct {
+	void* addr;									// Address file is mapped at
+	size_t len;									// Length of mapping
+} fontmap[MAX_FONTS] = { { 0 } };
+
+static uint8_t font_register_glyphs (FONTFORMAT format, uint8_t height, uint16_t firstchar, uint16_t numchars, const FONTGLYPH* glyphs, const uint8_t* bitmap, const uint16_t* pagedir, const uint16_t* pages, uint16_t defaultchar);
+
+/*-[ INTERNAL: font_alloc ]-------------------------------------------------}
+. RETURN: a free registry entry id, FONT_INVALID if registry full
+.--------------------------------------------------------------------------*/
+static uint8_t font_alloc (void)
+{
+	for (uint8_t i = FONT_BUILTIN; i < MAX_FONTS; i++)				// Search each table entry
+		if (fonttab[i].bitmap == 0) return i;						// Entry is free
+	return FONT_INVALID;											// Registry full
+}
+
+/*-[ Font_RegisterFixed ]---------------------------------------------------}
+. Registers a fixed width font in the format of the compiled in fonts, each
+. character is stride bytes, rows are (wth+7)/8 bytes MSB first.
+. RETURN: font id for success, FONT_INVALID for any failure
+.--------------------------------------------------------------------------*/
+uint8_t Font_RegisterFixed (const uint8_t* data, uint8_t wth, uint8_t ht, uint16_t stride, uint16_t firstchar, uint16_t numchars)
+{
+	if (data == 0 || wth == 0 || (wth & 1) || wth > FONT_MAXWTH ||
+		ht == 0 || ht > FONT_MAXHT || numchars == 0 ||
+		stride < (wth + 7) / 8 * ht) return FONT_INVALID;			// Invalid font parameters
+	uint8_t id = font_alloc();										// Find a free entry
+	if (id != FONT_INVALID)
+	{
+		FONTDESC* f = &fonttab[id];
+		f->format = FONT_FORMAT_FIXED;								// Fixed font
+		f->height = ht;												// Font height
+		f->fixedwth = wth;											// Font width
+		f->stride = stride;											// Bytes per character
+		f->firstchar = firstchar;									// First character
+		f->numchars = numchars;										// Number of characters
+		f->defaultchar = ('?' >= firstchar && '?' - firstchar < numchars) ? '?' : firstchar;
+		f->defaultglyph = f->defaultchar - firstchar;				// Glyph of default character
+		f->glyphs = 0;												// No glyph table
+		f->pagedir = 0;												// Not a sparse font
+		f->pages = 0;
+		f->bitmap = data;											// Font data, entry now in use
+	}
+	return id;
+}
+
+/*-[ Font_RegisterPacked ]--------------------------------------------------}
+. Registers a packed variable width font of numchars glyphs starting from
+. firstchar. The glyph table and bitmap must stay valid while registered.
+. RETURN: font id for success, FONT_INVALID for any failure
+.--------------------------------------------------------------------------*/
+uint8_t Font_RegisterPacked (uint8_t height, uint16_t firstchar, uint16_t numchars, const FONTGLYPH* glyphs, const uint8_t* bitmap)
+{
+	return font_register_glyphs(FONT_FORMAT_PACKED, height, firstchar, numchars, glyphs, bitmap, 0, 0, '?');
+}
+
+/*-[ Font_RegisterAA ]------------------------------------------------------}
+. Registers an anti-aliased font of numchars glyphs starting from firstchar
+. whose bitmap is an atlas of 4 bit coverage glyphs. The glyph table and
+. bitmap must stay valid while registered.
+. RETURN: font id for success, FONT_INVALID for any failure
+.--------------------------------------------------------------------------*/
+uint8_t Font_RegisterAA (uint8_t height, uint16_t firstchar, uint16_t numchars, const FONTGLYPH* glyphs, const uint8_t* bitmap)
+{
+	return font_register_glyphs(FONT_FORMAT_AA4, height, firstchar, numchars, glyphs, bitmap, 0, 0, '?');
+}
+
+/*-[ Font_RegisterSparse ]--------------------------------------------------}
+. Registers a packed or anti-aliased font of numglyphs glyphs found through
+. a two level sparse index (see FONTDESC) so it can hold any set of BMP
+. characters. The tables and bitmap must stay valid while registered.
+. RETURN: font id for success, FONT_INVALID for any failure
+.--------------------------------------------------------------------------*/
+uint8_t Font_RegisterSparse (FONTFORMAT format, uint8_t height, uint16_t defaultchar, uint16_t numglyphs, const FONTGLYPH* glyphs, const uint8_t* bitmap, const uint16_t* pagedir, const uint16_t* pages)
+{
+	if ((format != FONT_FORMAT_PACKED && format != FONT_FORMAT_AA4)
+		|| pagedir == 0 || pages == 0) return FONT_INVALID;			// Invalid format or index
+	return font_register_glyphs(format, height, 0, numglyphs, glyphs, bitmap, pagedir, pages, defaultchar);
+}
+
+/*-[ INTERNAL: font_register_glyphs ]---------------------------------------}
+. Registers a font with a glyph table in the given format. With a page
+. directory the glyphs are found through the sparse index, otherwise they
+. are the characters from firstchar and defaultchar is only a preference.
+. RETURN: font id for success, FONT_INVALID for any failure
+.--------------------------------------------------------------------------*/
+static uint8_t font_register_glyphs (FONTFORMAT format, uint8_t height, uint16_t firstchar, uint16_t numchars, const FONTGLYPH* glyphs, const uint8_t* bitmap, const uint16_t* pagedir, const uint16_t* pages, uint16_t defaultchar)
+{
+	if (glyphs == 0 || bitmap == 0 || height == 0 || height > FONT_MAXHT
+		|| numchars == 0) return FONT_INVALID;						// Invalid font parameters
+	for (uint16_t i = 0; i < numchars; i++)							// Check every glyph fits the cell
+	{
+		if (glyphs[i].wth > FONT_MAXWTH || glyphs[i].advance > FONT_MAXWTH ||
+			glyphs[i].top + glyphs[i].ht > height) return FONT_INVALID;
+	}
+	uint16_t defglyph;
+	if (pagedir)													// Sparse font
+	{
+		uint32_t numpages = 0;
+		for (uint16_t i = 0; i < FONT_PAGES; i++)					// Find how many pages are used
+			if (pagedir[i] != FONT_NOPAGE && pagedir[i] >= numpages) numpages = pagedir[i] + 1;
+		for (uint32_t i = 0; i < numpages * 256; i++)				// Check every entry is a real glyph
+			if (pages[i] != FONT_NOGLYPH && pages[i] >= numchars) return FONT_INVALID;
+		defglyph = (pagedir[defaultchar >> 8] != FONT_NOPAGE) ?
+			pages[((uint32_t)pagedir[defaultchar >> 8] << 8) | (defaultchar & 0xFF)] : FONT_NOGLYPH;
+		if (defglyph == FONT_NOGLYPH) defglyph = 0;					// Default character missing, use first glyph
+	} else {
+		if (defaultchar < firstchar || defaultchar - firstchar >= numchars)
+			defaultchar = firstchar;								// Default character not in font
+		defglyph = defaultchar - firstchar;							// Glyph of default character
+	}
+	uint8_t id = font_alloc();										// Find a free entry
+	if (id != FONT_INVALID)
+	{
+		FONTDESC* f = &fonttab[id];
+		f->format = format;											// Packed or anti-aliased font
+		f->height = height;											// Font cell height
+		f->fixedwth = 0;											// Not fixed width
+		f->stride = 0;												// No fixed stride
+		f->firstchar = firstchar;									// First character
+		f->numchars = numchars;										// Number of characters
+		f->defaultchar = defaultchar;								// Default character
+		f->defaultglyph = defglyph;									// Glyph of default character
+		f->glyphs = glyphs;											// Glyph table
+		f->pagedir = pagedir;										// Sparse index if any
+		f->pages = pages;
+		f->bitmap = bitmap;											// Font bitmap, entry now in use
+	}
+	return id;
+}
+
+/*-[ Font_Unregister ]------------------------------------------------------}
+. Removes a registered font, the compiled in fonts can not be removed and
+. fonts loaded from file use Font_Unload. No device context may still have
+. the font selected.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Font_Unregister (uint8_t fontid)
+{
+	if (fontid >= FONT_BUILTIN && fontid < MAX_FONTS && fonttab[fontid].bitmap
+		&& fontmap[fontid].addr == 0)								// Valid font not loaded from file
+	{
+		memset(&fonttab[fontid], 0, sizeof(FONTDESC));				// Entry is free again
+		font_generation++;											// Glyph caches must discard font
+		return true;
+	}
+	return false;
+}
+
+/*-[ Font_Load ]------------------------------------------------------------}
+. Maps a font file written by tools/fontconv read only and registers it. The
+. glyph pages fault in as they are first drawn and are shared through the
+. page cache with every other process using the same font file.
+. RETURN: font id for success, FONT_INVALID for any failure
+.--------------------------------------------------------------------------*/
+uint8_t Font_Load (const char* filename)
+{
+	uint8_t id = FONT_INVALID;										// Preset failure
+	if (filename == 0) return id;									// No filename
+	int fd = open(filename, O_RDONLY);								// Open the font file
+	if (fd < 0) return id;											// File did not open
+	struct stat st;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size >= offsetof(FONTFILEHEADER, numpages))
+	{
+		size_t len = st.st_size;									// Size of file
+		void* addr = mmap(0, len, PROT_READ, MAP_SHARED, fd, 0);	// Map it read only and shared
+		if (addr != MAP_FAILED)
+		{
+			const FONTFILEHEADER* hdr = addr;
+			size_t hsize = (hdr->version == 1) ?
+				offsetof(FONTFILEHEADER, numpages) : sizeof(FONTFILEHEADER);// Version 1 header is shorter
+			uint16_t numpages = (hdr->version == 1 || len < hsize) ? 0 : hdr->numpages;
+			size_t idxsize = numpages ? (FONT_PAGES + (size_t)numpages * 256) * sizeof(uint16_t) : 0;
+			const FONTGLYPH* glyphs = (const FONTGLYPH*)((const uint8_t*)addr + hsize);// Glyph table follows header
+			const uint16_t* pagedir = (const uint16_t*)&glyphs[hdr->numchars];// Sparse index follows glyph table
+			const uint8_t* bitmap = (const uint8_t*)pagedir + idxsize;// Bitmap follows glyph table and index
+			bool aa = (memcmp(&hdr->magic[0], FONTFILE_MAGIC_AA4, 4) == 0);// Anti-aliased font file
+			bool valid = ((aa || memcmp(&hdr->magic[0], FONTFILE_MAGIC, 4) == 0) &&
+				hdr->version >= 1 && hdr->version <= FONTFILE_VERSION &&
+				hsize + (size_t)hdr->numchars * sizeof(FONTGLYPH) + idxsize
+				+ hdr->bitmapsize <= len);							// Header valid and file holds all data
+			for (uint16_t i = 0; valid && numpages && i < FONT_PAGES; i++)// Check directory only names pages in file
+				valid = (pagedir[i] == FONT_NOPAGE || pagedir[i] < numpages);
+			for (uint16_t i = 0; valid && i < hdr->numchars; i++)	// Check no glyph reads past bitmap
+				valid = aa ? (glyphs[i].offset + (uint64_t)(glyphs[i].wth + 1) / 2 * glyphs[i].ht
+					<= hdr->bitmapsize) : (glyphs[i].offset + (uint64_t)glyphs[i].wth * glyphs[i].ht
+					<= (uint64_t)hdr->bitmapsize * 8);
+			if (valid) id = font_register_glyphs(aa ? FONT_FORMAT_AA4 : FONT_FORMAT_PACKED,
+				hdr->height, numpages ? 0 : hdr->firstchar, hdr->numchars, glyphs, bitmap,
+				numpages ? pagedir : 0, numpages ? &pagedir[FONT_PAGES] : 0,
+				hdr->defaultchar);									// Register the mapped font
+			if (id != FONT_INVALID)
+			{
+				fontmap[id].addr = addr;							// Hold mapping to release later
+				fontmap[id].len = len;
+			} else munmap(addr, len);								// Invalid file so unmap
+		}
+	}
+	close(fd);														// Mapping stays valid after close
+	return id;														// Return font id
+}
+
+/*-[ Font_Unload ]----------------------------------------------------------}
+. Unregisters a font loaded by Font_Load and unmaps the file. No device
+. context may still have the font selected.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Font_Unload (uint8_t fontid)
+{
+	if (fontid >= FONT_BUILTIN && fontid < MAX_FONTS && fontmap[fontid].addr)// Valid font loaded from file
+	{
+		memset(&fonttab[fontid], 0, sizeof(FONTDESC));				// Entry is free again
+		font_generation++;											// Glyph caches must discard font
+		munmap(fontmap[fontid].addr, fontmap[fontid].len);			// Release the mapping
+		fontmap[fontid].addr = 0;
+		fontmap[fontid].len = 0;
+		return true;
+	}
+	return false;
+}
+
+/*-[ Font_Get ]-------------------------------------------------------------}
+. RETURN: the registered font for the id, NULL if no such font
+.--------------------------------------------------------------------------*/
+const FONTDESC* Font_Get (uint8_t fontid)
+{
+	if (fontid < MAX_FONTS && fonttab[fontid].bitmap) return &fonttab[fontid];
+	return 0;
+}
+
+/*-[ Font_Generation ]------------------------------------------------------}
+. RETURN: a count that changes whenever a font is unregistered, so anything
+. caching glyphs by font id knows to discard them.
+.--------------------------------------------------------------------------*/
+uint32_t Font_Generation (void)
+{
+	return font_generation;
+}
+
+/*-[ Font_DecodeUTF8 ]------------------------------------------------------}
+. Decodes the next character of a UTF-8 string and moves the pointer past
+. it. A byte that does not start a valid sequence decodes as itself, so 8
+. bit text written for the compiled in fonts still draws the same glyphs.
+. RETURN: the character code, 0 at the end of the string
+.--------------------------------------------------------------------------*/
+uint32_t Font_DecodeUTF8 (const char** txt)
+{
+	const uint8_t* p = (const uint8_t*)*txt;
+	uint32_t ch = p[0];												// Lead byte
+	if (ch == 0) return 0;											// End of string, pointer stays
+	if (ch >= 0xC2 && ch <= 0xF4)									// Lead byte of multibyte sequence
+	{
+		int more = (ch >= 0xF0) ? 3 : (ch >= 0xE0) ? 2 : 1;			// Continuation bytes expected
+		uint32_t cp = ch & (0x3F >> more);							// Code bits of lead byte
+		int i;
+		for (i = 1; i <= more && (p[i] & 0xC0) == 0x80; i++)		// Each continuation byte
+			cp = (cp << 6) | (p[i] & 0x3F);
+		if (i > more && !(more == 2 && cp < 0x800) &&				// Complete and not overlong
+			!(more == 3 && (cp < 0x10000 || cp > 0x10FFFF)) &&
+			!(cp >= 0xD800 && cp <= 0xDFFF))						// and not a surrogate
+		{
+			*txt += more + 1;										// Move past sequence
+			return cp;
+		}
+	}
+	(*txt)++;														// Single byte character
+	return ch;
+}
+
+/*-[ Font_GlyphIndexSparse ]------------------------------------------------}
+. Looks the character up through the sparse page index of the font.
+. RETURN: the glyph index of the character, default glyph if not in font
+.--------------------------------------------------------------------------*/
+uint16_t Font_GlyphIndexSparse (const FONTDESC* font, uint32_t ch)
+{
+	if (ch < FONT_PAGES * 256)										// Character within sparse index
+	{
+		uint16_t page = font->pagedir[ch >> 8];						// Page holding character
+		if (page != FONT_NOPAGE)
+		{
+			uint16_t glyph = font->pages[((uint32_t)page << 8) | (ch & 0xFF)];
+			if (glyph != FONT_NOGLYPH) return glyph;				// Character is in font
+		}
+	}
+	return font->defaultglyph;										// Use the default glyph
+}
+
+/*-[ Font_GlyphWidth ]------------------------------------------------------}
+. RETURN: the width in pixels of the glyph cell which is also the advance.
+. It is always even as the screen packs two pixels per byte.
+.--------------------------------------------------------------------------*/
+uint16_t Font_GlyphWidth (const FONTDESC* font, uint16_t glyph)
+{
+	if (font->format == FONT_FORMAT_FIXED) return font->fixedwth;	// Fixed fonts are always even
+	const FONTGLYPH* g = &font->glyphs[glyph];
+	uint16_t wth = (g->advance > g->wth) ? g->advance : g->wth;		// Cell must hold glyph and advance
+	return (wth + 1) & 0xFFFE;										// Round up to even
+}
+
+/*-[ Font_GlyphBits ]-------------------------------------------------------}
+. Fetches the glyph cell (Font_GlyphWidth x height) as 1bpp rows MSB first.
+. Fixed fonts return a pointer into the font data, packed glyphs are unpacked
+. into buf which must hold FONT_MAXCELLBYTES. The row stride is put in stride.
+. RETURN: pointer to the glyph rows, NULL for any failure
+.--------------------------------------------------------------------------*/
+const uint8_t* Font_GlyphBits (const FONTDESC* font, uint16_t glyph, uint8_t* buf, uint16_t* stride)
+{
+	if (font == 0 || glyph >= font->numchars || stride == 0) return 0;
+	if (font->format == FONT_FORMAT_FIXED)							// Fixed font rows are already byte aligned
+	{
+		*stride = (font->fixedwth + 7) / 8;							// Bytes per row
+		return &font->bitmap[(uint32_t)glyph * font->stride];		// Glyph straight from font data
+	}
+	const FONTGLYPH* g = &font->glyphs[glyph];
+	uint16_t cw = Font_GlyphWidth(font, glyph);						// Width of glyph cell
+	if (font->format == FONT_FORMAT_AA4)							// Anti-aliased coverage glyph
+	{
+		uint16_t gst = (g->wth + 1) / 2;							// Bytes per row of glyph
+		if (g->top == 0 && g->ht == font->height && gst == cw / 2)	// Glyph fills its cell
+		{
+			*stride = gst;
+			return &font->bitmap[g->offset];						// Coverage straight from atlas
+		}
+		if (buf == 0) return 0;										// Need a buffer to build cell
+		memset(buf, 0, cw / 2 * font->height);						// Cell starts as zero coverage
+		for (uint16_t r = 0; r < g->ht; r++)						// Copy each glyph row into cell
+			memcpy(&buf[(r + g->top) * (cw / 2)], &font->bitmap[g->offset + r * gst], gst);
+		*stride = cw / 2;
+		return buf;
+	}
+	if (buf == 0) return 0;											// Packed glyphs need a buffer
+	uint16_t st = (cw + 7) / 8;										// Bytes per row of cell
+	memset(buf, 0, st * font->height);								// Cell starts as all background
+	uint32_t bit = g->offset;										// Bit position of first glyph row
+	for (uint16_t r = 0; r < g->ht; r++, bit += g->wth)				// For each glyph row
+	{
+		uint8_t* d = &buf[(r + g->top) * st];						// Row in cell
+		for (uint16_t x = 0; x < g->wth; x += 8)					// Each 8 bits of the row
+		{
+			uint32_t pos = bit + x;									// Bit position in bitmap
+			uint8_t sh = pos & 7;									// Bit shift within byte
+			uint16_t left = g->wth - x;								// Bits left in row
+			uint8_t v = font->bitmap[pos >> 3] << sh;				// Bits from first byte
+			if (sh && left > 8 - sh)								// Bits run into next byte
+				v |= font->bitmap[(pos >> 3) + 1] >> (8 - sh);
+			if (left < 8) v &= 0xFF << (8 - left);					// Clear bits past end of row
+			d[x / 8] = v;
+		}
+	}
+	*stride = st;													// Return row stride
+	return buf;
+}
@@ -0,0 +1,226 @@
+#ifndef _FONT_H_
+#define _FONT_H_
+
+#ifdef __cplusplus								// If we are including to a C++
+extern "C" {									// Put extern C directive wrapper around
+#endif
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++}
+{																			}
+{       Filename: font.h													}
+{       Copyright: Leon de Boer(LdB) 2020									}
+{       Version: 1.00														}
+{		Release under MIT license (https://opensource.org/licenses/MIT)     }
+{																			}
+{***************************************************************************}
+{                                                                           }
+{      Defines a runtime registry of fixed, packed and anti-aliased fonts	}
+{																            }
+{++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
+{  1.00 Initial version														}
+{++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#include <stdbool.h>							// C standard unit for bool, true, false
+#include <stdint.h>								// C standard unit for uint32_t etc
+
+#define FONT_DRIVER_VERSION 1000				// Version number 1.00 build 0
+
+#define MAX_FONTS ( 16 )						// Fonts the registry can hold
+#define FONT_INVALID ( 0xFF )					// Font id returned on any failure
+#define FONT_MAXWTH ( 64 )						// Widest glyph cell supported
+#define FONT_MAXHT ( 64 )						// Tallest font supported
+#define FONT_MAXCELLBYTES ( FONT_MAXWTH / 2 * FONT_MAXHT )	// Largest glyph cell (4bpp)
+#define FONT_PAGES ( 256 )						// Pages of 256 characters in sparse index (BMP)
+#define FONT_NOPAGE ( 0xFFFF )					// Sparse index page directory entry with no page
+#define FONT_NOGLYPH ( 0xFFFF )					// Sparse index page entry with no glyph
+
+/* The compiled in fonts are always registered with these ids */
+#define FONT8x16	( 0 )
+#define FONT8x8		( 1 )
+#define FONT6x8		( 2 )
+
+typedef enum {
+	FONT_FORMAT_FIXED = 0,						// Fixed width, byte aligned rows, fixed bytes per character
+	FONT_FORMAT_PACKED = 1,						// Variable width, bit packed rows with no padding
+	FONT_FORMAT_AA4 = 2,						// Variable width, 4 bit coverage anti-aliased glyphs
+} FONTFORMAT;
+
+/*--------------------------------------------------------------------------}
+{   Packed font glyph. The glyph bitmap is wth x ht bits starting at bit	}
+{   offset in the font bitmap (MSB first), each row directly following the	}
+{   last with no padding. It is drawn top rows down in a cell the height of	}
+{   the font and the pen then moves right by advance pixels.				}
+{   For FONT_FORMAT_AA4 fonts the bitmap is an atlas of 4 bit coverage		}
+{   (0 = background .. 15 = text colour), two pixels per byte high nibble	}
+{   first, each row (wth+1)/2 bytes, and offset is a byte offset.			}
+{--------------------------------------------------------------------------*/
+typedef struct font_glyph
+{
+	uint32_t offset;							// Bit (byte for AA4) offset of glyph in font bitmap
+	uint8_t wth;								// Glyph bitmap width in pixels
+	uint8_t ht;									// Glyph bitmap height in pixels
+	uint8_t top;								// Rows from top of cell to first glyph row
+	uint8_t advance;							// Pixels to move right after the glyph
+} FONTGLYPH;
+
+/*--------------------------------------------------------------------------}
+{   A registered font. Characters from firstchar to firstchar+numchars-1	}
+{   are in the font, any other character draws the defaultchar glyph.		}
+{   A sparse font instead has a two level index, pagedir holds FONT_PAGES	}
+{   entries giving the page for each block of 256 characters and each page	}
+{   holds 256 glyph indexes, so lookup is two loads whatever the font size.	}
+{--------------------------------------------------------------------------*/
+typedef struct font_desc
+{
+	uint8_t format;								// FONTFORMAT of the font data
+	uint8_t height;								// Height of the font cell in pixels
+	uint8_t fixedwth;							// FONT_FORMAT_FIXED glyph width in pixels
+	uint8_t _reserved;
+	uint16_t stride;							// FONT_FORMAT_FIXED bytes between characters
+	uint16_t firstchar;							// First character in font
+	uint16_t numchars;							// Number of characters in font
+	uint16_t defaultchar;						// Character drawn for characters not in font
+	uint16_t defaultglyph;						// Glyph index of defaultchar
+	const FONTGLYPH* glyphs;					// FONT_FORMAT_PACKED/AA4 glyph table
+	const uint16_t* pagedir;					// Sparse index page directory, NULL if not sparse
+	const uint16_t* pages;						// Sparse index pages of 256 glyph indexes
+	const uint8_t* bitmap;						// Font bitmap data
+} FONTDESC;
+
+/*--------------------------------------------------------------------------}
+{   Font file as written by tools/fontconv and mapped by Font_Load. The		}
+{   header is followed by numchars FONTGLYPH entries then bitmapsize bytes	}
+{   of packed glyph bitmap. All values are little endian as on the Pi.		}
+{   The magic gives the format, packed 1bpp or anti-aliased coverage.		}
+{   Version 2 files have numpages and when it is non zero the glyph table	}
+{   is followed by the FONT_PAGES page directory and numpages index pages	}
+{   of a sparse font. Version 1 headers end at numpages.					}
+{--------------------------------------------------------------------------*/
+#define FONTFILE_MAGIC "LdBF"					// Font file magic for FONT_FORMAT_PACKED
+#define FONTFILE_MAGIC_AA4 "LdBA"				// Font file magic for FONT_FORMAT_AA4
+#define FONTFILE_VERSION ( 2 )					// Newest font file version this unit reads
+
+typedef struct font_file_header
+{
+	char magic[4];								// FONTFILE_MAGIC
+	uint8_t version;							// FONTFILE_VERSION
+	uint8_t height;								// Height of the font cell in pixels
+	uint16_t defaultchar;						// Character drawn for characters not in font
+	uint16_t firstchar;							// First character in font
+	uint16_t numchars;							// Number of glyphs that follow header
+	uint32_t bitmapsize;						// Bytes of packed bitmap after glyph table
+	uint16_t numpages;							// Version 2: sparse index pages, 0 if not sparse
+	uint8_t _reserved[6];						// Keeps glyph table 8 byte aligned
+} FONTFILEHEADER;
+
+/*-[ Font_RegisterFixed ]---------------------------------------------------}
+. Registers a fixed width font in the format of the compiled in fonts, each
+. character is stride bytes, rows are (wth+7)/8 bytes MSB first.
+. RETURN: font id for success, FONT_INVALID for any failure
+.--------------------------------------------------------------------------*/
+uint8_t Font_RegisterFixed (const uint8_t* data, uint8_t wth, uint8_t ht, uint16_t stride, uint16_t firstchar, uint16_t numchars);
+
+/*-[ Font_RegisterPacked ]--------------------------------------------------}
+. Registers a packed variable width font of numchars glyphs starting from
+. firstchar. The glyph table and bitmap must stay valid while registered.
+. RETURN: font id for success, FONT_INVALID for any failure
+.--------------------------------------------------------------------------*/
+uint8_t Font_RegisterPacked (uint8_t height, uint16_t firstchar, uint16_t numchars, const FONTGLYPH* glyphs, const uint8_t* bitmap);
+
+/*-[ Font_RegisterAA ]------------------------------------------------------}
+. Registers an anti-aliased font of numchars glyphs starting from firstchar
+. whose bitmap is an atlas of 4 bit coverage glyphs. The glyph table and
+. bitmap must stay valid while registered.
+. RETURN: font id for success, FONT_INVALID for any failure
+.--------------------------------------------------------------------------*/
+uint8_t Font_RegisterAA (uint8_t height, uint16_t firstchar, uint16_t numchars, const FONTGLYPH* glyphs, const uint8_t* bitmap);
+
+/*-[ Font_RegisterSparse ]--------------------------------------------------}
+. Registers a packed or anti-aliased font of numglyphs glyphs found through
+. a two level sparse index (see FONTDESC) so it can hold any set of BMP
+. characters. The tables and bitmap must stay valid while registered.
+. RETURN: font id for success, FONT_INVALID for any failure
+.--------------------------------------------------------------------------*/
+uint8_t Font_RegisterSparse (FONTFORMAT format, uint8_t height, uint16_t defaultchar, uint16_t numglyphs, const FONTGLYPH* glyphs, const uint8_t* bitmap, const uint16_t* pagedir, const uint16_t* pages);
+
+/*-[ Font_Unregister ]------------------------------------------------------}
+. Removes a registered font, the compiled in fonts can not be removed and
+. fonts loaded from file use Font_Unload. No device context may still have
+. the font selected.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Font_Unregister (uint8_t fontid);
+
+/*-[ Font_Load ]------------------------------------------------------------}
+. Maps a font file written by tools/fontconv read only and registers it. The
+. glyph pages fault in as they are first drawn and are shared through the
+. page cache with every other process using the same font file.
+. RETURN: font id for success, FONT_INVALID for any failure
+.--------------------------------------------------------------------------*/
+uint8_t Font_Load (const char* filename);
+
+/*-[ Font_Unload ]----------------------------------------------------------}
+. Unregisters a font loaded by Font_Load and unmaps the file. No device
+. context may still have the font selected.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Font_Unload (uint8_t fontid);
+
+/*-[ Font_Get ]-------------------------------------------------------------}
+. RETURN: the registered font for the id, NULL if no such font
+.--------------------------------------------------------------------------*/
+const FONTDESC* Font_Get (uint8_t fontid);
+
+/*-[ Font_Generation ]------------------------------------------------------}
+. RETURN: a count that changes whenever a font is unregistered, so anything
+. caching glyphs by font id knows to discard them.
+.--------------------------------------------------------------------------*/
+uint32_t Font_Generation (void);
+
+/*-[ Font_DecodeUTF8 ]------------------------------------------------------}
+. Decodes the next character of a UTF-8 string and moves the pointer past
+. it. A byte that does not start a valid sequence decodes as itself, so 8
+. bit text written for the compiled in fonts still draws the same glyphs.
+. RETURN: the character code, 0 at the end of the string
+.--------------------------------------------------------------------------*/
+uint32_t Font_DecodeUTF8 (const char** txt);
+
+/*-[ Font_GlyphIndexSparse ]------------------------------------------------}
+. Looks the character up through the sparse page index of the font.
+. RETURN: the glyph index of the character, default glyph if not in font
+.--------------------------------------------------------------------------*/
+uint16_t Font_GlyphIndexSparse (const FONTDESC* font, uint32_t ch);
+
+/*-[ Font_GlyphIndex ]------------------------------------------------------}
+. Inline so text in a contiguous font pays no call per character, sparse
+. fonts go on to Font_GlyphIndexSparse.
+. RETURN: the glyph index of the character, default glyph if not in font
+.--------------------------------------------------------------------------*/
+static inline uint16_t Font_GlyphIndex (const FONTDESC* font, uint32_t ch)
+{
+	if (font->pagedir) return Font_GlyphIndexSparse(font, ch);		// Sparse font
+	uint32_t glyph = ch - font->firstchar;							// Wraps large if below first character
+	return (glyph < font->numchars) ? glyph : font->defaultglyph;
+}
+
+/*-[ Font_GlyphWidth ]------------------------------------------------------}
+. RETURN: the width in pixels of the glyph cell which is also the advance.
+. It is always even as the screen packs two pixels per byte.
+.--------------------------------------------------------------------------*/
+uint16_t Font_GlyphWidth (const FONTDESC* font, uint16_t glyph);
+
+/*-[ Font_GlyphBits ]-------------------------------------------------------}
+. Fetches the glyph cell (Font_GlyphWidth x height) as 1bpp rows MSB first,
+. or for FONT_FORMAT_AA4 fonts as 4 bit coverage rows. Fixed fonts and AA
+. glyphs that fill their cell return a pointer into the font data, others
+. are unpacked into buf which must hold FONT_MAXCELLBYTES. The row stride is
+. put in stride.
+. RETURN: pointer to the glyph rows, NULL for any failure
+.--------------------------------------------------------------------------*/
+const uint8_t* Font_GlyphBits (const FONTDESC* font, uint16_t glyph, uint8_t* buf, uint16_t* stride);
+
+#ifdef __cplusplus								// If we are including to a C++ file
+}												// Close the extern C directive wrapper
+#endif
+
+#endif
@@ -8,7 +8,7 @@ extern "C" {									// Put extern C directive wrapper around
 #include <stdbool.h>							// C standard unit for bool, true, false
 #include <stdint.h>								// C standard unit for uint32_t etc
 
-const uint8_t font_8x16_data[256 * 16] = {
+static const uint8_t font_8x16_data[256 * 16] = {
 	/* 0 0x00 '^@' */
 	0x00, /* 00000000 */
 	0x00, /* 00000000 */
@@ -3,82 +3,62 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <stdio.h>
-#include <pthread.h>
+#include <sys/epoll.h> // Needed for EPOLLIN
 #include <linux/spi/spidev.h> // Needed for SPI_MODE_3
 
 #include <time.h>
-#include <semaphore.h> // need to share access to screen
 
 #include "gpio.h"
 #include "spi.h"
 #include "ssd1327.h"
+#include "eventloop.h" // widgets run as timers on one event loop thread
 
 
-static sem_t lock;
+static EVLOOP_HANDLE loop = 0;
 
-static void* ticktask  (void* param)
+struct widget {
+	HDC Dc;		// DC of the widget
+	uint16_t i;	// Count or bar length
+	int dir;	// Bar direction
+};
+
+static void ticktimer (HEVENT ev, void* arg, uint32_t count)
 {
-	char buf[17];
-	HDC Dc = GetDC();		  // Fetch DC for this task
-	SelectFont(Dc, FONT8x8);  // Small font for time
-	while (1)
-	{
-        time_t t = time(NULL);
-		struct tm* tm = localtime(&t);
-		sprintf(buf, "Time: %02u:%02u:%02u", tm->tm_hour, tm->tm_min, tm->tm_sec);
-		sem_wait(&lock);
-		SSD1327_WriteText(Dc, 0, 40, &buf[0]);
-		sem_post(&lock);
-		sleep(1);
-	}
-	ReleaseDC(Dc);
-	return 0;
+	HDC Dc = arg;
+	time_t t = time(NULL);
+	struct tm* tm = localtime(&t);
+	DrawNumber(Dc, 48, 40, tm->tm_hour, 2, DN_ZEROPAD);
+	DrawNumber(Dc, 72, 40, tm->tm_min, 2, DN_ZEROPAD);
+	DrawNumber(Dc, 96, 40, tm->tm_sec, 2, DN_ZEROPAD);
 }
 
-static void* counttask (void* param)
+static void counttimer (HEVENT ev, void* arg, uint32_t count)
 {
-	char buf[17];
-	HDC Dc = GetDC();	// Fetch DC for this task
-	uint16_t i = 0;
-	while (1)
-	{
-		sprintf(buf, "i=%05u", i);
-		sem_wait(&lock);
-		SSD1327_WriteText(Dc, 0, 72, &buf[0]);
-		sem_post(&lock);
-		usleep(111111); 
-		i++;
-	}
-	ReleaseDC(Dc);
-	return 0;
+	struct widget* w = arg;
+	DrawNumber(w->Dc, 16, 72, w->i, 5, DN_ZEROPAD);
+	w->i += count;  // Ticks missed still count
 }
 
-static void* bartask(void* param)
+static void bartimer (HEVENT ev, void* arg, uint32_t count)
 {
-	HDC Dc = GetDC();	// Fetch DC for this task
-	int dir = 1;
-	uint16_t i = 2;
-	while (1)
-	{
-		SetDCBrushColor(Dc, 4);
-		sem_wait(&lock);
-		Rectangle(Dc, 0, 96, i, 110);
-		sem_post(&lock);
-		SetDCBrushColor(Dc, 0);
-		sem_wait(&lock);
-		Rectangle(Dc, i, 96, 128, 110);
-		sem_post(&lock);
-		usleep(33333);
-		i = i + 2*dir;
-		if (i == 126 || i == 2) dir = -dir;
-	}
-	ReleaseDC(Dc);
-	return 0;
+	struct widget* w = arg;
+	SetDCBrushColor(w->Dc, 4);
+	Rectangle(w->Dc, 0, 96, w->i, 110);
+	SetDCBrushColor(w->Dc, 0);
+	Rectangle(w->Dc, w->i, 96, 128, 110);
+	w->i = w->i + 2*w->dir;
+	if (w->i == 126 || w->i == 2) w->dir = -w->dir;
+}
+
+static void keypress (HEVENT ev, void* arg, uint32_t events)
+{
+	EventLoop_Quit(loop);
 }
 
 
 static GPIO_HANDLE gpio = 0;
 static SPI_HANDLE spi = 0;
+static SSD1327_HANDLE panel = 0;
 
 int main (void) 
 {
@@ -106,36 +86,50 @@ int main (void)
 	usleep(100000);													// sleep for 100mS (RESET LOW = 100ms)
 	GPIO_Output(gpio, 25, 1);										// SSD1327 reset back high
 	usleep(100000);													// sleep for 100mS  (RESET HIGH = 100ms)
-	if (SSD1327_Open(spi, gpio, 24) == false)						// Open the SSD1327 which sends initialize string
+	panel = SSD1327_Open(spi, gpio, 24);							// Open the SSD1327 which sends initialize string
+	if (panel == 0)
     {
 		fprintf(stderr, "SSD1327 device could not open\n");
 		return 1;
 	}
 	usleep(200000);													// sleep for 200mS  (After initialize cmds sent)
-	SSD1327_ScreenOnOff(1);											// Set screen on
+	SSD1327_ScreenOnOff(panel, 1);									// Set screen on
 
-	SSD1327_ClearScreen(0);
+	SSD1327_ClearScreen(panel, 0);
 
-	HDC Dc = GetDC();
+	HDC Dc = GetDC(panel);
 	SelectFont(Dc, FONT6x8);
 	SSD1327_WriteText(Dc, 0, 0, "HELLO WORLD IN 6x8");
 	SSD1327_WriteText(Dc, 0, 128-8, "BOTTOM LINE IN 6x8");
         
-	sem_init(&lock, 0, 1);
+	loop = EventLoop_Create();										// All widgets run on this thread
+	if (loop == 0 || EventLoop_SetFrameRate(loop, panel, 30) == false)// One flush per frame whatever the widgets do
+	{
+		fprintf(stderr, "Event loop could not start\n");
+		return 1;
+	}
 
-	pthread_t taskhandle[3];
-	pthread_create(&taskhandle[0], NULL, ticktask, NULL);
-	pthread_create(&taskhandle[1], NULL, counttask, NULL);
-	pthread_create(&taskhandle[2], NULL, bartask, NULL);
+	HDC tickDc = GetDC(panel);
+	SelectFont(tickDc, FONT8x8);									// Small font for time
+	SSD1327_WriteText(tickDc, 0, 40, "Time:   :  :");				// Fixed text drawn once
+	EventLoop_AddTimer(loop, 0, 1000000, ticktimer, tickDc);
 
-	getchar();														// Wait of a keypress
+	struct widget count = { GetDC(panel), 0, 1 };
+	SSD1327_WriteText(count.Dc, 0, 72, "i=");						// Fixed text drawn once
+	EventLoop_AddTimer(loop, 0, 111111, counttimer, &count);
 
-	for (int i = 0; i < 3; i++)
-		pthread_cancel(taskhandle[i]);
-	for (int i = 0; i < 3; i++)
-		pthread_join(taskhandle[i], NULL);
+	struct widget bar = { GetDC(panel), 2, 1 };
+	EventLoop_AddTimer(loop, 0, 33333, bartimer, &bar);
 
-	sem_destroy(&lock);
+	EventLoop_AddFd(loop, STDIN_FILENO, EPOLLIN, keypress, 0);		// Wait of a keypress
+	EventLoop_Run(loop);
+
+	EventLoop_Destroy(loop);										// Sends the last frame
+	ReleaseDC(bar.Dc);
+	ReleaseDC(count.Dc);
+	ReleaseDC(tickDc);
+	ReleaseDC(Dc);
+	SSD1327_Close(panel);
     SpiClosePort(spi);
 	return (0);														// Exit program wioth no error
 }
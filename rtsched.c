@@ -0,0 +1,115 @@
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++}
+{																			}
+{       Filename: rtsched.c													}
+{       Copyright(c): Leon de Boer(LdB) 2020								}
+{       Version: 1.00														}
+{		Release under MIT license (https://opensource.org/licenses/MIT)     }
+{																			}
+{***************************************************************************}
+{                                                                           }
+{      Defines real time thread set up (SCHED_FIFO priority, CPU affinity	}
+{      and locked memory) and a histogram of frame start jitter with		}
+{      percentiles, for threads that must flush on time under load.		}
+{																            }
+{++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
+{  1.00 Initial version														}
+{++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+#define _GNU_SOURCE								// Needed for CPU_SET and pthread_attr_setaffinity_np
+#include <stdbool.h>							// C standard unit for bool, true, false
+#include <stdint.h>								// C standard unit for uint32_t etc
+#include <string.h>								// C standard unit needed for memset
+#include <pthread.h>							// Threads are set up through pthread attributes
+#include <sched.h>								// SCHED_FIFO and cpu sets
+#include <sys/mman.h>							// Needed for mlockall
+#include "rtsched.h"							// This units header
+
+#if RTSCHED_DRIVER_VERSION != 1000
+#error "Header does not match this version of file"
+#endif
+
+/*-[ RT_ThreadAttr ]--------------------------------------------------------}
+. Initializes thread attributes for SCHED_FIFO at priority 1 to 99, 0 for
+. the normal scheduler, and to run only on cpu, -1 for any cpu.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool RT_ThreadAttr (pthread_attr_t* attr, uint8_t priority, int16_t cpu)
+{
+	if (attr == 0 || priority > 99 || cpu >= CPU_SETSIZE) return false;
+	if (pthread_attr_init(attr) != 0) return false;
+	bool ok = true;
+	if (priority)													// Real time, not inherited from creator
+	{
+		struct sched_param sp = { .sched_priority = priority };
+		ok = (pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED) == 0
+			&& pthread_attr_setschedpolicy(attr, SCHED_FIFO) == 0
+			&& pthread_attr_setschedparam(attr, &sp) == 0);
+	}
+	if (ok && cpu >= 0)												// Pinned to one cpu
+	{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		ok = (pthread_attr_setaffinity_np(attr, sizeof(set), &set) == 0);
+	}
+	if (!ok) pthread_attr_destroy(attr);
+	return ok;
+}
+
+/*-[ RT_LockMemory ]--------------------------------------------------------}
+. Locks all memory of the process now and in future so a real time thread
+. never waits on a page fault. Needs CAP_IPC_LOCK or a big enough limit.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool RT_LockMemory (void)
+{
+	return (mlockall(MCL_CURRENT | MCL_FUTURE) == 0);
+}
+
+/*-[ Jitter_Reset ]---------------------------------------------------------}
+. Empties the histogram.
+.--------------------------------------------------------------------------*/
+void Jitter_Reset (JITTER* j)
+{
+	if (j) memset(j, 0, sizeof(JITTER));
+}
+
+/*-[ Jitter_Add ]-----------------------------------------------------------}
+. Adds a frame that started late_us after its ideal time, with missed
+. frames skipped before it.
+.--------------------------------------------------------------------------*/
+void Jitter_Add (JITTER* j, uint32_t late_us, uint32_t missed)
+{
+	if (j == 0) return;
+	uint32_t b = late_us / JITTER_US;
+	if (b >= JITTER_BUCKETS) b = JITTER_BUCKETS - 1;				// Later than the histogram
+	__atomic_fetch_add(&j->hist[b], 1, __ATOMIC_RELAXED);			// Atomic only so readers see whole values
+	if (missed) __atomic_fetch_add(&j->missed, missed, __ATOMIC_RELAXED);
+	if (late_us > j->max) __atomic_store_n(&j->max, late_us, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&j->frames, 1, __ATOMIC_RELAXED);
+}
+
+/*-[ Jitter_Stats ]---------------------------------------------------------}
+. Works out the percentiles of the histogram.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Jitter_Stats (const JITTER* j, JITTER_STATS* stats)
+{
+	static const uint16_t permille[4] = { 500, 900, 990, 999 };
+	if (j == 0 || stats == 0) return false;
+	uint32_t* p[4] = { &stats->p50, &stats->p90, &stats->p99, &stats->p999 };
+	uint64_t total = 0, seen = 0;
+	for (uint32_t b = 0; b < JITTER_BUCKETS; b++)
+		total += __atomic_load_n(&j->hist[b], __ATOMIC_RELAXED);
+	stats->frames = (uint32_t)total;								// Frames in this snapshot
+	stats->missed = __atomic_load_n(&j->missed, __ATOMIC_RELAXED);
+	stats->max = __atomic_load_n(&j->max, __ATOMIC_RELAXED);
+	uint16_t k = 0;
+	for (uint32_t b = 0; b < JITTER_BUCKETS && k < 4; b++)
+	{
+		seen += __atomic_load_n(&j->hist[b], __ATOMIC_RELAXED);
+		while (k < 4 && total && seen * 1000 >= total * permille[k])// Percentile falls in this bucket
+			*p[k++] = (b == JITTER_BUCKETS - 1) ? stats->max : (b + 1) * JITTER_US;
+	}
+	while (k < 4) *p[k++] = 0;										// No frames
+	return true;
+}
@@ -0,0 +1,97 @@
+#ifndef _RTSCHED_H_
+#define _RTSCHED_H_
+
+#ifdef __cplusplus								// If we are including to a C++
+extern "C" {									// Put extern C directive wrapper around
+#endif
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++}
+{																			}
+{       Filename: rtsched.h													}
+{       Copyright: Leon de Boer(LdB) 2020									}
+{       Version: 1.00														}
+{		Release under MIT license (https://opensource.org/licenses/MIT)     }
+{																			}
+{***************************************************************************}
+{                                                                           }
+{      Defines real time thread set up (SCHED_FIFO priority, CPU affinity	}
+{      and locked memory) and a histogram of frame start jitter with		}
+{      percentiles, for threads that must flush on time under load.		}
+{																            }
+{++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
+{  1.00 Initial version														}
+{++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#include <stdbool.h>							// C standard unit for bool, true, false
+#include <stdint.h>								// C standard unit for uint32_t etc
+#include <pthread.h>							// Threads are set up through pthread attributes
+
+#define RTSCHED_DRIVER_VERSION 1000				// Version number 1.00 build 0
+
+#define JITTER_US ( 5 )							// Microseconds per histogram bucket
+#define JITTER_BUCKETS ( 2048 )					// Buckets, the last holds everything later
+
+/*--------------------------------------------------------------------------}
+{   Frame start jitter is how late each frame started against its ideal	}
+{   time. Frames skipped because the one before ran into them are counted	}
+{   as missed. Only one thread may add, any thread may read.				}
+{--------------------------------------------------------------------------*/
+typedef struct jitter
+{
+	uint32_t frames;							// Frames added
+	uint32_t missed;							// Frames skipped as the thread was too late
+	uint32_t max;								// Latest start in us
+	uint32_t hist[JITTER_BUCKETS];				// Frames by lateness
+} JITTER;
+
+/*--------------------------------------------------------------------------}
+{   Percentiles of a JITTER in microseconds, each is the upper edge of the	}
+{   bucket so it is never lower than the real value.						}
+{--------------------------------------------------------------------------*/
+typedef struct jitter_stats
+{
+	uint32_t frames;							// Frames added
+	uint32_t missed;							// Frames skipped
+	uint32_t p50;								// Median lateness
+	uint32_t p90;
+	uint32_t p99;
+	uint32_t p999;
+	uint32_t max;								// Latest start
+} JITTER_STATS;
+
+/*-[ RT_ThreadAttr ]--------------------------------------------------------}
+. Initializes thread attributes for SCHED_FIFO at priority 1 to 99, 0 for
+. the normal scheduler, and to run only on cpu, -1 for any cpu.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool RT_ThreadAttr (pthread_attr_t* attr, uint8_t priority, int16_t cpu);
+
+/*-[ RT_LockMemory ]--------------------------------------------------------}
+. Locks all memory of the process now and in future so a real time thread
+. never waits on a page fault. Needs CAP_IPC_LOCK or a big enough limit.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool RT_LockMemory (void);
+
+/*-[ Jitter_Reset ]---------------------------------------------------------}
+. Empties the histogram.
+.--------------------------------------------------------------------------*/
+void Jitter_Reset (JITTER* j);
+
+/*-[ Jitter_Add ]-----------------------------------------------------------}
+. Adds a frame that started late_us after its ideal time, with missed
+. frames skipped before it.
+.--------------------------------------------------------------------------*/
+void Jitter_Add (JITTER* j, uint32_t late_us, uint32_t missed);
+
+/*-[ Jitter_Stats ]---------------------------------------------------------}
+. Works out the percentiles of the histogram.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Jitter_Stats (const JITTER* j, JITTER_STATS* stats);
+
+#ifdef __cplusplus								// If we are including to a C++ file
+}												// Close the extern C directive wrapper
+#endif
+
+#endif
@@ -2,7 +2,7 @@
 {																			}
 {       Filename: spi.c														}
 {       Copyright(c): Leon de Boer(LdB) 2019, 2020							}
-{       Version: 1.10														}
+{       Version: 1.20														}
 {		Release under MIT license (https://opensource.org/licenses/MIT)     }
 {																			}
 {***************************************************************************}
@@ -12,6 +12,7 @@
 {++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
 {  1.00 Initial version														}
 {  1.10 Compacted stuct fields  											}
+{  1.20 Any bus.cs pair can be opened										}
 {++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 #include <stdbool.h>			// C standard unit for bool, true, false
@@ -25,7 +26,7 @@
 #include <semaphore.h>			// Linux Semaphore unit
 #include "spi.h"				// This units header
 
-#if SPI_DRIVER_VERSION != 1100
+#if SPI_DRIVER_VERSION != 1200
 #error "Header does not match this version of file"
 #endif
 
@@ -42,10 +43,10 @@ struct spi_device
 	uint32_t spi_speed;							// SPI speed
 	uint16_t mode;								// SPI mode bits
     sem_t lock;									// Semaphore for lock
+	uint8_t spi_num;							// SPI device number, bus in top nibble, cs in bottom
 	struct {
         uint16_t spi_bitsPerWord: 8;			// SPI bits per word
-        uint16_t spi_num : 4;					// SPI device table number
-        uint16_t _reserved: 1;        			// reserved
+        uint16_t _reserved: 5;        			// reserved
 		uint16_t uselocks : 1;					// Locks to be used for access
 		uint16_t initializing : 1;				// SPI is initializing settings
 		uint16_t inuse : 1;						// In use flag
@@ -56,15 +57,22 @@ struct spi_device
 static struct spi_device spitab[NSPI] = { {0} };
 
 /*-[ SpiOpenPort ]----------------------------------------------------------}
-. Creates a SPI handle which provides access to the SPI device number.
-. The SPI device is setup to the bits, speed and mode provided.
+. Creates a SPI handle which provides access to the SPI device number,
+. made by SPI_DEVICE(bus, cs) for any bus. The SPI device is setup to the
+. bits, speed and mode provided.
 . RETURN: valid SPI_HANDLE for success, NULL for any failure
 .--------------------------------------------------------------------------*/
 SPI_HANDLE SpiOpenPort (uint8_t spi_devicenum, uint8_t bit_exchange_size, uint32_t speed, uint8_t mode, bool useLock)
 {
 	SPI_HANDLE spi = 0;												// Preset null handle
-	struct spi_device* spi_ptr = &spitab[spi_devicenum];			// SPI device pointer 
-	if (spi_devicenum < NSPI && spi_ptr->inuse == 0 && speed != 0)
+	struct spi_device* spi_ptr = 0;									// SPI device pointer
+	for (int i = 0; i < NSPI; i++)
+	{
+		if (spitab[i].inuse && spitab[i].spi_num == spi_devicenum)
+			return 0;												// Device is already open
+		if (spitab[i].inuse == 0 && spi_ptr == 0) spi_ptr = &spitab[i];// First free table entry
+	}
+	if (spi_ptr && speed != 0)
 	{
 		spi_ptr->spi_fd = 0;										// Zero SPI file device
 		spi_ptr->spi_num = spi_devicenum;							// Hold spi device number
@@ -74,7 +82,7 @@ SPI_HANDLE SpiOpenPort (uint8_t spi_devicenum, uint8_t bit_exchange_size, uint32
 			sem_init(&spi_ptr->lock, 0, 1);							// Initialize mutex to 1
         }
         char buf[256] = { 0 };
-		sprintf(&buf[0], "/dev/spidev0.%c", (char)(0x30 + spi_devicenum));
+		sprintf(&buf[0], "/dev/spidev%u.%u", spi_devicenum >> 4, spi_devicenum & 0x0F);
 		int fd = open(&buf[0], O_RDWR);								// Open the SPI device
 		if (fd >= 0)												// SPI device opened correctly
 		{
@@ -116,6 +124,17 @@ bool SpiClosePort (SPI_HANDLE spiHandle)
 	return false;													// Return failure
 }
 
+/*-[ SpiGetBus ]------------------------------------------------------------}
+. Given a valid SPI handle returns the bus it is on, handles on the same
+. bus share one controller and can not transfer at the same time.
+. RETURN: bus number for success, 0xFF for any failure
+.--------------------------------------------------------------------------*/
+uint8_t SpiGetBus (SPI_HANDLE spiHandle)
+{
+	if (spiHandle && spiHandle->inuse) return (spiHandle->spi_num >> 4);
+	return 0xFF;													// Return failure
+}
+
 #define all_mode_bits  (SPI_MODE_0 | SPI_MODE_1 | SPI_MODE_2 | SPI_MODE_3 )
 /*-[ SpiSetMode ]-----------------------------------------------------------}
 . Given a valid SPI handle sets the SPI mode to that given.
@@ -187,7 +206,7 @@ bool SpiSetChipSelect (SPI_HANDLE spiHandle, SPIChipSelect CS_Mode)
 	return false;													// Return failure
 }
 
-/*-[ SpiSetBitOrder ]-----------------------------------------------------}
+/*-[ SpiSetBitOrder ]-------------------------------------------------------}
 . Given a valid SPI handle sets the SPI bit order(LSB/MSB) to that given.
 . RETURN: true for success, false for any failure
 .--------------------------------------------------------------------------*/
@@ -324,3 +343,60 @@ bool SpiWriteBlockRepeat (SPI_HANDLE spiHandle, uint8_t* TxBlock, uint16_t TxBlo
 	}
 	return false;													// Return failure
 }
+
+/*-[ SpiWriteRows ]---------------------------------------------------------}
+. Given a valid SPI handle sends Rows rows of RowLen bytes that lie Stride
+. bytes apart starting at TxData, as if they were one block. Each row is a
+. transfer of its own within as few messages as possible so rows of an
+. image in memory go out with no copy into a buffer.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool SpiWriteRows (SPI_HANDLE spiHandle, const uint8_t* TxData, uint16_t RowLen, uint16_t Stride, uint16_t Rows, bool LeaveCsLow)
+{
+	if (spiHandle && spiHandle->inuse && TxData && RowLen > 0)		// SPI handle and TxData valid and SPI handle is in use
+	{
+		if (RowLen == Stride)										// Rows are contiguous so one block
+			return SpiWriteAndRead(spiHandle, (uint8_t*)TxData, 0, RowLen * Rows, LeaveCsLow);
+		int retVal = 0;												// Preset success for no rows
+		struct spi_ioc_transfer spi[64] = { { 0 } };				// Transfers of one message
+		unsigned int n = 0, bytes = 0;								// Transfers and bytes in message
+		if (spiHandle->uselocks)									// Using locks
+		{
+			sem_wait(&spiHandle->lock);								// Take semaphore
+		}
+		for (uint16_t j = 0; j < Rows && retVal >= 0; j++)			// For each row
+		{
+			const uint8_t* p = TxData + (uint32_t)j * Stride;		// Start of row
+			uint16_t left = RowLen;
+			while (left > 0 && retVal >= 0)
+			{
+				uint16_t count = left;
+				if (count > 4096 - bytes) count = 4096 - bytes;		// Message is at most 4096 in total
+				spi[n].tx_buf = (unsigned long)p;					// Transmit straight from row
+				spi[n].rx_buf = (unsigned long)0;					// Receive nothing
+				spi[n].len = count;									// Length of data to tx
+				spi[n].speed_hz = spiHandle->spi_speed;				// Speed for transfer
+				spi[n].bits_per_word = spiHandle->spi_bitsPerWord;	// Bits per exchange
+				spi[n].cs_change = 0;								// CS stays low between rows
+				p += count;
+				left -= count;
+				bytes += count;
+				n++;
+				bool last = (j == Rows - 1 && left == 0);			// Final transfer of all rows
+				if (last || n == 64 || bytes == 4096)				// Message full or done so send it
+				{
+					spi[n - 1].cs_change = LeaveCsLow;				// 0=Set CS high after a message, 1=leave CS set low
+					retVal = ioctl(spiHandle->spi_fd, SPI_IOC_MESSAGE(n), &spi[0]);// Execute exchange
+					n = 0;
+					bytes = 0;
+				}
+			}
+		}
+		if (spiHandle->uselocks)									// Using locks
+		{
+			sem_post(&spiHandle->lock);								// Give semaphore
+		}
+		if (retVal >= 0) return true;								// Return sucess
+	}
+	return false;													// Return failure
+}
@@ -9,7 +9,7 @@ extern "C" {									// Put extern C directive wrapper around
 {																			}
 {       Filename: spi.h														}
 {       Copyright: Leon de Boer(LdB) 2019, 2020		    					}
-{       Version: 1.10														}
+{       Version: 1.20														}
 {		Release under MIT license (https://opensource.org/licenses/MIT)     }
 {																			}
 {***************************************************************************}
@@ -19,12 +19,13 @@ extern "C" {									// Put extern C directive wrapper around
 {++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
 {  1.00 Initial version														}
 {  1.10 Compacted stuct fields  											}
+{  1.20 Any bus.cs pair can be opened										}
 {++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 #include <stdbool.h>							// C standard unit for bool, true, false
 #include <stdint.h>								// C standard unit for uint32_t etc
 
-#define SPI_DRIVER_VERSION 1100					// Version number 1.10 build 0
+#define SPI_DRIVER_VERSION 1200					// Version number 1.20 build 0
 
 typedef enum {
    SPI_CS_Mode_LOW = 0,             /*!< Chip Select 0 */
@@ -40,12 +41,20 @@ typedef enum
 
 typedef struct spi_device* SPI_HANDLE;			// Define an SPI_HANDLE pointer to opaque internal struct
 
-#define NSPI 2									// 2 SPI devices supported
+#define NSPI 8									// 8 SPI devices can be open at once
+
+/*--------------------------------------------------------------------------}
+{   SPI device number of /dev/spidevB.C, 0 and 1 stay /dev/spidev0.0 and	}
+{   /dev/spidev0.1. Each bus (SPI0, SPI1 and the Pi 4 SPI3 to SPI6) is its	}
+{   own controller so transfers on different buses run at the same time.	}
+{--------------------------------------------------------------------------*/
+#define SPI_DEVICE(bus, cs) ((uint8_t)(((bus) << 4) | ((cs) & 0x0F)))
 
 
 /*-[ SpiOpenPort ]----------------------------------------------------------}
-. Creates a SPI handle which provides access to the SPI device number.
-. The SPI device is setup to the bits, speed and mode provided.
+. Creates a SPI handle which provides access to the SPI device number,
+. made by SPI_DEVICE(bus, cs) for any bus. The SPI device is setup to the
+. bits, speed and mode provided.
 . RETURN: valid SPI_HANDLE for success, NULL for any failure
 .--------------------------------------------------------------------------*/
 SPI_HANDLE SpiOpenPort (uint8_t spi_devicenum, uint8_t bit_exchange_size, uint32_t speed, uint8_t mode, bool useLock);
@@ -56,6 +65,13 @@ SPI_HANDLE SpiOpenPort (uint8_t spi_devicenum, uint8_t bit_exchange_size, uint32
 .--------------------------------------------------------------------------*/
 bool SpiClosePort (SPI_HANDLE spiHandle);
 
+/*-[ SpiGetBus ]------------------------------------------------------------}
+. Given a valid SPI handle returns the bus it is on, handles on the same
+. bus share one controller and can not transfer at the same time.
+. RETURN: bus number for success, 0xFF for any failure
+.--------------------------------------------------------------------------*/
+uint8_t SpiGetBus (SPI_HANDLE spiHandle);
+
 /*-[ SpiSetMode ]-----------------------------------------------------------}
 . Given a valid SPI handle sets the SPI mode to that given.
 . RETURN: true for success, false for any failure
@@ -74,7 +90,7 @@ bool SpiSetSpeed (SPI_HANDLE spiHandle, uint32_t speed);
 .--------------------------------------------------------------------------*/
 bool SpiSetChipSelect (SPI_HANDLE spiHandle, SPIChipSelect CS_Mode);
 
-/*-[ SpiSetBitOrder ]-----------------------------------------------------}
+/*-[ SpiSetBitOrder ]-------------------------------------------------------}
 . Given a valid SPI handle sets the SPI bit order(LSB/MSB) to that given.
 . RETURN: true for success, false for any failure
 .--------------------------------------------------------------------------*/
@@ -103,6 +119,15 @@ bool SpiWriteAndRead (SPI_HANDLE spiHandle, uint8_t* TxData, uint8_t* RxData, ui
 .--------------------------------------------------------------------------*/
 bool SpiWriteBlockRepeat (SPI_HANDLE spiHandle, uint8_t* TxBlock, uint16_t TxBlockLen, uint32_t Repeats, bool LeaveCsLow);
 
+/*-[ SpiWriteRows ]---------------------------------------------------------}
+. Given a valid SPI handle sends Rows rows of RowLen bytes that lie Stride
+. bytes apart starting at TxData, as if they were one block. Each row is a
+. transfer of its own within as few messages as possible so rows of an
+. image in memory go out with no copy into a buffer.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool SpiWriteRows (SPI_HANDLE spiHandle, const uint8_t* TxData, uint16_t RowLen, uint16_t Stride, uint16_t Rows, bool LeaveCsLow);
+
 #ifdef __cplusplus								// If we are including to a C++ file
 }												// Close the extern C directive wrapper
 #endif
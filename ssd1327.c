@@ -2,7 +2,7 @@
 {																			}
 {       Filename: ssd1327.c													}
 {       Copyright(c): Leon de Boer(LdB) 2020								}
-{       Version: 1.10														}
+{       Version: 1.20														}
 {		Release under MIT license (https://opensource.org/licenses/MIT)     }
 {																			}
 {***************************************************************************}
@@ -12,19 +12,21 @@
 {++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
 {  1.00 Initial version														}
 {  1.10 Added device context and more primitives							}
+{  1.20 Several devices open at once, each DC bound to its device			}
 {++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
-
+#define _POSIX_C_SOURCE 200809L				// Needed for pthread_barrier_t under -std=c11
 #include <stdbool.h>							// C standard unit for bool, true, false
 #include <stdint.h>								// C standard unit for uint32_t etc
+#include <stdlib.h>								// C standard unit needed for calloc, aligned_alloc, free
 #include <string.h>								// C standard unit needed for memset
+#include <pthread.h>							// Flush group workers and barriers
 #include "spi.h"								// SPI device unit as we will be using SPI
 #include "gpio.h"								// We need access to GPIO to resetup reset pin
-#include "font8x16.h"							// Font 16x8 bitmap data
-#include "font8x8.h"							// Font 8x8 bitmap data
-#include "font6x8.h"							// Font 6x8 bitmap data
+#include "expand.h"								// 1bpp to 4bpp expansion kernels
+#include "font.h"								// Font registry
 #include "ssd1327.h"							// This units header
 
-#if SSD1327_DRIVER_VERSION != 1100
+#if SSD1327_DRIVER_VERSION != 1200
 #error "Header does not match this version of file"
 #endif
 
@@ -52,12 +54,11 @@ static const uint8_t ssd1327_init[34] =
 static uint8_t ssd1327_on = 0xaf;
 static uint8_t ssd1327_off = 0xae;
 
+#define CACHE_LINE ( 64 )						// Bytes in a cache line
+
 struct device_context
 {
-	uint16_t fontwth;				// Current font width of selected font
-	uint16_t fontht;				// Current font height of selected font
-	uint16_t fontstride;			// Bytes between characters in font
-	uint8_t* fontdata;				// Pointer to current font data	
+	const FONTDESC* font;			// Currently selected font
 	struct {
 		uint32_t hiTxtColor : 8;	// 8 bits to use for high pixel of text colour
 		uint32_t loTxtColor : 8;	// 8 bits to use for low pixel of text colour
@@ -72,14 +73,155 @@ struct device_context
 	};
 	struct {
 		uint16_t curfontnum : 7;	// Current selected font number
-		uint16_t _reserved : 8;
+		uint16_t textscale : 3;		// Text scale 1 to 4
+		uint16_t _reserved : 5;
 		uint16_t inuse : 1;			// DC is in use
 	};
+	int16_t curx;					// Current position x for LineTo
+	int16_t cury;					// Current position y for LineTo
+	uint8_t priority;				// Flush priority, 0 is background
+	uint16_t deadline;				// Milliseconds from queued to on screen, 0 none
+	struct ssd1327_device* dev;		// Device the DC draws on
+} __attribute__((aligned(CACHE_LINE)));		// Each DC on its own line so owners never false share
+
+/*--------------------------------------------------------------------------}
+{   DCs are handed out from blocks of 32 with a bit per DC in an atomic		}
+{   bitmap, so threads can get and release them at once without a lock.	}
+{   The first block is static, more are allocated as needed up to			}
+{   SSD1327_MAX_DC which can be set at build time. Blocks are never freed	}
+{   so a handle stays valid memory for the life of the program.				}
+{--------------------------------------------------------------------------*/
+#ifndef SSD1327_MAX_DC
+#define SSD1327_MAX_DC ( 256 )					// Most DCs that can be in use at once
+#endif
+#define DC_BLOCK ( 32 )							// DCs per block, one bitmap word
+#define MAX_DC_BLOCK ( (SSD1327_MAX_DC + DC_BLOCK - 1) / DC_BLOCK )
+
+struct dc_block
+{
+	uint32_t used;								// Bit set for each DC handed out
+	struct device_context dc[DC_BLOCK];
+};
+
+static struct dc_block dc_first = { 0 };
+static struct dc_block* dc_pool[MAX_DC_BLOCK] = { &dc_first };
+
+struct memory_bitmap
+{
+	const uint8_t* bits;			// Packed 4bpp pixels
+	uint16_t wth;					// Width in pixels
+	uint16_t ht;					// Height in pixels
+	uint16_t stride;				// Bytes between rows
+	struct {
+		uint16_t owned : 1;			// Bits were allocated by CreateCompatibleBitmap
+		uint16_t _reserved : 14;
+		uint16_t inuse : 1;			// Bitmap is in use
+	};
+};
+
+#define MAX_BITMAP ( 16 )
+static struct memory_bitmap bitmap_table[MAX_BITMAP] = { 0 };
+
+enum blt_op { BLT_COPY, BLT_PAINT, BLT_AND, BLT_INVERT, BLT_TRANSPARENT };
+
+#define SSD1327_WTH ( 128 )						// Screen width in pixels
+#define SSD1327_HT ( 128 )						// Screen height in pixels
+#define WINDOW_COST ( 64 )						// Data bytes that take as long to send as setting a window
+
+/*--------------------------------------------------------------------------}
+{   A flush group sends the frame of several devices at once. Devices on	}
+{   one SPI bus or sharing a Data/Cmd pin can not send at the same time so	}
+{   are put in the same lane. The caller sends lane 0 and a worker thread	}
+{   each other lane, one barrier starts the lanes together and another		}
+{   holds everyone until the last lane is sent.								}
+{--------------------------------------------------------------------------*/
+struct flush_lane
+{
+	struct flush_group* group;					// Group lane belongs to
+	uint8_t lane;								// Lane number
+	bool ok;									// Lane sent without failure
+	pthread_t thread;							// Worker sending the lane
+};
+
+struct flush_group
+{
+	uint8_t count;								// Devices in group
+	uint8_t lanes;								// Lanes, lane 0 is the caller
+	bool stop;									// Workers should exit
+	bool failed;								// A worker could not be created
+	pthread_mutex_t gate;						// Held while workers are created
+	pthread_barrier_t start;					// Lanes start the frame
+	pthread_barrier_t done;						// Every lane has sent
+	SSD1327_HANDLE dev[SSD1327_MAX_GROUP];		// Devices of group
+	uint8_t devlane[SSD1327_MAX_GROUP];			// Lane each device is sent in
+	struct flush_lane lane[SSD1327_MAX_GROUP];
+};
+
+/*--------------------------------------------------------------------------}
+{   GLYPH CACHE .. glyphs already expanded to 4bpp ready to send over SPI	}
+{   Keyed by font, text colour, background colour and glyph index. The		}
+{   links are held as index + 1 so a zeroed table is a valid empty cache.	}
+{--------------------------------------------------------------------------*/
+#define GLYPH_CACHE_SIZE ( 256 )				// Number of expanded glyphs held
+#define GLYPH_CACHE_HASH ( 512 )				// Hash buckets (must be power of 2)
+#define GLYPH_CACHE_MAXBYTES ( 128 )			// Largest glyph cached (16x16 = 128 bytes)
+
+struct glyph_entry
+{
+	uint32_t key;								// Font, colours and glyph packed as key
+	uint16_t prev;								// Previous entry in LRU list (index + 1)
+	uint16_t next;								// Next entry in LRU list (index + 1)
+	uint16_t hnext;								// Next entry in hash chain (index + 1)
+	uint16_t wth;								// Width of glyph cell in pixels
+	uint8_t data[GLYPH_CACHE_MAXBYTES];			// Expanded 4bpp glyph data
+};
+
+struct glyph_cache
+{
+	uint16_t mru;								// Most recently used entry (index + 1)
+	uint16_t lru;								// Least recently used entry (index + 1)
+	uint16_t count;								// Number of entries used
+	uint32_t generation;						// Font registry generation entries belong to
+	uint16_t hash[GLYPH_CACHE_HASH];			// Hash bucket heads (index + 1)
+	struct glyph_entry entry[GLYPH_CACHE_SIZE];	// The cached glyphs
+};
+
+/*--------------------------------------------------------------------------}
+{   LAYOUT CACHE .. line breaks found by DrawText and GetTextExtent. Keyed	}
+{   by a hash of the text plus the font, rectangle size and layout flags,	}
+{   each key has one slot so a new layout simply replaces the old one.		}
+{--------------------------------------------------------------------------*/
+#define LAYOUT_CACHE_SIZE ( 16 )				// Layouts held (must be power of 2)
+#define LAYOUT_MAXLINES ( 32 )					// Most lines in one layout
+#define LAYOUT_FLAGS ( DT_WORDBREAK | DT_SINGLELINE | DT_END_ELLIPSIS )// Flags that change line breaks
+
+struct text_line
+{
+	uint16_t start;								// Byte offset of line in text
+	uint16_t len;								// Bytes of text drawn on line
+	uint16_t wth;								// Width of line in pixels including any ellipsis
+	uint16_t ellipsis;							// Line ends with an ellipsis
 };
 
-#define MAX_DC ( 8 )
-static struct device_context dc_table[MAX_DC] = { 0 };
+struct text_layout
+{
+	uint64_t hash;								// FNV-1a hash of text
+	uint32_t generation;						// Font registry generation of layout
+	uint16_t textlen;							// Length of text in bytes
+	uint16_t wth;								// Width text was laid out in
+	uint16_t ht;								// Height text was laid out in
+	uint16_t flags;								// Layout flags used
+	uint8_t fontnum;							// Font used
+	uint8_t valid;								// Entry holds a layout
+	uint16_t numlines;							// Number of lines
+	uint16_t maxwth;							// Width of widest line
+	struct text_line line[LAYOUT_MAXLINES];		// The lines
+};
 
+/*--------------------------------------------------------------------------}
+{   Each device holds its own glyph and layout cache so text can be drawn	}
+{   on different devices from different threads.							}
+{--------------------------------------------------------------------------*/
 typedef struct ssd1327_device
 {
 	SPI_HANDLE spi;				// SPI Handle for device
@@ -87,10 +229,250 @@ typedef struct ssd1327_device
 	uint16_t screenht;			// Screen ht
 	GPIO_HANDLE gpio;			// GPIO handle for Data/Cmd access
 	uint8_t data_cmd_gpio;		// GPIO number that is Data/Cmd pin
+	uint8_t shadow[SSD1327_HT][SSD1327_WTH / 2];	// Copy of GDDRAM, SPI can not read it back
+	uint8_t dmgleft[SSD1327_HT];	// First damaged byte on each shadow row
+	uint8_t dmgright[SSD1327_HT];	// Last damaged byte on each shadow row, < dmgleft if none
+	uint8_t scrollcmd[8];			// Scroll setup command, 0 if no scroll set
+	uint8_t scrollleft;				// First byte column of scroll area
+	uint8_t scrollright;			// Last byte column of scroll area
+	uint8_t scrolltop;				// First row of scroll area
+	uint8_t scrollbottom;			// Last row of scroll area
+	bool scrolling;					// Controller is scrolling the area
+	uint8_t startline;				// GDDRAM row shown at top of screen
+	bool linepending;				// Start line latched while deferred, not yet sent
+	bool deferred;					// Drawing only damages the shadow until SSD1327_Flush
+	struct glyph_cache glyphs;		// Expanded glyphs of text drawn on device
+	struct text_layout layouts[LAYOUT_CACHE_SIZE];	// Line breaks of text drawn on device
 } SSD1327;
 
-/* Global table of ssd1327 devices.  */
-static SSD1327 tab[1] = { {0} };
+/***************************************************************************}
+{						 SHADOW AND DAMAGE ROUTINES	                        }
+{***************************************************************************/
+
+/*-[ INTERNAL: shadow_fill ]------------------------------------------------}
+. Fills an area of the GDDRAM shadow with a byte, x and wth even. The area
+. must already be clipped to the screen.
+.--------------------------------------------------------------------------*/
+static void shadow_fill (SSD1327_HANDLE dev, uint16_t x, uint16_t y, uint16_t wth, uint16_t ht, uint8_t colour)
+{
+	for (uint16_t j = 0; j < ht; j++)								// Each row of area
+		memset(&dev->shadow[y + j][x / 2], colour, wth / 2);
+}
+
+/*-[ INTERNAL: scroll_overlaps ]--------------------------------------------}
+. RETURN: true if a running hardware scroll covers any of the area from
+. (x1,y1) to (x2,y2) exclusive
+.--------------------------------------------------------------------------*/
+static bool scroll_overlaps (SSD1327_HANDLE dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+	return (dev->scrolling && x1 < x2 && y1 < y2 &&
+		x1 / 2 <= dev->scrollright && (x2 - 1) / 2 >= dev->scrollleft &&
+		y1 <= dev->scrollbottom && y2 - 1 >= dev->scrolltop);
+}
+
+/*-[ INTERNAL: shadow_only ]------------------------------------------------}
+. RETURN: true if drawing to the area from (x1,y1) to (x2,y2) exclusive
+. must go through the shadow and damage rather than straight to the screen
+. because drawing is deferred or the area hits a running hardware scroll
+.--------------------------------------------------------------------------*/
+static bool shadow_only (SSD1327_HANDLE dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+	return (dev->deferred || scroll_overlaps(dev, x1, y1, x2, y2));
+}
+
+/*-[ INTERNAL: damage_send ]------------------------------------------------}
+. Sends every damaged area of the shadow to the screen. Runs of damaged
+. rows are merged into one window while the extra bytes that carries cost
+. less than setting another window, so scattered spans go out as a few
+. windows rather than one per span. Windows never grow over a running
+. hardware scroll.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+static bool damage_send (SSD1327_HANDLE dev)
+{
+	bool retVal = true;
+	uint8_t buf[SSD1327_HT * SSD1327_WTH / 2];						// Window data gathered from shadow
+	uint16_t y = 0;
+	while (y < dev->screenht)
+	{
+		if (dev->dmgleft[y] > dev->dmgright[y]) { y++; continue; }	// Row not damaged
+		uint16_t y0 = y;											// First row of window
+		uint8_t l = dev->dmgleft[y], r = dev->dmgright[y];			// Byte columns of window
+		for (y++; y < dev->screenht && dev->dmgleft[y] <= dev->dmgright[y]; y++)
+		{
+			uint8_t nl = (dev->dmgleft[y] < l) ? dev->dmgleft[y] : l;
+			uint8_t nr = (dev->dmgright[y] > r) ? dev->dmgright[y] : r;
+			uint32_t merged = (uint32_t)(nr - nl + 1) * (y - y0 + 1);// Bytes if row joins window
+			uint32_t apart = (uint32_t)(r - l + 1) * (y - y0)
+				+ (dev->dmgright[y] - dev->dmgleft[y] + 1) + WINDOW_COST;	// Bytes if row starts new window
+			if (merged > apart) break;								// Cheaper as a new window
+			if (scroll_overlaps(dev, nl * 2, y0, (nr + 1) * 2, y + 1)) break;	// Window would cover the scroll
+			l = nl;
+			r = nr;
+		}
+		uint16_t stride = r - l + 1;								// Bytes per row of window
+		for (uint16_t j = y0; j < y; j++)							// Gather window rows from shadow
+		{
+			memcpy(&buf[(j - y0) * stride], &dev->shadow[j][l], stride);
+			dev->dmgleft[j] = 0xFF;									// Row no longer damaged
+			dev->dmgright[j] = 0;
+		}
+		if (!SSD1327_SetWindow(dev, l * 2, y0, (r + 1) * 2, y)) retVal = false;	// Set window to damaged area
+		GPIO_Output(dev->gpio, dev->data_cmd_gpio, 1);				// Make sure Data#Cmd high
+		if (!SpiWriteAndRead(dev->spi, &buf[0], 0, stride * (y - y0), false))
+			retVal = false;											// Send damaged area
+	}
+	return retVal;
+}
+
+/*-[ INTERNAL: damage_flush ]-----------------------------------------------}
+. Sends every damaged area of the shadow to the screen except what lies in
+. a running hardware scroll. Scroll rows damaged on both sides of it are
+. sent as a left then a right pass. Damage inside the scroll is dropped as
+. the whole scroll area is rewritten when it stops.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+static bool damage_flush (SSD1327_HANDLE dev)
+{
+	if (!dev->scrolling) return damage_send(dev);					// No scroll to avoid
+	uint8_t rl[SSD1327_HT], rr[SSD1327_HT];							// Right of scroll damage
+	bool right = false;
+	for (uint16_t y = dev->scrolltop; y <= dev->scrollbottom; y++)
+	{
+		uint8_t l = dev->dmgleft[y], r = dev->dmgright[y];
+		rl[y] = 0xFF;												// Preset no damage right of scroll
+		rr[y] = 0;
+		if (l > r || r < dev->scrollleft || l > dev->scrollright) continue;	// Misses scroll
+		if (r > dev->scrollright)									// Damage right of scroll
+		{
+			rl[y] = (l > dev->scrollright) ? l : dev->scrollright + 1;
+			rr[y] = r;
+			right = true;
+		}
+		if (l < dev->scrollleft) dev->dmgright[y] = dev->scrollleft - 1;// Keep left of scroll
+		else {
+			dev->dmgleft[y] = 0xFF;									// Nothing left of scroll
+			dev->dmgright[y] = 0;
+		}
+	}
+	bool retVal = damage_send(dev);									// Send all but right of scroll
+	if (right)
+	{
+		for (uint16_t y = dev->scrolltop; y <= dev->scrollbottom; y++)
+		{
+			dev->dmgleft[y] = rl[y];								// Only right of scroll left
+			dev->dmgright[y] = rr[y];
+		}
+		if (!damage_send(dev)) retVal = false;						// Send right of scroll
+	}
+	return retVal;
+}
+
+/*-[ INTERNAL: damage_commit ]----------------------------------------------}
+. Finishes a drawing call, the damage is sent now unless drawing is being
+. deferred to SSD1327_Flush.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+static bool damage_commit (SSD1327_HANDLE dev)
+{
+	return (dev->deferred) ? true : damage_flush(dev);
+}
+
+/*-[ INTERNAL: startline_commit ]-------------------------------------------}
+. Sends a start line latched while deferred once no damage is left, so the
+. console lines it scrolls onto the screen are already there.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+static bool startline_commit (SSD1327_HANDLE dev)
+{
+	if (!dev->linepending) return true;								// Nothing latched
+	for (uint16_t y = 0; y < dev->screenht; y++)
+		if (dev->dmgleft[y] <= dev->dmgright[y]) return true;		// Rows still waiting
+	dev->linepending = false;
+	return SSD1327_SetStartLine(dev, dev->startline);
+}
+
+/*-[ INTERNAL: damage_add ]-------------------------------------------------}
+. Marks bytes b1 to b2 inclusive of shadow row y as damaged.
+.--------------------------------------------------------------------------*/
+static void damage_add (SSD1327_HANDLE dev, uint16_t y, uint8_t b1, uint8_t b2)
+{
+	if (dev->dmgleft[y] > dev->dmgright[y])							// Row not yet damaged
+	{
+		dev->dmgleft[y] = b1;
+		dev->dmgright[y] = b2;
+	} else {
+		if (b1 < dev->dmgleft[y]) dev->dmgleft[y] = b1;				// Grow damage to include bytes
+		if (b2 > dev->dmgright[y]) dev->dmgright[y] = b2;
+	}
+}
+
+/*-[ INTERNAL: shadow_damage ]----------------------------------------------}
+. Marks an area of the GDDRAM shadow damaged, x and wth even. The area
+. must already be clipped to the screen.
+.--------------------------------------------------------------------------*/
+static void shadow_damage (SSD1327_HANDLE dev, uint16_t x, uint16_t y, uint16_t wth, uint16_t ht)
+{
+	for (uint16_t j = 0; j < ht && wth > 0; j++)					// Each row of area
+		damage_add(dev, y + j, x / 2, (x + wth) / 2 - 1);
+}
+
+/*-[ INTERNAL: screen_write ]-----------------------------------------------}
+. Sends a wth x ht block of packed pixels, rows stride bytes apart, as one
+. window at (x,y), x even. The block is clipped to the screen so the window
+. and the GDDRAM shadow always get the same pixels. If it hits a running
+. hardware scroll or drawing is deferred it only damages the shadow and
+. goes out with the damage.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+static bool screen_write (SSD1327_HANDLE dev, uint16_t x, uint16_t y, uint16_t wth, uint16_t ht, const uint8_t* buf, uint16_t stride)
+{
+	if (x >= dev->screenwth || y >= dev->screenht) return false;	// Block starts off screen
+	if (wth > dev->screenwth - x) wth = dev->screenwth - x;			// Clip to right of screen
+	if (ht > dev->screenht - y) ht = dev->screenht - y;				// Clip to bottom of screen
+	bool shadow = shadow_only(dev, x, y, x + wth, y + ht);			// Area must avoid the scroll
+	if (!shadow)
+	{
+		if (!SSD1327_SetWindow(dev, x, y, x + wth, y + ht)) return false;	// Set the window area
+		GPIO_Output(dev->gpio, dev->data_cmd_gpio, 1);				// Make sure Data#Cmd high
+		if (!SpiWriteRows(dev->spi, buf, wth / 2, stride, ht, false))
+			return false;											// Send block, one transfer if rows are contiguous
+	}
+	for (uint16_t j = 0; j < ht; j++)								// Each row
+		memcpy(&dev->shadow[y + j][x / 2], &buf[j * stride], wth / 2);
+	if (!shadow) return true;
+	shadow_damage(dev, x, y, wth, ht);								// Send around the scroll
+	return damage_commit(dev);
+}
+
+/*-[ INTERNAL: span_fill ]--------------------------------------------------}
+. Sets pixels x1 to x2 inclusive of row y in the shadow to a colour given
+. as its high and low nibble values, clipped to the screen. Edge pixels
+. that share a byte with a neighbour only change their own nibble. The
+. bytes are marked damaged.
+.--------------------------------------------------------------------------*/
+static void span_fill (SSD1327_HANDLE dev, int y, int x1, int x2, uint8_t hicolor, uint8_t locolor)
+{
+	if (y < 0 || y >= dev->screenht) return;						// Row off screen
+	if (x1 < 0) x1 = 0;												// Clip to left of screen
+	if (x2 >= dev->screenwth) x2 = dev->screenwth - 1;				// Clip to right of screen
+	if (x1 > x2) return;											// Nothing on screen
+	uint8_t* row = &dev->shadow[y][0];
+	uint8_t bl = x1 / 2, br = x2 / 2;								// Bytes span touches
+	if (x1 & 1)														// Starts on right pixel of a byte
+	{
+		row[x1 / 2] = (row[x1 / 2] & 0xF0) | locolor;				// Keep left pixel
+		x1++;
+	}
+	if (x1 <= x2 && (x2 & 1) == 0)									// Ends on left pixel of a byte
+	{
+		row[x2 / 2] = (row[x2 / 2] & 0x0F) | hicolor;				// Keep right pixel
+		x2--;
+	}
+	if (x1 <= x2) memset(&row[x1 / 2], hicolor | locolor,
+		(x2 - x1 + 1) / 2);											// Whole bytes between
+	damage_add(dev, y, bl, br);										// Mark bytes damaged
+}
 
 /***************************************************************************}
 {						 DEVICE SPECIFIC ROUTINES	                        }
@@ -101,35 +483,78 @@ static SSD1327 tab[1] = { {0} };
 . should be opened with desired speed settings and SPI_MODE3 before call.
 . It is also assumed a valid reset cycle on reset pin was completed and the
 . reset operation lies outside this code scope as it involves long delays.
-. RETURN: true for success, false for any failure
+. Any number of devices can be open, each on its own SPI handle. Different
+. devices may be drawn on from different threads but drawing on one device
+. must come from one thread at a time. Fonts must not be added or removed
+. while any device is being drawn on.
+. RETURN: valid SSD1327_HANDLE for success, NULL for any failure
 .--------------------------------------------------------------------------*/
-bool SSD1327_Open (SPI_HANDLE spi, GPIO_HANDLE gpio, uint8_t data_cmd_gpio)
+SSD1327_HANDLE SSD1327_Open (SPI_HANDLE spi, GPIO_HANDLE gpio, uint8_t data_cmd_gpio)
 {
-	if (tab[0].spi == 0)											// Make sure device is not already open 
+	if (spi == 0 || gpio == 0) return 0;							// Need SPI and GPIO
+	SSD1327_HANDLE dev = calloc(1, sizeof(SSD1327));				// Shadow assumes a cleared screen
+	if (dev)
 	{
-		tab[0].spi = spi;											// Hold the SPI Handle
-		tab[0].gpio = gpio;											// Hold GPIO handle
-		tab[0].data_cmd_gpio = data_cmd_gpio;						// Hold gpio number for data_cmd
-		tab[0].screenwth = 128;										// Set screen width
-		tab[0].screenht = 128;										// Set screen height
+		dev->spi = spi;												// Hold the SPI Handle
+		dev->gpio = gpio;											// Hold GPIO handle
+		dev->data_cmd_gpio = data_cmd_gpio;							// Hold gpio number for data_cmd
+		dev->screenwth = SSD1327_WTH;								// Set screen width
+		dev->screenht = SSD1327_HT;									// Set screen height
+		memset(&dev->dmgleft[0], 0xFF, sizeof(dev->dmgleft));		// Nothing damaged
+		dev->scrollcmd[0] = 0;										// No scroll set
+		dev->scrolling = false;
+		dev->startline = 0;											// Init sequence sets start line 0
+		dev->deferred = false;										// Drawing goes straight out
 		GPIO_Output(gpio, data_cmd_gpio, 0);						// Set to low .. ready for commands
 		SpiWriteAndRead(spi, (uint8_t*)&ssd1327_init[0], 0, 34, false);// Send initialize commands
-		GPIO_Output(tab[0].gpio, tab[0].data_cmd_gpio, 1);			// Data#Cmd back high for safety
-		return true;												// Return success
+		GPIO_Output(dev->gpio, dev->data_cmd_gpio, 1);				// Data#Cmd back high for safety
+	}
+	return dev;														// Return the handle
+}
+
+/*-[ INTERNAL: dev_has_dc ]-------------------------------------------------}
+. RETURN: true if any DC in use draws on the device
+.--------------------------------------------------------------------------*/
+static bool dev_has_dc (SSD1327_HANDLE dev)
+{
+	for (uint16_t b = 0; b < MAX_DC_BLOCK; b++)						// Search each block
+	{
+		struct dc_block* blk = __atomic_load_n(&dc_pool[b], __ATOMIC_ACQUIRE);
+		if (blk == 0) break;										// No more blocks
+		uint32_t used = __atomic_load_n(&blk->used, __ATOMIC_ACQUIRE);
+		for (; used; used &= used - 1)								// Each DC handed out
+			if (__atomic_load_n(&blk->dc[__builtin_ctz(used)].dev, __ATOMIC_RELAXED) == dev)
+				return true;										// DC still draws on device
 	}
 	return false;
 }
 
+/*-[ SSD1327_Close ]--------------------------------------------------------}
+. Frees the device, anything deferred is sent first. Every DC got on it
+. must have been released, while any is still in use the device is left
+. open and false returned. The SPI and GPIO handles stay open.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool SSD1327_Close (SSD1327_HANDLE dev)
+{
+	if (dev == 0 || dev_has_dc(dev)) return false;					// Invalid or DCs still draw on it
+	bool retVal = (dev->deferred) ? damage_flush(dev) : true;		// Nothing left waiting
+	if (!startline_commit(dev)) retVal = false;
+	free(dev);
+	return retVal;
+}
+
 /*-[ SSD1327_ScreenOnOff ]--------------------------------------------------}
 . Sends the command to turn the screen on/off.
 . RETURN: true for success, false for any failure
 .--------------------------------------------------------------------------*/
-bool SSD1327_ScreenOnOff (bool ScreenOn)
+bool SSD1327_ScreenOnOff (SSD1327_HANDLE dev, bool ScreenOn)
 {
-	GPIO_Output(tab[0].gpio, tab[0].data_cmd_gpio, 0);				// Data#Cmd low for command
+	if (dev == 0) return false;										// Device not valid
+	GPIO_Output(dev->gpio, dev->data_cmd_gpio, 0);				// Data#Cmd low for command
 	uint8_t* p = (ScreenOn) ? &ssd1327_on : &ssd1327_off;
-	bool retVal = SpiWriteAndRead(tab[0].spi, p, 0, 1, false);		// Send off command commands
-	GPIO_Output(tab[0].gpio, tab[0].data_cmd_gpio, 1);				// Data#Cmd back high for safety
+	bool retVal = SpiWriteAndRead(dev->spi, p, 0, 1, false);		// Send off command commands
+	GPIO_Output(dev->gpio, dev->data_cmd_gpio, 1);					// Data#Cmd back high for safety
 	return retVal;													// Return result of transmission
 }
 
@@ -138,8 +563,9 @@ bool SSD1327_ScreenOnOff (bool ScreenOn)
 . into that area.
 . RETURN: true for success, false for any failure
 .--------------------------------------------------------------------------*/
-bool SSD1327_SetWindow (uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+bool SSD1327_SetWindow (SSD1327_HANDLE dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
 {
+	if (dev == 0) return false;										// Device not valid
 	uint8_t temp[6];
 	temp[0] = 0x15;
 	temp[1] = x1 / 2;
@@ -147,10 +573,10 @@ bool SSD1327_SetWindow (uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
 	temp[3] = 0x75;
 	temp[4] = y1;
 	temp[5] = y2 - 1;
-	GPIO_Output(tab[0].gpio, tab[0].data_cmd_gpio, 0);				// Set to low .. ready for command
-	bool retVal = SpiWriteAndRead(tab[0].spi, (uint8_t*)&temp[0], 
+	GPIO_Output(dev->gpio, dev->data_cmd_gpio, 0);					// Set to low .. ready for command
+	bool retVal = SpiWriteAndRead(dev->spi, (uint8_t*)&temp[0], 
 		0, 6, false);												// Send set window command
-	GPIO_Output(tab[0].gpio, tab[0].data_cmd_gpio, 1);				// Data#Cmd back high for safety
+	GPIO_Output(dev->gpio, dev->data_cmd_gpio, 1);					// Data#Cmd back high for safety
 	return retVal;													// Return result of transmission
 }
 
@@ -158,253 +584,1663 @@ bool SSD1327_SetWindow (uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
 . Puts a colour on entire screen
 . RETURN: true for success, false for any failure
 .--------------------------------------------------------------------------*/
-bool SSD1327_ClearScreen (uint8_t colour)
+bool SSD1327_ClearScreen (SSD1327_HANDLE dev, uint8_t colour)
 {
-
-	uint8_t buf[tab[0].screenwth / 2];								// Setup a buffer for a single line
+	if (dev == 0 || dev->spi == 0) return false;					// Device not open
+	uint8_t buf[dev->screenwth / 2];								// Setup a buffer for a single line
 	uint8_t temp = (colour << 4) | colour;							// Create a single colour byte of 2 pixels
-	memset(&buf[0], temp, tab[0].screenwth / 2);					// Fill the temp buffer with the colour
-	if (SSD1327_SetWindow(0, 0, tab[0].screenwth, tab[0].screenht))	// Set the window to entire screen
+	memset(&buf[0], temp, dev->screenwth / 2);						// Fill the temp buffer with the colour
+	if (dev->scrolling || dev->deferred)							// Screen around a running scroll
+	{
+		shadow_fill(dev, 0, 0, dev->screenwth, dev->screenht, temp);
+		shadow_damage(dev, 0, 0, dev->screenwth, dev->screenht);
+		return damage_commit(dev);
+	}
+	if (SSD1327_SetWindow(dev, 0, 0, dev->screenwth, dev->screenht))// Set the window to entire screen
 	{
-		GPIO_Output(tab[0].gpio, tab[0].data_cmd_gpio, 1);			// Make sure Data#Cmd high
-		return (SpiWriteBlockRepeat(tab[0].spi, &buf[0],
-			tab[0].screenwth / 2, tab[0].screenht, false));			// Transfer buffer repeatedly and return result
+		GPIO_Output(dev->gpio, dev->data_cmd_gpio, 1);				// Make sure Data#Cmd high
+		shadow_fill(dev, 0, 0, dev->screenwth, dev->screenht, temp);// Shadow follows the screen
+		return (SpiWriteBlockRepeat(dev->spi, &buf[0],
+			dev->screenwth / 2, dev->screenht, false));				// Transfer buffer repeatedly and return result
 	}
 	return false;													// Set window failed
 }
 
-/*-[ SSD1327_WriteChar ]----------------------------------------------------}
-. Writes the character in the current font to the screen at position (x,y)
-. **** Note x can only be even value 0,2,4 etc due to two pixel per byte 
-. format and me being to lazy to deal with odds. If you do ask for an odd X
-. value it will write at the value one less so x = 3 would write at x = 2.
-. Fonts also have restriction they must be of even width .. the demo fonts 
-. being 6 and 8 pixels wide.
+/*-[ SSD1327_DrawGrey ]-----------------------------------------------------}
+. Draws a wth x ht image of 8 bit grey pixels (rows stride bytes apart) at
+. (x,y) dithered to the 16 screen levels. Each row is dithered straight
+. into the GDDRAM shadow and the rows are sent from there, so the image is
+. never held twice. The area is clipped to the screen.
+. **** Note x and wth are rounded down to even values like WriteText.
 . RETURN: true for success, false for any failure
 .--------------------------------------------------------------------------*/
-bool SSD1327_WriteChar (HDC Dc, uint16_t x, uint16_t y, char Ch)
+bool SSD1327_DrawGrey (HDC Dc, uint16_t x, uint16_t y, uint16_t wth, uint16_t ht, const uint8_t* grey, uint16_t stride, DITHERMODE mode)
 {
-	if (tab[0].spi && Dc && Dc->fontdata)							// Make sure device is open and we have DC and fontdata
+	if (Dc && Dc->inuse && Dc->dev->spi && grey)					// Make sure device is open, DC valid and have image
 	{
-		uint16_t TSize = Dc->fontwth/2 * Dc->fontht;				// Bytes to tranfer for font is Fontwidth/2 * FontHt
-		uint8_t* bp = &Dc->fontdata[(unsigned int)Ch * Dc->fontstride];// Load font bitmap pointer
-		x &= 0xFFFE;												// Make sure x value even 											
-		if (SSD1327_SetWindow(x, y, x + Dc->fontwth, y + Dc->fontht))// Set the window area
-		{	
-			uint8_t buf[TSize];										// Setup a buffer for transfer 
-			uint8_t b = *bp++;										// Fetch the first font byte
-			uint8_t fbuc = 0;										// Zero font bits used count for fonts > 8 pixels in width
-			for (unsigned int i = 0; i < TSize; i++)
-			{
-				buf[i] = ((b & 0x80) == 0x80) ? Dc->hiTxtColor : Dc->hiBkColor; // High pixel colour either text or bkgnd
-				buf[i] |= ((b & 0x40) == 0x40) ? Dc->loTxtColor : Dc->loBkColor; // Low pixel colour either text or bkgnd
-				b = b << 2;											// Shift b left by two places
-				fbuc++;												// Increment font bits used count
-				if ((i + 1) % (Dc->fontwth/2) == 0 || fbuc == 4)	// If the byte is a mod of fontwth/2 or we have used all 8 font bits
-				{
-					b = *bp++;										// Load next byte from font
-					fbuc = 0;										// Zero font bits used as we ahve new font byte 
-				}
-			}
-			GPIO_Output(tab[0].gpio, tab[0].data_cmd_gpio, 1);		// Make sure Data#Cmd high
-			return SpiWriteAndRead(tab[0].spi, &buf[0], 0, TSize, false);// Send all font data
+		x &= 0xFFFE;												// Make sure x value even
+		if (x >= Dc->dev->screenwth || y >= Dc->dev->screenht) return false;// Image starts off screen
+		if (wth > Dc->dev->screenwth - x) wth = Dc->dev->screenwth - x;// Clip to right of screen
+		if (ht > Dc->dev->screenht - y) ht = Dc->dev->screenht - y;	// Clip to bottom of screen
+		wth &= 0xFFFE;												// Whole bytes only
+		DITHERSTATE ds;
+		if (!Expand_DitherInit(&ds, mode, wth)) return false;		// Invalid mode or nothing to draw
+		for (uint16_t j = 0; j < ht; j++)							// Dither each row into the shadow
+			Expand_DitherRow(&ds, grey + (uint32_t)j * stride, &Dc->dev->shadow[y + j][x / 2]);
+		if (shadow_only(Dc->dev, x, y, x + wth, y + ht))			// Image around a running scroll
+		{
+			shadow_damage(Dc->dev, x, y, wth, ht);
+			return damage_commit(Dc->dev);
 		}
+		if (!SSD1327_SetWindow(Dc->dev, x, y, x + wth, y + ht)) return false;	// Set the window area
+		GPIO_Output(Dc->dev->gpio, Dc->dev->data_cmd_gpio, 1);		// Make sure Data#Cmd high
+		return SpiWriteRows(Dc->dev->spi, &Dc->dev->shadow[y][x / 2], wth / 2,
+			SSD1327_WTH / 2, ht, false);							// Send rows from the shadow
 	}
 	return false;													// Return failure
 }
 
-/*-[ SSD1327_WriteText ]----------------------------------------------------}
-. Writes the text in the current font to the screen at position (x,y)
-. **** Note x can only be even value 0,2,4 etc due to two pixel per byte
-. format and me being to lazy to deal with odds. If you do ask for an odd X
-. value it will write at the value one less so x = 3 would write at x = 2.
-. Fonts also have restriction they must be of even width .. the demo font
-. being 8 pixels wide.
+/*-[ SSD1327_SetScroll ]----------------------------------------------------}
+. Sets the area (right and bottom exclusive) the controller scrolls around
+. by itself once SSD1327_StartScroll is called, left and right are rounded
+. out to even pixels. Any scroll running is stopped first.
 . RETURN: true for success, false for any failure
 .--------------------------------------------------------------------------*/
-bool SSD1327_WriteText (HDC Dc, uint16_t x, uint16_t y, char* txt)
+bool SSD1327_SetScroll (SSD1327_HANDLE dev, uint16_t left, uint16_t top, uint16_t right, uint16_t bottom, SCROLLDIR dir, SCROLLSPEED speed)
 {
-	if (tab[0].spi && Dc && Dc->fontdata && txt)					// Make sure device is open and we have fontdata and txt pointer
+	if (dev && dev->spi && left < right && top < bottom && right <= dev->screenwth
+		&& bottom <= dev->screenht && (dir == SCROLL_RIGHT || dir == SCROLL_LEFT))
 	{
-		bool retVal = true;											// Preset success
-		x &= 0xFFFE;												// Make sure x value even 
-		while ((*txt) != 0 && retVal)								// Not a c string terminate character and retVal still true
-		{
-			char ch = (*txt++);										// Next character
-			retVal = SSD1327_WriteChar(Dc, x, y, ch);				// Write the charter to screen
-			x += Dc->fontwth;										// Move to next character position
-		}
-		return retVal;												// Return result
+		if (dev->scrolling && !SSD1327_StopScroll(dev)) return false;	// Must not change a running scroll
+		dev->scrollleft = left / 2;									// Byte columns of area
+		dev->scrollright = (right - 1) / 2;
+		dev->scrolltop = top;										// Rows of area
+		dev->scrollbottom = bottom - 1;
+		dev->scrollcmd[0] = dir;									// Scroll direction command
+		dev->scrollcmd[1] = 0x00;									// Dummy byte
+		dev->scrollcmd[2] = top;									// Start row
+		dev->scrollcmd[3] = speed & 0x07;							// Time interval code
+		dev->scrollcmd[4] = bottom - 1;								// End row
+		dev->scrollcmd[5] = dev->scrollleft;						// Start column
+		dev->scrollcmd[6] = dev->scrollright;						// End column
+		dev->scrollcmd[7] = 0x00;									// Dummy byte
+		GPIO_Output(dev->gpio, dev->data_cmd_gpio, 0);				// Data#Cmd low for command
+		bool retVal = SpiWriteAndRead(dev->spi, &dev->scrollcmd[0], 0, 8, false);	// Send scroll setup
+		GPIO_Output(dev->gpio, dev->data_cmd_gpio, 1);				// Data#Cmd back high for safety
+		return retVal;												// Return result of transmission
 	}
-	return false;													// Return failure
+	return false;
 }
 
-/***************************************************************************}
-{						 DEVICE CONTEXT ROUTINES	                        }
-{***************************************************************************/
+/*-[ SSD1327_StartScroll ]--------------------------------------------------}
+. Starts the scroll set by SSD1327_SetScroll. While it runs drawing in the
+. scroll area is only kept in the shadow and never sent, as the controller
+. does not support writes there, so the animation costs no SPI traffic.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool SSD1327_StartScroll (SSD1327_HANDLE dev)
+{
+	if (dev && dev->spi && dev->scrollcmd[0])						// Device open and scroll set
+	{
+		uint8_t cmd = 0x2f;											// Activate scroll
+		GPIO_Output(dev->gpio, dev->data_cmd_gpio, 0);				// Data#Cmd low for command
+		bool retVal = SpiWriteAndRead(dev->spi, &cmd, 0, 1, false);
+		GPIO_Output(dev->gpio, dev->data_cmd_gpio, 1);				// Data#Cmd back high for safety
+		if (retVal) dev->scrolling = true;							// Scroll area now excluded from writes
+		return retVal;												// Return result of transmission
+	}
+	return false;
+}
 
-/*-[ GetDc ]----------------------------------------------------------------}
-.  Fetches the next available device context handle (HDC).
-. If all handles are currently in use it will return NULL.
+/*-[ SSD1327_StopScroll ]---------------------------------------------------}
+. Stops a running scroll and rewrites the scroll area from the shadow, so
+. it shows what was last drawn there unscrolled.
+. RETURN: true for success, false for any failure
 .--------------------------------------------------------------------------*/
-HDC GetDC (void)
+bool SSD1327_StopScroll (SSD1327_HANDLE dev)
 {
-	uint16_t i;
-	for (i = 0; i < MAX_DC; i++)									// Search each table entry
+	if (dev && dev->spi)											// Device open
 	{
-		if (dc_table[i].inuse == 0)									// Is DC in use
+		uint8_t cmd = 0x2e;											// Deactivate scroll
+		GPIO_Output(dev->gpio, dev->data_cmd_gpio, 0);				// Data#Cmd low for command
+		bool retVal = SpiWriteAndRead(dev->spi, &cmd, 0, 1, false);
+		GPIO_Output(dev->gpio, dev->data_cmd_gpio, 1);				// Data#Cmd back high for safety
+		if (retVal && dev->scrolling)								// Scrolled area needs rewriting
 		{
-			dc_table[i].inuse = 1;									// Set the in use flag
-			SetBkColor(&dc_table[i], 0);							// Set background colour black
-			SetTextColor(&dc_table[i], 15);							// Set text colour white
-			SetDCBrushColor(&dc_table[i], 8);						// Set brush colour mid gray
-			SetDCPenColor(&dc_table[i], 8);							// Set pen colour mid gray
-			dc_table[i].fontwth = 8;								// Default font width = 8
-			dc_table[i].fontht = 16;								// Default font width = 16
-			dc_table[i].fontstride = 16;							// Default font stride = 16 bytes per character
-			dc_table[i].fontdata = (uint8_t*)&font_8x16_data[0];	// Default pointer to font data
-			return &dc_table[i];									// Return the handle
+			dev->scrolling = false;
+			for (uint16_t y = dev->scrolltop; y <= dev->scrollbottom; y++)
+				damage_add(dev, y, dev->scrollleft, dev->scrollright);
+			retVal = damage_commit(dev);
 		}
+		return retVal;												// Return result of transmission
 	}
-	return 0;														// No DC available
+	return false;
 }
 
-/*-[ ReleaseDc ]------------------------------------------------------------}
-.  Releases the device context
+/*-[ SSD1327_SetStartLine ]-------------------------------------------------}
+. Sets the GDDRAM row shown at the top of the screen, the rows below follow
+. on from it wrapping around at the last row.
+. RETURN: true for success, false for any failure
 .--------------------------------------------------------------------------*/
-void ReleaseDC (HDC Dc)
+bool SSD1327_SetStartLine (SSD1327_HANDLE dev, uint8_t line)
 {
-	if (Dc && Dc->inuse)											// Check the DC is valid and in use
+	if (dev && dev->spi && line < dev->screenht)					// Device open and line on screen
 	{
-		Dc->inuse = 0;												// DC is available again
+		uint8_t cmd[2] = { 0xa1, line };							// Set start line command
+		GPIO_Output(dev->gpio, dev->data_cmd_gpio, 0);				// Data#Cmd low for command
+		bool retVal = SpiWriteAndRead(dev->spi, &cmd[0], 0, 2, false);
+		GPIO_Output(dev->gpio, dev->data_cmd_gpio, 1);				// Data#Cmd back high for safety
+		if (retVal) dev->startline = line;							// Hold start line
+		return retVal;												// Return result of transmission
 	}
+	return false;
 }
 
-/*-[ SetBkColor ]-----------------------------------------------------------}
-.  Sets the current device context background color to the specified color 
-.  and returns the previously set background color
+/*-[ SSD1327_SetDeferred ]--------------------------------------------------}
+. With defer true drawing only changes the GDDRAM shadow and marks it
+. damaged, nothing goes to the screen until SSD1327_Flush. Anything drawn
+. over twice before the flush is only sent once as its last value. Setting
+. it false flushes anything still waiting.
+. RETURN: true for success, false for any failure
 .--------------------------------------------------------------------------*/
-COLORREF SetBkColor(HDC Dc, COLORREF Color)
+bool SSD1327_SetDeferred (SSD1327_HANDLE dev, bool defer)
 {
-	COLORREF retVal = 0;											// Preset zero return
-	if (Dc && Dc->inuse)											// Check the DC is valid and in use
+	if (dev && dev->spi)											// Device open
 	{
-		retVal = Dc->loBkColor;										// Return current low pixel background colour
-		Dc->hiBkColor = Color << 4;									// Set the high pixel background colour 
-		Dc->loBkColor = Color & 0xF;								// Set the low pixel background colour
+		dev->deferred = defer;
+		if (defer) return true;
+		bool retVal = damage_flush(dev);							// Nothing left waiting
+		if (!startline_commit(dev)) retVal = false;
+		return retVal;
 	}
-	return retVal;													// Return the old background colour
+	return false;
 }
 
-/*-[ SetTextColor ]---------------------------------------------------------}
-.  Sets the current device context text color to the specified color and 
-.  returns the previously set text color
+/*-[ SSD1327_Flush ]--------------------------------------------------------}
+. Sends everything drawn since the last flush, damaged rows are merged
+. into as few windows as is cheapest.
+. RETURN: true for success, false for any failure
 .--------------------------------------------------------------------------*/
-COLORREF SetTextColor (HDC Dc, COLORREF Color)
+bool SSD1327_Flush (SSD1327_HANDLE dev)
 {
-	COLORREF retVal = 0;											// Preset zero return
-	if (Dc && Dc->inuse)											// Check the DC is valid and in use
+	if (dev && dev->spi)
 	{
-		retVal = Dc->loTxtColor;									// Return current low pixel text colour
-		Dc->hiTxtColor = Color << 4;								// Set the high pixel text colour 
-		Dc->loTxtColor = Color & 0xF;								// Set the low pixel text colour
+		bool retVal = damage_flush(dev);							// Send all the damage
+		if (!startline_commit(dev)) retVal = false;					// Then any console scroll
+		return retVal;
 	}
-	return retVal;													// Return the old text colour
+	return false;
 }
 
-/*-[ SetDCPenColor ]--------------------------------------------------------}
-.  Sets the current device context pen color to the specified color and
-. returns the previously set pen color
+/*-[ SSD1327_FlushRows ]----------------------------------------------------}
+. As SSD1327_Flush but only sends what was drawn on rows top to bottom-1,
+. the rest stays waiting for a later flush. Urgent areas can go first.
+. RETURN: true for success, false for any failure
 .--------------------------------------------------------------------------*/
-COLORREF SetDCPenColor (HDC Dc, COLORREF Color)
+bool SSD1327_FlushRows (SSD1327_HANDLE dev, uint16_t top, uint16_t bottom)
 {
-	COLORREF retVal = 0;											// Preset zero return
-	if (Dc && Dc->inuse)											// Check the DC is valid and in use
+	if (dev && dev->spi)											// Device open
 	{
-		retVal = Dc->loPenColor;									// Return current low pixel pen colour
-		Dc->hiPenColor = Color << 4;								// Set the high pixel pen colour 
-		Dc->loPenColor = Color & 0xF;								// Set the low pixel pen colour
+		if (bottom > dev->screenht) bottom = dev->screenht;			// Clip to bottom of screen
+		if (top >= bottom) return true;								// No rows
+		uint8_t l[SSD1327_HT], r[SSD1327_HT];						// Damage of rows held back
+		for (uint16_t y = 0; y < dev->screenht; y++)
+		{
+			if (y >= top && y < bottom) continue;					// Row is to go
+			l[y] = dev->dmgleft[y];
+			r[y] = dev->dmgright[y];
+			dev->dmgleft[y] = 0xFF;									// Hide its damage
+			dev->dmgright[y] = 0;
+		}
+		bool retVal = damage_flush(dev);							// Send the rows
+		for (uint16_t y = 0; y < dev->screenht; y++)
+		{
+			if (y >= top && y < bottom) continue;
+			dev->dmgleft[y] = l[y];									// Damage back for later
+			dev->dmgright[y] = r[y];
+		}
+		if (!startline_commit(dev)) retVal = false;					// Once the last rows are sent
+		return retVal;
 	}
-	return retVal;													// Return the old pen colour
+	return false;
 }
 
-/*-[ SetDCBrushColor ]------------------------------------------------------}
-.  Sets the current device context brush color to the specified color and 
-. returns the previously set brush color
+/*-[ INTERNAL: group_send ]-------------------------------------------------}
+. Flushes every device of the lane in turn.
 .--------------------------------------------------------------------------*/
-COLORREF SetDCBrushColor (HDC Dc, COLORREF Color)
+static bool group_send (struct flush_group* g, uint8_t lane)
 {
-	COLORREF retVal = 0;											// Preset zero return
-	if (Dc && Dc->inuse)											// Check the DC is valid and in use
+	bool retVal = true;
+	for (uint8_t i = 0; i < g->count; i++)
+		if (g->devlane[i] == lane && !SSD1327_Flush(g->dev[i])) retVal = false;
+	return retVal;
+}
+
+/*-[ INTERNAL: group_worker ]-----------------------------------------------}
+. Worker thread of one lane, sends its lane each time the frame starts.
+.--------------------------------------------------------------------------*/
+static void* group_worker (void* param)
+{
+	struct flush_lane* ln = param;
+	struct flush_group* g = ln->group;
+	pthread_mutex_lock(&g->gate);									// Wait until every worker exists
+	bool failed = g->failed;										// Creation of a worker failed
+	pthread_mutex_unlock(&g->gate);
+	while (!failed)
 	{
-		retVal = Dc->loBrushColor;									// Return current low pixel brush colour
-		Dc->hiBrushColor = Color << 4;								// Set the high pixel brush colour 
-		Dc->loBrushColor = Color & 0xF;								// Set the low pixel brush colour
+		pthread_barrier_wait(&g->start);							// Frame starts
+		if (g->stop) break;											// Barrier makes stop visible
+		ln->ok = group_send(g, ln->lane);
+		pthread_barrier_wait(&g->done);								// Frame done on this lane
 	}
-	return retVal;													// Return the old brush colour
+	return 0;
 }
 
-/*-[ Rectangle ]------------------------------------------------------------}
-. Draws a rectangle using the current brush color.
-. RETURN: true for success, false for any failure
+/*-[ SSD1327_CreateFlushGroup ]---------------------------------------------}
+. Creates a group that flushes count devices in parallel. Devices on the
+. same SPI bus, or sharing a Data/Cmd pin, are flushed one after the other
+. in one lane and each other lane gets a worker thread. The workers take
+. the scheduling and cpus of the thread creating the group.
+. RETURN: valid HFLUSHGROUP for success, NULL for any failure
 .--------------------------------------------------------------------------*/
-bool Rectangle (HDC Dc, uint16_t left, uint16_t top, uint16_t right, uint16_t bottom)
+HFLUSHGROUP SSD1327_CreateFlushGroup (const SSD1327_HANDLE* dev, uint8_t count)
 {
-	if (Dc && Dc->inuse)											// Check the DC is valid
+	if (dev == 0 || count == 0 || count > SSD1327_MAX_GROUP) return 0;
+	for (uint8_t i = 0; i < count; i++)
+		if (dev[i] == 0 || dev[i]->spi == 0) return 0;				// Devices must be open
+	struct flush_group* g = calloc(1, sizeof(struct flush_group));
+	if (g == 0) return 0;
+	g->count = count;
+	for (uint8_t i = 0; i < count; i++)
 	{
-		if (left > tab[0].screenwth) left = tab[0].screenwth;		// Make sure left is in screen area
-		if (right > tab[0].screenwth) right = tab[0].screenwth;		// Make sure right is in screen area
-		if (top > tab[0].screenht) top = tab[0].screenht;			// Make sure top is in screen area
-		if (bottom > tab[0].screenht) bottom = tab[0].screenht;		// Make sure top is in screen area
-		if (left < right && top < bottom)							// Make sure left < right and top < bottom
+		g->dev[i] = dev[i];
+		g->devlane[i] = i;											// Own lane until joined
+	}
+	bool joined;
+	do {															// Join lanes of devices that share
+		joined = false;
+		for (uint8_t i = 0; i < count; i++)
+			for (uint8_t j = i + 1; j < count; j++)
+				if (g->devlane[i] != g->devlane[j] &&
+					(SpiGetBus(dev[i]->spi) == SpiGetBus(dev[j]->spi) ||
+					(dev[i]->gpio == dev[j]->gpio && dev[i]->data_cmd_gpio == dev[j]->data_cmd_gpio)))
+				{
+					uint8_t from = g->devlane[j], to = g->devlane[i];
+					if (from < to) { from = to; to = g->devlane[j]; }
+					for (uint8_t k = 0; k < count; k++)
+						if (g->devlane[k] == from) g->devlane[k] = to;	// Lowest number wins
+					joined = true;
+				}
+	} while (joined);
+	uint8_t map[SSD1327_MAX_GROUP];
+	memset(&map[0], 0xFF, sizeof(map));
+	for (uint8_t i = 0; i < count; i++)								// Number lanes 0,1,2.. in device order
+	{
+		if (map[g->devlane[i]] == 0xFF) map[g->devlane[i]] = g->lanes++;
+		g->devlane[i] = map[g->devlane[i]];
+	}
+	if (g->lanes == 1) return g;									// Caller sends everything
+	if (pthread_barrier_init(&g->start, NULL, g->lanes) == 0)
+	{
+		if (pthread_barrier_init(&g->done, NULL, g->lanes) == 0)
 		{
-			uint8_t buf[(right - left) / 2];						// Setup a buffer for a single line
-			memset(&buf[0], Dc->hiBrushColor | Dc->loBrushColor, 
-				(right - left) / 2);								// Fill the temp buffer with the brush colour
-			if (SSD1327_SetWindow(left, top, right, bottom))		// Set the window
+			pthread_mutex_init(&g->gate, NULL);
+			pthread_mutex_lock(&g->gate);							// Workers wait until all exist
+			uint8_t l = 1;
+			for (; l < g->lanes; l++)
 			{
-				GPIO_Output(tab[0].gpio, tab[0].data_cmd_gpio, 1);	// Make sure Data#Cmd high
-				return (SpiWriteBlockRepeat(tab[0].spi, &buf[0],
-					(right - left) / 2, bottom - top, false));		// Transfer buffer repeatedly and return result
+				g->lane[l].group = g;
+				g->lane[l].lane = l;
+				if (pthread_create(&g->lane[l].thread, NULL, group_worker, &g->lane[l]) != 0) break;
 			}
+			g->failed = (l < g->lanes);								// A worker failed, the rest exit
+			pthread_mutex_unlock(&g->gate);
+			if (!g->failed) return g;
+			while (--l > 0) pthread_join(g->lane[l].thread, NULL);
+			pthread_mutex_destroy(&g->gate);
+			pthread_barrier_destroy(&g->done);
 		}
+		pthread_barrier_destroy(&g->start);
 	}
-	return false;													// Return error
+	free(g);
+	return 0;
 }
 
-/*-[ SelectFont ]-----------------------------------------------------------}
-. Set the current font on the device context to the specified font and
-. returns the previosuly selected font.
+/*-[ SSD1327_FlushGroup ]---------------------------------------------------}
+. Flushes every device of the group, the lanes at the same time, and only
+. returns once all are sent so a frame across the panels completes
+. together. Only one thread may flush a group at a time.
+. RETURN: true for success, false for any failure
 .--------------------------------------------------------------------------*/
-uint8_t SelectFont(HDC Dc, uint8_t fontnum)
+bool SSD1327_FlushGroup (HFLUSHGROUP group)
 {
-	uint8_t retVal = 0;												// Preset zero return
-	if (Dc)
+	if (group == 0) return false;
+	if (group->lanes > 1) pthread_barrier_wait(&group->start);		// Workers start their lanes
+	bool retVal = group_send(group, 0);								// Caller sends lane 0
+	if (group->lanes > 1)
 	{
-		retVal = Dc->curfontnum;									// Return will be current font number
-		switch (fontnum)
-		{
-		case FONT8x8:
-			Dc->fontdata = (uint8_t*)&font_8x8_data[0];				// Set 8x8 font data pointer
-			Dc->fontwth = 8;										// Font width is 8 pixels
-			Dc->fontht = 8;											// Font height is 8 pixels
-			Dc->fontstride = 8;										// Font stride is 8 bytes
-			Dc->curfontnum = FONT8x8;								// Set current font number
-			break;
-		case FONT6x8:
-			Dc->fontdata = (uint8_t*)&font_6x8_data[0];				// Set 6x8 font data pointer
-			Dc->fontwth = 6;										// Font width is 6 pixels
-			Dc->fontht = 8;											// Font height is 8 pixels
-			Dc->fontstride = 8;										// Font stride is 8 bytes
-			Dc->curfontnum = FONT6x8;								// Set current font number
-			break;
-		default:
-			Dc->fontdata = (uint8_t*)&font_8x16_data[0];			// Set 8x16 font data pointer
-			Dc->fontwth = 8;										// Font width is 8 pixels
-			Dc->fontht = 16;										// Font height is 8 pixels
-			Dc->fontstride = 16;									// Font stride is 16 bytes
-			Dc->curfontnum = FONT8x16;								// Set current font number
-		}
+		pthread_barrier_wait(&group->done);							// Every lane is sent
+		for (uint8_t l = 1; l < group->lanes; l++)
+			if (!group->lane[l].ok) retVal = false;
 	}
-	return retVal;													// Return previous font number 
+	return retVal;
+}
+
+/*-[ SSD1327_DestroyFlushGroup ]--------------------------------------------}
+. Stops the workers and frees the group, the devices stay open.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool SSD1327_DestroyFlushGroup (HFLUSHGROUP group)
+{
+	if (group == 0) return false;
+	if (group->lanes > 1)
+	{
+		group->stop = true;
+		pthread_barrier_wait(&group->start);						// Workers see stop and exit
+		for (uint8_t l = 1; l < group->lanes; l++)
+			pthread_join(group->lane[l].thread, NULL);
+		pthread_mutex_destroy(&group->gate);
+		pthread_barrier_destroy(&group->done);
+		pthread_barrier_destroy(&group->start);
+	}
+	free(group);
+	return true;
+}
+
+/*-[ INTERNAL: glyph_cache_unlink ]-----------------------------------------}
+. Removes the entry (index + 1) from the LRU list.
+.--------------------------------------------------------------------------*/
+static void glyph_cache_unlink (struct glyph_cache* gc, uint16_t e)
+{
+	struct glyph_entry* g = &gc->entry[e - 1];
+	if (g->prev) gc->entry[g->prev - 1].next = g->next;				// Previous entry now points past us
+		else gc->mru = g->next;										// We were the most recently used
+	if (g->next) gc->entry[g->next - 1].prev = g->prev;				// Next entry now points back past us
+		else gc->lru = g->prev;										// We were the least recently used
+}
+
+/*-[ INTERNAL: glyph_cache_pushfront ]--------------------------------------}
+. Places the entry (index + 1) at the most recently used end of LRU list.
+.--------------------------------------------------------------------------*/
+static void glyph_cache_pushfront (struct glyph_cache* gc, uint16_t e)
+{
+	struct glyph_entry* g = &gc->entry[e - 1];
+	g->prev = 0;													// Nothing in front of us
+	g->next = gc->mru;												// Old most recent is behind us
+	if (gc->mru) gc->entry[gc->mru - 1].prev = e;					// Old most recent points back to us
+		else gc->lru = e;											// List was empty so we are also the least recent
+	gc->mru = e;													// We are now most recently used
+}
+
+/*-[ INTERNAL: glyph_cache_fetch ]------------------------------------------}
+. Returns the expanded 4bpp cell of the glyph in the current font and colours
+. of the device context. On a miss the least recently used entry is recycled
+. and the glyph is expanded into it. Glyphs larger than the cache entry size
+. are expanded into buf which must hold FONT_MAXWTH/2 * FONT_MAXHT bytes.
+. Each device has its own cache so like the SPI writes that follow it only
+. drawing on the same device must be serialized.
+. RETURN: pointer to expanded glyph data, cell width in pixels placed in wth
+.--------------------------------------------------------------------------*/
+static const uint8_t* glyph_cache_fetch (HDC Dc, uint32_t Ch, uint8_t* buf, uint16_t* wth)
+{
+	const FONTDESC* font = Dc->font;
+	struct glyph_cache* gc = &Dc->dev->glyphs;						// Cache of the device
+	uint16_t glyph = Font_GlyphIndex(font, Ch);						// Glyph index of character
+	uint16_t gw = Font_GlyphWidth(font, glyph);						// Width of glyph cell
+	uint8_t* dst = buf;												// Preset expand into callers buffer
+	*wth = gw;														// Return the cell width
+	if (gw / 2 * font->height <= GLYPH_CACHE_MAXBYTES)				// Glyph small enough to cache
+	{
+		if (gc->generation != Font_Generation())					// A font was removed
+		{
+			memset(gc, 0, sizeof(struct glyph_cache));				// Discard the whole cache
+			gc->generation = Font_Generation();
+		}
+		uint32_t key = ((uint32_t)Dc->curfontnum << 24) | ((uint32_t)Dc->loTxtColor << 20)
+			| ((uint32_t)Dc->loBkColor << 16) | glyph;				// Create the cache key
+		uint16_t h = (key * 2654435761u) >> 23;						// Hash key to one of 512 buckets
+		uint16_t e = gc->hash[h];									// First entry in bucket
+		while (e && gc->entry[e - 1].key != key)					// Search the hash chain
+			e = gc->entry[e - 1].hnext;								// Next entry in chain
+		if (e)														// Cache hit
+		{
+			if (gc->mru != e)										// Not already most recently used
+			{
+				glyph_cache_unlink(gc, e);							// Remove from current LRU position
+				glyph_cache_pushfront(gc, e);						// Make it the most recently used
+			}
+			return &gc->entry[e - 1].data[0];						// Return the expanded data
+		}
+		if (gc->count < GLYPH_CACHE_SIZE)							// Cache not yet full
+		{
+			e = ++gc->count;										// Use the next free entry
+		} else {
+			e = gc->lru;											// Recycle the least recently used
+			glyph_cache_unlink(gc, e);								// Remove it from LRU list
+			uint16_t oh = (gc->entry[e - 1].key * 2654435761u) >> 23;	// Bucket of the old key
+			uint16_t* pp = &gc->hash[oh];							// Start at bucket head
+			while (*pp != e) pp = &gc->entry[*pp - 1].hnext;		// Find link that points at old entry
+			*pp = gc->entry[e - 1].hnext;							// Remove it from hash chain
+		}
+		struct glyph_entry* g = &gc->entry[e - 1];
+		g->key = key;												// Set the new key
+		g->wth = gw;												// Hold the cell width
+		g->hnext = gc->hash[h];										// Chain to current bucket head
+		gc->hash[h] = e;											// We are new bucket head
+		glyph_cache_pushfront(gc, e);								// Make it the most recently used
+		dst = &g->data[0];											// Expand into the cache entry
+	}
+	uint8_t bits[FONT_MAXCELLBYTES];								// Buffer to unpack packed glyphs
+	uint16_t stride;
+	const uint8_t* bp = Font_GlyphBits(font, glyph, &bits[0], &stride);// Fetch glyph cell
+	if (font->format == FONT_FORMAT_AA4)							// Anti-aliased font
+		Expand_Blend4bpp(bp, stride, dst, gw / 2, gw, font->height,
+			Dc->loTxtColor, Dc->loBkColor);							// Blend coverage between colours
+	else Expand_1bpp(bp, stride, dst, gw / 2, gw, font->height,
+		Dc->loTxtColor, Dc->loBkColor);								// Expand 1bpp glyph cell to 4bpp
+	return dst;														// Return the expanded data
+}
+
+/*-[ INTERNAL: text_next ]--------------------------------------------------}
+. Returns the next character of UTF-8 text moving the pointer past it, the
+. plain ASCII byte is handled here so it never leaves the caller's loop.
+. Only the local copy has its address taken so the caller's pointer can
+. stay in a register.
+.--------------------------------------------------------------------------*/
+static inline uint32_t text_next (const char** txt)
+{
+	const char* p = *txt;
+	uint8_t b = (uint8_t)(*p);										// Next byte of text
+	if (b < 0x80)													// ASCII character
+	{
+		*txt = p + 1;
+		return b;
+	}
+	uint32_t ch = Font_DecodeUTF8(&p);								// Decode multibyte sequence
+	*txt = p;
+	return ch;
+}
+
+/*-[ INTERNAL: text_blit ]--------------------------------------------------}
+. Copies an expanded glyph scaled up by scale into a 4bpp buffer at (x,y),
+. x even, clipping to the buffer size.
+.--------------------------------------------------------------------------*/
+static void text_blit (uint8_t* buf, uint16_t stride, uint16_t ht, int x, int y, const uint8_t* gp, uint16_t gw, uint16_t gh, uint8_t scale)
+{
+	int cbytes = gw * scale / 2;									// Bytes per row of scaled glyph
+	if (x / 2 + cbytes > stride) cbytes = stride - x / 2;			// Clip to right of buffer
+	if (cbytes <= 0) return;
+	for (int j = 0; j < gh; j++)									// Each row of glyph
+	{
+		int ry = y + j * scale;										// First buffer row it becomes
+		int rows = scale;											// Number of buffer rows
+		if (ry >= ht) break;										// Rest of glyph below buffer
+		if (ry < 0) { rows += ry; ry = 0; }							// Clip to top of buffer
+		if (ry + rows > ht) rows = ht - ry;							// Clip to bottom of buffer
+		if (rows > 0) Expand_ScaleRow4bpp(&gp[j * (gw / 2)], &buf[ry * stride + x / 2],
+			stride, cbytes, rows, scale);							// Replicate row across and down
+	}
+}
+
+/*-[ SSD1327_WriteChar ]----------------------------------------------------}
+. Writes the character in the current font to the screen at position (x,y)
+. **** Note x can only be even value 0,2,4 etc due to two pixel per byte 
+. format and me being to lazy to deal with odds. If you do ask for an odd X
+. value it will write at the value one less so x = 3 would write at x = 2.
+. Font glyph cells are always an even number of pixels wide.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool SSD1327_WriteChar (HDC Dc, uint16_t x, uint16_t y, char Ch)
+{
+	if (Dc && Dc->inuse && Dc->dev->spi && Dc->font)				// Make sure device is open and we have DC and font
+	{
+		uint8_t buf[FONT_MAXWTH / 2 * FONT_MAXHT];					// Buffer for uncached glyphs
+		uint16_t wth;
+		const uint8_t* gp = glyph_cache_fetch(Dc, (uint8_t)Ch, &buf[0], &wth);// Fetch the expanded glyph
+		x &= 0xFFFE;												// Make sure x value even 											
+		if (Dc->textscale > 1)										// Scaled text
+		{
+			if (x >= Dc->dev->screenwth || y >= Dc->dev->screenht) return false;// Character starts off screen
+			uint16_t sw = wth * Dc->textscale;						// Scaled glyph size
+			uint16_t sh = Dc->font->height * Dc->textscale;
+			if (sw > Dc->dev->screenwth - x) sw = Dc->dev->screenwth - x;	// Clip to right of screen
+			if (sh > Dc->dev->screenht - y) sh = Dc->dev->screenht - y;// Clip to bottom of screen
+			uint8_t sbuf[sw / 2 * sh];								// Buffer for scaled glyph
+			text_blit(&sbuf[0], sw / 2, sh, 0, 0, gp, wth, Dc->font->height, Dc->textscale);
+			return screen_write(Dc->dev, x, y, sw, sh, &sbuf[0], sw / 2);// Send scaled glyph as one window
+		}
+		return screen_write(Dc->dev, x, y, wth, Dc->font->height, gp, wth / 2);	// Send glyph straight from cache
+	}
+	return false;													// Return failure
+}
+
+/*-[ SSD1327_WriteText ]----------------------------------------------------}
+. Writes the text in the current font to the screen at position (x,y)
+. **** Note x can only be even value 0,2,4 etc due to two pixel per byte
+. format and me being to lazy to deal with odds. If you do ask for an odd X
+. value it will write at the value one less so x = 3 would write at x = 2.
+. The text is UTF-8 and each character advances by its own glyph width.
+. The whole string is expanded row by row into one buffer and sent as a
+. single window, text past the screen edge is clipped. Text is scaled up
+. by the device context text scale.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool SSD1327_WriteText (HDC Dc, uint16_t x, uint16_t y, const char* txt)
+{
+	if (Dc && Dc->inuse && Dc->dev->spi && Dc->font && txt)			// Make sure device is open and we have font and txt pointer
+	{
+		const FONTDESC* font = Dc->font;
+		uint8_t scale = Dc->textscale;								// Text scale
+		x &= 0xFFFE;												// Make sure x value even 
+		if (x >= Dc->dev->screenwth || y >= Dc->dev->screenht) return false;// Text starts off screen
+		uint16_t wth = 0;											// Width of whole string
+		const char* p = txt;
+		while (*p && wth < Dc->dev->screenwth - x)					// Measure until string ends or screen edge
+			wth += Font_GlyphWidth(font, Font_GlyphIndex(font, text_next(&p))) * scale;
+		if (wth > Dc->dev->screenwth - x) wth = Dc->dev->screenwth - x;// Clip to right of screen
+		uint16_t ht = font->height * scale;							// Height of the text
+		if (ht > Dc->dev->screenht - y) ht = Dc->dev->screenht - y;	// Clip to bottom of screen
+		if (wth == 0) return true;									// Nothing to draw
+		uint16_t stride = wth / 2;									// Bytes per row of the string
+		uint8_t buf[stride * ht];									// Buffer for whole string
+		uint8_t gbuf[FONT_MAXWTH / 2 * FONT_MAXHT];					// Buffer for uncached glyphs
+		uint8_t* dp = &buf[0];										// Glyph position in buffer
+		for (uint16_t used = 0; used < stride && *txt; )			// Until string buffer full
+		{
+			uint16_t gw;
+			const uint8_t* gp = glyph_cache_fetch(Dc, text_next(&txt), &gbuf[0], &gw);// Fetch the expanded glyph
+			uint16_t gbytes = gw * scale / 2;						// Bytes per row of glyph
+			uint16_t cbytes = stride - used;						// Bytes of glyph that fit
+			if (cbytes > gbytes) cbytes = gbytes;					// Whole glyph fits
+			if (scale > 1)											// Scaled glyph
+				text_blit(&buf[0], stride, ht, used * 2, 0, gp, gw, font->height, scale);
+			else if (cbytes == 4 && gbytes == 4)							// Common 8 pixel wide glyph
+			{
+				for (uint16_t j = 0; j < ht; j++)					// Copy each row as one 32 bit move
+					memcpy(&dp[j * stride], &gp[j * 4], 4);
+			} else {
+				for (uint16_t j = 0; j < ht; j++)					// Copy each row of glyph
+					memcpy(&dp[j * stride], &gp[j * gbytes], cbytes);
+			}
+			dp += cbytes;											// Next glyph position
+			used += cbytes;											// Bytes of row used
+		}
+		return screen_write(Dc->dev, x, y, wth, ht, &buf[0], wth / 2);// Send whole string in one transfer
+	}
+	return false;													// Return failure
+}
+
+/*-[ INTERNAL: text_ellipsis ]----------------------------------------------}
+. Shortens the line so it and a following "..." fit in wth pixels.
+.--------------------------------------------------------------------------*/
+static void text_ellipsis (const FONTDESC* font, const char* txt, struct text_line* ln, uint16_t wth)
+{
+	uint16_t ew = 3 * Font_GlyphWidth(font, Font_GlyphIndex(font, '.'));// Width of ellipsis
+	uint32_t w = 0;
+	const char* p = &txt[ln->start];
+	const char* end = p + ln->len;
+	while (p < end)													// Take characters while they fit
+	{
+		const char* q = p;
+		uint16_t gw = Font_GlyphWidth(font, Font_GlyphIndex(font, text_next(&q)));
+		if (w + gw + ew > wth) break;								// Next character would not fit
+		w += gw;
+		p = q;
+	}
+	ln->len = p - &txt[ln->start];									// Bytes that fit
+	ln->wth = w + ew;												// Width with ellipsis
+	ln->ellipsis = 1;
+}
+
+/*-[ INTERNAL: text_layout ]------------------------------------------------}
+. Breaks the text into lines that fit wth x ht in the font of the device
+. context. The layout comes from the cache if the same text was laid out
+. the same way before, otherwise it is measured into the cache slot.
+. RETURN: pointer to the layout
+.--------------------------------------------------------------------------*/
+static const struct text_layout* text_layout (HDC Dc, const char* txt, uint16_t wth, uint16_t ht, uint16_t flags)
+{
+	const FONTDESC* font = Dc->font;
+	uint64_t hash = 14695981039346656037ull;						// FNV-1a offset basis
+	uint32_t len = 0;
+	for (const char* p = txt; *p && len < 0xFFFF; p++, len++)		// Hash the text
+		hash = (hash ^ (uint8_t)(*p)) * 1099511628211ull;			// FNV-1a prime
+	flags &= LAYOUT_FLAGS;											// Only flags that change breaks
+	struct text_layout* l = &Dc->dev->layouts[(hash ^ (hash >> 32) ^ Dc->curfontnum
+		^ wth) & (LAYOUT_CACHE_SIZE - 1)];							// Slot for this layout
+	if (l->valid && l->hash == hash && l->textlen == len && l->fontnum == Dc->curfontnum
+		&& l->wth == wth && l->ht == ht && l->flags == flags
+		&& l->generation == Font_Generation()) return l;			// Cache hit, no measuring
+	l->hash = hash;													// Measure into this slot
+	l->generation = Font_Generation();
+	l->textlen = len;
+	l->wth = wth;
+	l->ht = ht;
+	l->flags = flags;
+	l->fontnum = Dc->curfontnum;
+	l->valid = 1;
+	l->numlines = 0;
+	l->maxwth = 0;
+	uint16_t maxlines = (flags & DT_SINGLELINE) ? 1 : (ht + font->height - 1) / font->height;
+	if (maxlines == 0) maxlines = 1;								// Always lay out one line
+	if (maxlines > LAYOUT_MAXLINES) maxlines = LAYOUT_MAXLINES;
+	uint32_t pos = 0;												// Start of next line
+	while (pos < len && l->numlines < maxlines)
+	{
+		uint32_t p = pos, end = len, next = len;					// Preset line runs to end of text
+		uint32_t w = 0, brk = 0, brkw = 0;							// Width and last word break
+		bool inspace = false;
+		while (p < len)
+		{
+			const char* q = &txt[p];
+			uint32_t ch = text_next(&q);							// Next character
+			if (ch == '\n' && !(flags & DT_SINGLELINE))				// Newline breaks the line
+			{
+				end = p;
+				next = q - txt;
+				break;
+			}
+			uint16_t gw = Font_GlyphWidth(font, Font_GlyphIndex(font, ch));
+			if (ch == ' ' && !inspace)								// Start of spaces, a place to break
+			{
+				brk = p;
+				brkw = w;
+			}
+			inspace = (ch == ' ');
+			if ((flags & DT_WORDBREAK) && w + gw > wth && p > pos)	// Character does not fit line
+			{
+				if (brk > pos)										// Break at last space
+				{
+					end = brk;
+					w = brkw;
+					next = brk;
+					while (next < len && txt[next] == ' ') next++;	// Spaces are not carried to next line
+				} else end = next = p;								// Single word so break it here
+				break;
+			}
+			w += gw;
+			p = q - txt;
+		}
+		struct text_line* ln = &l->line[l->numlines++];
+		ln->start = pos;
+		ln->len = end - pos;
+		ln->wth = (w > 0xFFFF) ? 0xFFFF : w;
+		ln->ellipsis = 0;
+		pos = next;
+	}
+	for (uint16_t i = 0; i < l->numlines; i++)
+	{
+		struct text_line* ln = &l->line[i];
+		if ((flags & DT_END_ELLIPSIS) && (ln->wth > wth ||
+			(i == l->numlines - 1 && pos < len)))					// Line too wide or text left over
+			text_ellipsis(font, txt, ln, wth);
+		if (ln->wth > l->maxwth) l->maxwth = ln->wth;				// Track widest line
+	}
+	return l;
+}
+
+/***************************************************************************}
+{						 DEVICE CONTEXT ROUTINES	                        }
+{***************************************************************************/
+
+/*-[ GetDc ]----------------------------------------------------------------}
+. Fetches the next available device context handle (HDC) bound to the
+. device, safe from any thread. If all SSD1327_MAX_DC handles are in use
+. it will return NULL. DCs on the same device must not draw at the same
+. time, DCs on different devices may.
+.--------------------------------------------------------------------------*/
+HDC GetDC (SSD1327_HANDLE dev)
+{
+	if (dev == 0) return 0;											// Every DC draws on a device
+	for (uint16_t b = 0; b < MAX_DC_BLOCK; b++)						// Search each block
+	{
+		struct dc_block* blk = __atomic_load_n(&dc_pool[b], __ATOMIC_ACQUIRE);
+		if (blk == 0)												// Pool needs to grow
+		{
+			struct dc_block* nb = aligned_alloc(CACHE_LINE, sizeof(struct dc_block));
+			if (nb == 0) return 0;									// Out of memory
+			memset(nb, 0, sizeof(struct dc_block));
+			if (__atomic_compare_exchange_n(&dc_pool[b], &blk, nb, false,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) blk = nb;		// Our block went in
+			else free(nb);											// Another thread grew it first, blk is theirs
+		}
+		uint32_t used = __atomic_load_n(&blk->used, __ATOMIC_RELAXED);
+		while (used != 0xFFFFFFFF)									// Block has a free DC
+		{
+			uint16_t i = __builtin_ctz(~used);						// Lowest free DC
+			if (__atomic_compare_exchange_n(&blk->used, &used, used | (1u << i), true,
+				__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))				// Claimed it, on failure used is reloaded
+			{
+				HDC Dc = &blk->dc[i];
+				Dc->inuse = 1;										// Set the in use flag
+				SetBkColor(Dc, 0);									// Set background colour black
+				SetTextColor(Dc, 15);								// Set text colour white
+				SetDCBrushColor(Dc, 8);								// Set brush colour mid gray
+				SetDCPenColor(Dc, 8);								// Set pen colour mid gray
+				Dc->font = Font_Get(FONT8x16);						// Default font is 8x16
+				Dc->curfontnum = FONT8x16;							// Set current font number
+				Dc->textscale = 1;									// Text is not scaled
+				Dc->priority = 0;									// Background priority
+				Dc->deadline = 0;									// No deadline
+				__atomic_store_n(&Dc->dev, dev, __ATOMIC_RELAXED);	// Device it draws on, read by SSD1327_Close
+				return Dc;											// Return the handle
+			}
+		}
+	}
+	return 0;														// No DC available
+}
+
+/*-[ ReleaseDc ]------------------------------------------------------------}
+.  Releases the device context, safe from any thread
+.--------------------------------------------------------------------------*/
+void ReleaseDC (HDC Dc)
+{
+	if (Dc && Dc->inuse)											// Check the DC is valid and in use
+	{
+		for (uint16_t b = 0; b < MAX_DC_BLOCK; b++)					// Find its block
+		{
+			struct dc_block* blk = __atomic_load_n(&dc_pool[b], __ATOMIC_ACQUIRE);
+			if (blk == 0) break;									// Not one of ours
+			if (Dc >= &blk->dc[0] && Dc < &blk->dc[DC_BLOCK])
+			{
+				Dc->inuse = 0;										// DC is available again
+				__atomic_fetch_and(&blk->used, ~(1u << (Dc - &blk->dc[0])), __ATOMIC_RELEASE);
+				return;
+			}
+		}
+	}
+}
+
+/*-[ SetBkColor ]-----------------------------------------------------------}
+.  Sets the current device context background color to the specified color 
+.  and returns the previously set background color
+.--------------------------------------------------------------------------*/
+COLORREF SetBkColor(HDC Dc, COLORREF Color)
+{
+	COLORREF retVal = 0;											// Preset zero return
+	if (Dc && Dc->inuse)											// Check the DC is valid and in use
+	{
+		retVal = Dc->loBkColor;										// Return current low pixel background colour
+		Dc->hiBkColor = Color << 4;									// Set the high pixel background colour 
+		Dc->loBkColor = Color & 0xF;								// Set the low pixel background colour
+	}
+	return retVal;													// Return the old background colour
+}
+
+/*-[ SetTextColor ]---------------------------------------------------------}
+.  Sets the current device context text color to the specified color and 
+.  returns the previously set text color
+.--------------------------------------------------------------------------*/
+COLORREF SetTextColor (HDC Dc, COLORREF Color)
+{
+	COLORREF retVal = 0;											// Preset zero return
+	if (Dc && Dc->inuse)											// Check the DC is valid and in use
+	{
+		retVal = Dc->loTxtColor;									// Return current low pixel text colour
+		Dc->hiTxtColor = Color << 4;								// Set the high pixel text colour 
+		Dc->loTxtColor = Color & 0xF;								// Set the low pixel text colour
+	}
+	return retVal;													// Return the old text colour
+}
+
+/*-[ SetDCPenColor ]--------------------------------------------------------}
+.  Sets the current device context pen color to the specified color and
+. returns the previously set pen color
+.--------------------------------------------------------------------------*/
+COLORREF SetDCPenColor (HDC Dc, COLORREF Color)
+{
+	COLORREF retVal = 0;											// Preset zero return
+	if (Dc && Dc->inuse)											// Check the DC is valid and in use
+	{
+		retVal = Dc->loPenColor;									// Return current low pixel pen colour
+		Dc->hiPenColor = Color << 4;								// Set the high pixel pen colour 
+		Dc->loPenColor = Color & 0xF;								// Set the low pixel pen colour
+	}
+	return retVal;													// Return the old pen colour
+}
+
+/*-[ SetDCBrushColor ]------------------------------------------------------}
+.  Sets the current device context brush color to the specified color and 
+. returns the previously set brush color
+.--------------------------------------------------------------------------*/
+COLORREF SetDCBrushColor (HDC Dc, COLORREF Color)
+{
+	COLORREF retVal = 0;											// Preset zero return
+	if (Dc && Dc->inuse)											// Check the DC is valid and in use
+	{
+		retVal = Dc->loBrushColor;									// Return current low pixel brush colour
+		Dc->hiBrushColor = Color << 4;								// Set the high pixel brush colour 
+		Dc->loBrushColor = Color & 0xF;								// Set the low pixel brush colour
+	}
+	return retVal;													// Return the old brush colour
+}
+
+/*-[ SetDCPriority ]--------------------------------------------------------}
+. Sets the flush priority of what is drawn with the device context, 0 is
+. background and higher is more urgent, and returns the previous priority.
+. The deadline is how many milliseconds after it is queued the drawing
+. should be on screen, 0 for none. Both are carried with drawing queued to
+. a compositor.
+.--------------------------------------------------------------------------*/
+uint8_t SetDCPriority (HDC Dc, uint8_t priority, uint16_t deadline)
+{
+	uint8_t retVal = 0;												// Preset zero return
+	if (Dc && Dc->inuse)											// Check the DC is valid and in use
+	{
+		retVal = Dc->priority;										// Return current priority
+		Dc->priority = priority;									// Set the new priority
+		Dc->deadline = deadline;									// Set the new deadline
+	}
+	return retVal;													// Return the old priority
+}
+
+/*-[ GetDCPriority ]--------------------------------------------------------}
+. RETURN: the device context flush priority
+.--------------------------------------------------------------------------*/
+uint8_t GetDCPriority (HDC Dc)
+{
+	return (Dc && Dc->inuse) ? Dc->priority : 0;
+}
+
+/*-[ GetDCDeadline ]--------------------------------------------------------}
+. RETURN: the device context deadline in milliseconds, 0 for none
+.--------------------------------------------------------------------------*/
+uint16_t GetDCDeadline (HDC Dc)
+{
+	return (Dc && Dc->inuse) ? Dc->deadline : 0;
+}
+
+/*-[ GetBkColor ]-----------------------------------------------------------}
+. RETURN: the current device context background color
+.--------------------------------------------------------------------------*/
+COLORREF GetBkColor (HDC Dc)
+{
+	return (Dc && Dc->inuse) ? Dc->loBkColor : 0;					// Low pixel holds the colour
+}
+
+/*-[ GetTextColor ]---------------------------------------------------------}
+. RETURN: the current device context text color
+.--------------------------------------------------------------------------*/
+COLORREF GetTextColor (HDC Dc)
+{
+	return (Dc && Dc->inuse) ? Dc->loTxtColor : 0;					// Low pixel holds the colour
+}
+
+/*-[ GetDCPenColor ]--------------------------------------------------------}
+. RETURN: the current device context pen color
+.--------------------------------------------------------------------------*/
+COLORREF GetDCPenColor (HDC Dc)
+{
+	return (Dc && Dc->inuse) ? Dc->loPenColor : 0;					// Low pixel holds the colour
+}
+
+/*-[ GetDCBrushColor ]------------------------------------------------------}
+. RETURN: the current device context brush color
+.--------------------------------------------------------------------------*/
+COLORREF GetDCBrushColor (HDC Dc)
+{
+	return (Dc && Dc->inuse) ? Dc->loBrushColor : 0;				// Low pixel holds the colour
+}
+
+/*-[ Rectangle ]------------------------------------------------------------}
+. Draws a rectangle using the current brush color.
+. **** Note left and right are rounded down to even values like WriteText.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Rectangle (HDC Dc, uint16_t left, uint16_t top, uint16_t right, uint16_t bottom)
+{
+	if (Dc && Dc->inuse)											// Check the DC is valid
+	{
+		left &= 0xFFFE;												// Whole bytes so window and data agree
+		right &= 0xFFFE;
+		if (left > Dc->dev->screenwth) left = Dc->dev->screenwth;	// Make sure left is in screen area
+		if (right > Dc->dev->screenwth) right = Dc->dev->screenwth;	// Make sure right is in screen area
+		if (top > Dc->dev->screenht) top = Dc->dev->screenht;		// Make sure top is in screen area
+		if (bottom > Dc->dev->screenht) bottom = Dc->dev->screenht;	// Make sure top is in screen area
+		if (left < right && top < bottom)							// Make sure left < right and top < bottom
+		{
+			uint8_t buf[(right - left) / 2];						// Setup a buffer for a single line
+			memset(&buf[0], Dc->hiBrushColor | Dc->loBrushColor, 
+				(right - left) / 2);								// Fill the temp buffer with the brush colour
+			if (shadow_only(Dc->dev, left, top, right, bottom))		// Rectangle around a running scroll
+			{
+				shadow_fill(Dc->dev, left & 0xFFFE, top, (right - left) & 0xFFFE, bottom - top,
+					Dc->hiBrushColor | Dc->loBrushColor);
+				shadow_damage(Dc->dev, left & 0xFFFE, top, (right - left) & 0xFFFE, bottom - top);
+				return damage_commit(Dc->dev);
+			}
+			if (SSD1327_SetWindow(Dc->dev, left, top, right, bottom))// Set the window
+			{
+				GPIO_Output(Dc->dev->gpio, Dc->dev->data_cmd_gpio, 1);// Make sure Data#Cmd high
+				shadow_fill(Dc->dev, left & 0xFFFE, top, (right - left) & 0xFFFE, bottom - top,
+					Dc->hiBrushColor | Dc->loBrushColor);			// Shadow follows the screen
+				return (SpiWriteBlockRepeat(Dc->dev->spi, &buf[0],
+					(right - left) / 2, bottom - top, false));		// Transfer buffer repeatedly and return result
+			}
+		}
+	}
+	return false;													// Return error
+}
+
+/*-[ SSD1327_ConsoleWrite ]-------------------------------------------------}
+. Adds the UTF-8 text to the bottom of the screen as a scrolling console,
+. each newline starting another line and a final newline being ignored.
+. GDDRAM is used as a ring, each new line is written over the rows about
+. to leave the top and the start line moved on, so one line costs only its
+. own pixels and a two byte command. Lines are clipped at the screen edge.
+. While deferred the lines and the new start line go out with the flush.
+. **** Note other drawing still uses GDDRAM rows, so once the console has
+. moved the start line, y positions are relative to it.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool SSD1327_ConsoleWrite (HDC Dc, const char* txt)
+{
+	if (Dc && Dc->inuse && Dc->dev->spi && Dc->font && txt)			// Make sure device is open and we have font and txt pointer
+	{
+		const FONTDESC* font = Dc->font;
+		uint8_t scale = Dc->textscale;								// Text scale
+		uint16_t ht = font->height * scale;							// Height of a console line
+		if (ht > Dc->dev->screenht) return false;					// Line taller than screen
+		uint16_t stride = Dc->dev->screenwth / 2;					// Lines are the full screen width
+		uint8_t buf[stride * ht];									// Buffer for one line
+		uint8_t gbuf[FONT_MAXWTH / 2 * FONT_MAXHT];					// Buffer for uncached glyphs
+		uint16_t start = Dc->dev->startline;
+		do {
+			memset(&buf[0], Dc->hiBkColor | Dc->loBkColor, sizeof(buf));// Line starts as background
+			for (uint16_t x = 0; *txt && *txt != '\n'; )			// Each character of line
+			{
+				uint32_t ch = text_next(&txt);
+				if (x >= Dc->dev->screenwth) continue;				// Rest of line is off screen
+				uint16_t gw;
+				const uint8_t* gp = glyph_cache_fetch(Dc, ch, &gbuf[0], &gw);// Fetch the expanded glyph
+				text_blit(&buf[0], stride, ht, x, 0, gp, gw, font->height, scale);
+				x += gw * scale;									// Next glyph position
+			}
+			for (uint16_t j = 0; j < ht; j++)						// Line replaces rows leaving the top
+			{
+				uint16_t row = (start + j) % Dc->dev->screenht;		// GDDRAM row wraps as a ring
+				memcpy(&Dc->dev->shadow[row][0], &buf[j * stride], stride);
+				damage_add(Dc->dev, row, 0, stride - 1);
+			}
+			start = (start + ht) % Dc->dev->screenht;				// Those rows are now the bottom
+		} while (*txt == '\n' && *++txt);							// Another line follows newline
+		bool retVal = damage_commit(Dc->dev);						// Send the new lines unless deferred
+		if (Dc->dev->deferred)										// Scroll goes out with the flush
+		{
+			Dc->dev->startline = start;
+			Dc->dev->linepending = true;
+		} else if (!SSD1327_SetStartLine(Dc->dev, start)) retVal = false;// Scroll them onto the bottom
+		return retVal;
+	}
+	return false;													// Return failure
+}
+
+/*-[ SelectFont ]-----------------------------------------------------------}
+. Set the current font on the device context to the specified font and
+. returns the previosuly selected font. The font number is any id returned
+. by the font registry, an unknown id selects FONT8x16.
+.--------------------------------------------------------------------------*/
+uint8_t SelectFont(HDC Dc, uint8_t fontnum)
+{
+	uint8_t retVal = 0;												// Preset zero return
+	if (Dc)
+	{
+		retVal = Dc->curfontnum;									// Return will be current font number
+		const FONTDESC* font = Font_Get(fontnum);					// Look font up in registry
+		if (font == 0)												// No such font
+		{
+			fontnum = FONT8x16;										// Use the default font
+			font = Font_Get(FONT8x16);
+		}
+		Dc->font = font;											// Set font on DC
+		Dc->curfontnum = fontnum;									// Set current font number
+	}
+	return retVal;													// Return previous font number 
+}
+
+/*-[ GetCurrentFont ]-------------------------------------------------------}
+. RETURN: the font number currently selected on the device context
+.--------------------------------------------------------------------------*/
+uint8_t GetCurrentFont (HDC Dc)
+{
+	return (Dc) ? Dc->curfontnum : 0;
+}
+
+/*-[ DrawNumber ]-----------------------------------------------------------}
+. Draws an integer at (x,y) like WriteText, padded to width characters by
+. the DN_ flags. With DN_DECIMALS(n) the value is fixed point, so 1234 with
+. two decimals draws 12.34. The digits are converted directly with no
+. format string to parse.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool DrawNumber (HDC Dc, uint16_t x, uint16_t y, int32_t value, uint8_t width, uint16_t flags)
+{
+	char buf[DN_MAXWIDTH * 2 + 2];									// Number grows left and padding right from middle
+	char* p = &buf[DN_MAXWIDTH];									// Digits are written leftwards from here
+	char* end = p;													// Left justify padding is written from here
+	uint8_t decimals = (flags >> 8) & 0xF;							// Fixed point decimal places
+	if (decimals > 9) decimals = 9;
+	if (width > DN_MAXWIDTH) width = DN_MAXWIDTH;
+	uint32_t mag = (value < 0) ? 0u - (uint32_t)value : (uint32_t)value;// Magnitude, safe for INT32_MIN
+	uint8_t n = 0;													// Digits written
+	do {
+		if (decimals && n == decimals) *--p = '.';					// Decimal point after fraction digits
+		*--p = '0' + mag % 10;										// Next digit
+		mag /= 10;
+		n++;
+	} while (mag || n <= decimals);									// Always a digit before the point
+	char sign = (value < 0) ? '-' : (flags & DN_SIGN) ? '+' : 0;	// Sign character if any
+	uint8_t len = (end - p) + (sign ? 1 : 0);						// Characters so far
+	if (flags & DN_ZEROPAD)
+		for (; len < width; len++) *--p = '0';						// Zeros go between sign and digits
+	if (sign) *--p = sign;
+	if (flags & DN_LEFT)
+		for (; len < width; len++) *end++ = ' ';					// Spaces after number
+	else for (; len < width; len++) *--p = ' ';						// Spaces before number
+	*end = 0;														// Terminate the string
+	return SSD1327_WriteText(Dc, x, y, p);							// Expand straight into one window
+}
+
+/*-[ DrawText ]-------------------------------------------------------------}
+. Draws UTF-8 text in the current font laid out in the rectangle by the DT_
+. flags. Lines break at newlines and with DT_WORDBREAK between words at the
+. rectangle width. The rectangle is filled with the background colour, the
+. text drawn over it and the whole rectangle sent as a single window. Line
+. breaks are cached by a hash of the text so redrawing the same text does
+. no measuring. With DT_CALCRECT nothing is drawn and the rectangle right
+. and bottom are set to fit the text.
+. **** Note rect left is rounded down to an even value like WriteText.
+. RETURN: height of the text in pixels, 0 for any failure
+.--------------------------------------------------------------------------*/
+uint16_t DrawText (HDC Dc, RECT* rect, const char* txt, uint16_t flags)
+{
+	if (Dc && Dc->inuse && Dc->dev->spi && Dc->font && rect && txt)	// Make sure device is open and we have font, rect and txt
+	{
+		const FONTDESC* font = Dc->font;
+		uint8_t scale = Dc->textscale;								// Text scale
+		uint16_t fht = font->height * scale;						// Height of a line
+		uint16_t left = rect->left & 0xFFFE;						// Make sure left value even
+		if (flags & DT_CALCRECT)									// Measure only
+		{
+			uint16_t wth = ((flags & DT_WORDBREAK) && rect->right > left) ?
+				(rect->right - left) / scale : 0xFFFF;				// Only word break limits the width
+			const struct text_layout* l = text_layout(Dc, txt, wth, 0xFFFF, flags);
+			uint16_t textht = l->numlines * fht;					// Height of all lines
+			rect->right = rect->left + l->maxwth * scale;			// Rectangle now fits text
+			rect->bottom = rect->top + textht;
+			return textht;
+		}
+		uint16_t right = (rect->right > Dc->dev->screenwth) ? Dc->dev->screenwth : rect->right;
+		uint16_t bottom = (rect->bottom > Dc->dev->screenht) ? Dc->dev->screenht : rect->bottom;
+		if (right <= left + 1 || bottom <= rect->top) return 0;		// Nothing of rectangle on screen
+		uint16_t wth = (right - left) & 0xFFFE;						// Whole bytes of rectangle
+		uint16_t ht = bottom - rect->top;
+		const struct text_layout* l = text_layout(Dc, txt, wth / scale, (ht + scale - 1) / scale, flags);// Layout is in unscaled pixels
+		uint16_t textht = l->numlines * fht;						// Height of all lines
+		uint16_t stride = wth / 2;									// Bytes per row of rectangle
+		uint8_t buf[stride * ht];									// Buffer for whole rectangle
+		uint8_t gbuf[FONT_MAXWTH / 2 * FONT_MAXHT];					// Buffer for uncached glyphs
+		memset(&buf[0], Dc->hiBkColor | Dc->loBkColor, stride * ht);// Fill with background colour
+		int y = 0;													// Top of first line
+		if (flags & DT_VCENTER) y = ((int)ht - textht) / 2;			// Centre lines vertically
+			else if (flags & DT_BOTTOM) y = (int)ht - textht;		// Lines end at bottom
+		for (uint16_t i = 0; i < l->numlines && y < ht; i++, y += fht)
+		{
+			const struct text_line* ln = &l->line[i];
+			if (y + fht <= 0) continue;								// Line above rectangle
+			int x = 0;												// Left aligned
+			uint32_t lw = ln->wth * scale;							// Scaled width of line
+			if (lw < wth)											// Line narrower than rectangle
+			{
+				if (flags & DT_CENTER) x = ((wth - lw) / 2) & 0xFFFE;	// Centre line
+					else if (flags & DT_RIGHT) x = (wth - lw) & 0xFFFE;// Right align line
+			}
+			const char* p = &txt[ln->start];
+			const char* end = p + ln->len;
+			for (int dots = ln->ellipsis ? 3 : 0; x < wth && (p < end || dots > 0); )
+			{
+				uint16_t gw;
+				uint32_t ch = (p < end) ? text_next(&p) : (dots--, '.');// Text then any ellipsis
+				const uint8_t* gp = glyph_cache_fetch(Dc, ch, &gbuf[0], &gw);// Fetch the expanded glyph
+				text_blit(&buf[0], stride, ht, x, y, gp, gw, font->height, scale);
+				x += gw * scale;
+			}
+		}
+		if (screen_write(Dc->dev, left, rect->top, wth, ht, &buf[0], wth / 2))	// Send rectangle in one transfer
+			return textht;
+	}
+	return 0;														// Return failure
+}
+
+/*-[ GetTextExtent ]--------------------------------------------------------}
+. Measures UTF-8 text in the current font as one line, the result shares
+. the DrawText layout cache.
+. RETURN: true for success and size set, false for any failure
+.--------------------------------------------------------------------------*/
+bool GetTextExtent (HDC Dc, const char* txt, SIZE* size)
+{
+	if (Dc && Dc->inuse && Dc->font && txt && size)					// Make sure we have font, txt and size
+	{
+		const struct text_layout* l = text_layout(Dc, txt, 0xFFFF, Dc->font->height, DT_SINGLELINE);
+		uint32_t cx = (uint32_t)l->maxwth * Dc->textscale;			// Scaled width of the line
+		size->cx = (cx > 0xFFFF) ? 0xFFFF : cx;
+		size->cy = Dc->font->height * Dc->textscale;				// Scaled height of the font
+		return true;
+	}
+	return false;
+}
+
+/*-[ SetTextScale ]---------------------------------------------------------}
+. Sets the device context text scale, 1 to 4, and returns the previous
+. scale. Each font pixel is drawn as a scale x scale block so large
+. readouts need no large fonts.
+.--------------------------------------------------------------------------*/
+uint8_t SetTextScale (HDC Dc, uint8_t scale)
+{
+	uint8_t retVal = 0;												// Preset zero return
+	if (Dc)
+	{
+		retVal = Dc->textscale;										// Return will be current scale
+		if (scale >= 1 && scale <= 4) Dc->textscale = scale;		// Set the new scale if valid
+	}
+	return retVal;													// Return previous scale
+}
+
+/*-[ GetTextScale ]---------------------------------------------------------}
+. RETURN: the device context text scale, 1 to 4
+.--------------------------------------------------------------------------*/
+uint8_t GetTextScale (HDC Dc)
+{
+	return (Dc) ? Dc->textscale : 0;
+}
+
+/*-[ INTERNAL: isqrt ]------------------------------------------------------}
+. RETURN: floor of the square root of v
+.--------------------------------------------------------------------------*/
+static uint32_t isqrt (uint64_t v)
+{
+	uint64_t r = 0, bit = 1ull << 62;								// Highest power of 4 in range
+	while (bit > v) bit >>= 2;
+	while (bit)														// Digit by digit square root
+	{
+		if (v >= r + bit)
+		{
+			v -= r + bit;
+			r = (r >> 1) + bit;
+		} else r >>= 1;
+		bit >>= 2;
+	}
+	return r;
+}
+
+/*-[ INTERNAL: ellipse_rows ]-----------------------------------------------}
+. Finds the first and last pixel of rows y0 to y1-1 of the ellipse that
+. fits the rectangle (right and bottom exclusive), row y0 is placed at
+. xl[0]. Pixel centres are tested in doubled coordinates so even and odd
+. sized ellipses are both exact. The axes can be up to 65535 so the square
+. terms are multiplied unsigned, 65535^4 still fits 64 bits.
+. RETURN: number of rows placed in xl and xr
+.--------------------------------------------------------------------------*/
+static int ellipse_rows (int left, int top, int right, int bottom, int y0, int y1, int16_t* xl, int16_t* xr)
+{
+	int64_t a = right - left, b = bottom - top;						// Doubled semi axes
+	for (int y = y0; y < y1; y++)
+	{
+		int64_t dy = 2 * y + 1 - (top + bottom);					// Doubled distance from centre
+		int dx = isqrt((uint64_t)(a * a) * (uint64_t)(b * b - dy * dy)) / b;// Doubled half width of row
+		xl[y - y0] = (left + right - 1 - dx + 1) >> 1;				// First pixel centre inside
+		xr[y - y0] = (left + right - 1 + dx) >> 1;					// Last pixel centre inside
+		if (xl[y - y0] > xr[y - y0]) xl[y - y0] = xr[y - y0] = (left + right - 1) >> 1;
+	}
+	return y1 - y0;
+}
+
+/*-[ INTERNAL: ellipse_outline ]--------------------------------------------}
+. Gives the left outline of row i as xl[i] to the returned pixel. The
+. outline runs to just short of where the further in neighbouring row
+. starts so the edge has no gaps. The right outline mirrors it. Edge is set
+. for the top and bottom row of the ellipse, otherwise both neighbouring
+. rows must be in xl.
+.--------------------------------------------------------------------------*/
+static int ellipse_outline (const int16_t* xl, int i, bool edge)
+{
+	if (edge) return -1;											// Top and bottom rows are all outline
+	int n = (xl[i - 1] > xl[i + 1]) ? xl[i - 1] : xl[i + 1];		// Further in neighbouring row start
+	return (n - 1 > xl[i]) ? n - 1 : xl[i];
+}
+
+/*-[ INTERNAL: arc_contains ]-----------------------------------------------}
+. Checks if the direction (px,py) lies on the arc that runs anticlockwise
+. from direction (sx,sy) to (ex,ey), all with y measured upwards.
+.--------------------------------------------------------------------------*/
+static bool arc_contains (int64_t sx, int64_t sy, int64_t ex, int64_t ey, int64_t px, int64_t py)
+{
+	int64_t se = sx * ey - sy * ex;									// Cross products give sides
+	int64_t sp = sx * py - sy * px;
+	int64_t pe = px * ey - py * ex;
+	if (se == 0 && sx * ex + sy * ey > 0) return true;				// Start and end equal, whole ellipse
+	if (se >= 0) return (sp >= 0 && pe >= 0);						// Arc no more than half turn
+	return (sp >= 0 || pe >= 0);									// Arc more than half turn
+}
+
+/*-[ MoveTo ]---------------------------------------------------------------}
+. Moves the current position of the device context to (x,y).
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool MoveTo (HDC Dc, int16_t x, int16_t y)
+{
+	if (Dc && Dc->inuse)											// Check the DC is valid
+	{
+		Dc->curx = x;												// Set current position
+		Dc->cury = y;
+		return true;
+	}
+	return false;
+}
+
+/*-[ LineTo ]---------------------------------------------------------------}
+. Draws a line in the pen colour from the current position up to but not
+. including (x,y), which becomes the current position. Each row of the
+. line is one span and the spans go to the screen as a few windows.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool LineTo (HDC Dc, int16_t x, int16_t y)
+{
+	if (Dc && Dc->inuse && Dc->dev->spi)							// Make sure device is open and DC is valid
+	{
+		int x0 = Dc->curx, y0 = Dc->cury;							// Start at current position
+		int dx = (x > x0) ? x - x0 : x0 - x, sx = (x0 < x) ? 1 : -1;
+		int dy = (y > y0) ? y0 - y : y - y0, sy = (y0 < y) ? 1 : -1;
+		int err = dx + dy;											// Bresenham error term
+		int runy = y0, runl = x0, runr = x0;						// Pixels on current row
+		bool run = false;
+		while (x0 != x || y0 != y)									// Every pixel except the end point
+		{
+			if (run && y0 != runy)									// Moved to a new row
+			{
+				span_fill(Dc->dev, runy, runl, runr, Dc->hiPenColor, Dc->loPenColor);
+				run = false;
+			}
+			if (!run) { runy = y0; runl = runr = x0; run = true; }	// Start a new run
+			if (x0 < runl) runl = x0;								// Grow run to include pixel
+			if (x0 > runr) runr = x0;
+			int e2 = 2 * err;
+			if (e2 >= dy) { err += dy; x0 += sx; }					// Step across
+			if (e2 <= dx) { err += dx; y0 += sy; }					// Step down
+		}
+		if (run) span_fill(Dc->dev, runy, runl, runr, Dc->hiPenColor, Dc->loPenColor);
+		Dc->curx = x;												// End point is new position
+		Dc->cury = y;
+		return damage_commit(Dc->dev);								// Send the changed spans
+	}
+	return false;
+}
+
+/*-[ FrameRect ]------------------------------------------------------------}
+. Draws a one pixel border in the pen colour just inside the rectangle,
+. right and bottom are exclusive as with Rectangle.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool FrameRect (HDC Dc, uint16_t left, uint16_t top, uint16_t right, uint16_t bottom)
+{
+	if (Dc && Dc->inuse && Dc->dev->spi && left < right && top < bottom)// Make sure device is open, DC valid and rectangle not empty
+	{
+		span_fill(Dc->dev, top, left, right - 1, Dc->hiPenColor, Dc->loPenColor);	// Top edge
+		span_fill(Dc->dev, bottom - 1, left, right - 1, Dc->hiPenColor, Dc->loPenColor);// Bottom edge
+		for (int y = top + 1; y < bottom - 1; y++)					// Sides
+		{
+			span_fill(Dc->dev, y, left, left, Dc->hiPenColor, Dc->loPenColor);
+			span_fill(Dc->dev, y, right - 1, right - 1, Dc->hiPenColor, Dc->loPenColor);
+		}
+		return damage_commit(Dc->dev);								// Send the changed spans
+	}
+	return false;
+}
+
+/*-[ Ellipse ]--------------------------------------------------------------}
+. Draws the ellipse that fits the rectangle, outlined in the pen colour and
+. filled with the brush colour. Right and bottom are exclusive.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Ellipse (HDC Dc, int16_t left, int16_t top, int16_t right, int16_t bottom)
+{
+	if (Dc && Dc->inuse && Dc->dev->spi && left < right && top < bottom)// Make sure device is open, DC valid and rectangle not empty
+	{
+		int16_t xl[SSD1327_HT + 2], xr[SSD1327_HT + 2];				// Extent of screen rows and a row each side
+		int y0 = (top > 0) ? top : 0;								// Rows on screen
+		int y1 = (bottom < Dc->dev->screenht) ? bottom : Dc->dev->screenht;
+		int b0 = (top > y0 - 1) ? top : y0 - 1;						// Rows found, neighbours of screen rows too
+		ellipse_rows(left, top, right, bottom, b0, (bottom < y1 + 1) ? bottom : y1 + 1, &xl[0], &xr[0]);
+		for (int y = y0; y < y1; y++)
+		{
+			int i = y - b0;
+			int ol = ellipse_outline(xl, i, y == top || y == bottom - 1);// Left outline ends here
+			if (ol < 0 || 2 * ol >= xl[i] + xr[i])					// Whole row is outline
+				span_fill(Dc->dev, y, xl[i], xr[i], Dc->hiPenColor, Dc->loPenColor);
+			else {
+				int orx = xl[i] + xr[i] - ol;						// Right outline mirrors left
+				span_fill(Dc->dev, y, xl[i], ol, Dc->hiPenColor, Dc->loPenColor);
+				span_fill(Dc->dev, y, ol + 1, orx - 1, Dc->hiBrushColor, Dc->loBrushColor);	// Interior
+				span_fill(Dc->dev, y, orx, xr[i], Dc->hiPenColor, Dc->loPenColor);
+			}
+		}
+		return damage_commit(Dc->dev);								// Send the changed spans
+	}
+	return false;
+}
+
+/*-[ Arc ]------------------------------------------------------------------}
+. Draws in the pen colour the part of the outline of the ellipse fitting
+. the rectangle that runs anticlockwise from where the line from its centre
+. to (xstart,ystart) crosses it to where the line to (xend,yend) does. If
+. the two points are in the same direction the whole outline is drawn.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Arc (HDC Dc, int16_t left, int16_t top, int16_t right, int16_t bottom, int16_t xstart, int16_t ystart, int16_t xend, int16_t yend)
+{
+	if (Dc && Dc->inuse && Dc->dev->spi && left < right && top < bottom)// Make sure device is open, DC valid and rectangle not empty
+	{
+		int16_t xl[SSD1327_HT + 2], xr[SSD1327_HT + 2];				// Extent of screen rows and a row each side
+		int y0 = (top > 0) ? top : 0;								// Rows on screen
+		int y1 = (bottom < Dc->dev->screenht) ? bottom : Dc->dev->screenht;
+		int b0 = (top > y0 - 1) ? top : y0 - 1;						// Rows found, neighbours of screen rows too
+		ellipse_rows(left, top, right, bottom, b0, (bottom < y1 + 1) ? bottom : y1 + 1, &xl[0], &xr[0]);
+		int cx2 = left + right, cy2 = top + bottom;					// Doubled centre
+		int64_t sx = 2 * xstart - cx2, sy = cy2 - 2 * ystart;		// Start direction, y upwards
+		int64_t ex = 2 * xend - cx2, ey = cy2 - 2 * yend;			// End direction, y upwards
+		for (int y = y0; y < y1; y++)
+		{
+			int i = y - b0;
+			int ol = ellipse_outline(xl, i, y == top || y == bottom - 1);// Left outline ends here
+			int orx = xl[i] + xr[i] - ol;							// Right outline starts here
+			if (ol < 0 || 2 * ol >= xl[i] + xr[i]) { ol = xr[i]; orx = xr[i] + 1; }// Whole row is outline
+			int xs = (xl[i] > 0) ? xl[i] : 0;						// Outline pixels on screen
+			int xe = (xr[i] < Dc->dev->screenwth) ? xr[i] : Dc->dev->screenwth - 1;
+			int runl = 0;
+			bool run = false;
+			for (int x = xs; x <= xe; x++)							// Each outline pixel of row
+			{
+				if (x > ol && x < orx) x = orx;					// Skip the interior
+				if (x > xe) break;
+				bool on = arc_contains(sx, sy, ex, ey, 2 * x + 1 - cx2, cy2 - 2 * y - 1);
+				if (on && !run) { runl = x; run = true; }			// Arc enters row
+				if (run && (!on || x == ol || x == xe))				// Arc leaves or outline piece ends
+				{
+					span_fill(Dc->dev, y, runl, on ? x : x - 1, Dc->hiPenColor, Dc->loPenColor);
+					run = false;
+				}
+			}
+		}
+		return damage_commit(Dc->dev);								// Send the changed spans
+	}
+	return false;
+}
+
+/***************************************************************************}
+{						 BITMAP ROUTINES			                        }
+{***************************************************************************/
+
+/*-[ INTERNAL: bitmap_alloc ]-----------------------------------------------}
+. RETURN: a free bitmap table entry marked in use, NULL if none free
+.--------------------------------------------------------------------------*/
+static struct memory_bitmap* bitmap_alloc (uint16_t wth, uint16_t ht)
+{
+	if (wth == 0 || ht == 0) return 0;								// Empty bitmap is invalid
+	for (int i = 0; i < MAX_BITMAP; i++)							// Search each table entry
+	{
+		if (bitmap_table[i].inuse == 0)								// Is bitmap free
+		{
+			bitmap_table[i] = (struct memory_bitmap){ 0 };
+			bitmap_table[i].wth = wth;
+			bitmap_table[i].ht = ht;
+			bitmap_table[i].stride = (wth + 1) / 2;					// Rows start on a byte
+			bitmap_table[i].inuse = 1;								// Set the in use flag
+			return &bitmap_table[i];
+		}
+	}
+	return 0;														// No bitmap available
+}
+
+/*-[ CreateCompatibleBitmap ]-----------------------------------------------}
+. Creates a wth x ht memory bitmap in the screen pixel format, cleared to
+. colour 0. Draw into it through GetBitmapBits.
+. RETURN: valid HBITMAP for success, NULL for any failure
+.--------------------------------------------------------------------------*/
+HBITMAP CreateCompatibleBitmap (HDC Dc, uint16_t wth, uint16_t ht)
+{
+	if (Dc && Dc->inuse)											// Check the DC is valid
+	{
+		struct memory_bitmap* bmp = bitmap_alloc(wth, ht);
+		if (bmp)
+		{
+			bmp->bits = calloc(ht, bmp->stride);					// Pixels start as colour 0
+			if (bmp->bits)
+			{
+				bmp->owned = 1;										// Free pixels on delete
+				return bmp;
+			}
+			bmp->inuse = 0;											// Out of memory, release entry
+		}
+	}
+	return 0;
+}
+
+/*-[ CreateBitmap ]---------------------------------------------------------}
+. Creates a wth x ht bitmap over existing packed 4bpp pixels such as an
+. icon compiled into the program, rows are (wth+1)/2 bytes. The pixels are
+. not copied so must stay valid until the bitmap is deleted.
+. RETURN: valid HBITMAP for success, NULL for any failure
+.--------------------------------------------------------------------------*/
+HBITMAP CreateBitmap (uint16_t wth, uint16_t ht, const uint8_t* bits)
+{
+	if (bits)														// Must have pixels
+	{
+		struct memory_bitmap* bmp = bitmap_alloc(wth, ht);
+		if (bmp) bmp->bits = bits;									// Use the pixels where they are
+		return bmp;
+	}
+	return 0;
+}
+
+/*-[ DeleteObject ]---------------------------------------------------------}
+. Deletes a bitmap freeing any pixel memory it created.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool DeleteObject (HBITMAP bmp)
+{
+	if (bmp && bmp->inuse)											// Check the bitmap is valid
+	{
+		if (bmp->owned) free((void*)bmp->bits);						// Release pixels we allocated
+		*bmp = (struct memory_bitmap){ 0 };							// Entry is available again
+		return true;
+	}
+	return false;
+}
+
+/*-[ GetBitmapBits ]--------------------------------------------------------}
+. Gives the pixels of a bitmap made by CreateCompatibleBitmap so they can be
+. drawn into, the bytes between rows are put in stride.
+. RETURN: pointer to the first row, NULL for any failure or read only bitmap
+.--------------------------------------------------------------------------*/
+uint8_t* GetBitmapBits (HBITMAP bmp, uint16_t* stride)
+{
+	if (bmp && bmp->inuse && bmp->owned)							// Only our own pixels are writable
+	{
+		if (stride) *stride = bmp->stride;
+		return (uint8_t*)bmp->bits;
+	}
+	return 0;
+}
+
+/*-[ INTERNAL: blt_rop ]----------------------------------------------------}
+. RETURN: the blt_op for a raster operation, -1 if not supported
+.--------------------------------------------------------------------------*/
+static int blt_rop (uint32_t rop)
+{
+	switch (rop)
+	{
+		case SRCCOPY: return BLT_COPY;
+		case SRCPAINT: return BLT_PAINT;
+		case SRCAND: return BLT_AND;
+		case SRCINVERT: return BLT_INVERT;
+	}
+	return -1;
+}
+
+/*-[ INTERNAL: blt_srcrow ]-------------------------------------------------}
+. Gives w pixels of bitmap row sy from pixel sx lined up so the first is in
+. the nibble given by parity (0 high, 1 low) of the first byte. When the
+. bitmap already lines up the row is used in place, otherwise it is shifted
+. a nibble into tmp.
+. RETURN: pointer to the lined up pixels
+.--------------------------------------------------------------------------*/
+static const uint8_t* blt_srcrow (const struct memory_bitmap* bmp, int sy, int sx, int w, int parity, uint8_t* tmp)
+{
+	const uint8_t* p = bmp->bits + (uint32_t)sy * bmp->stride;		// Start of bitmap row
+	if ((sx & 1) == parity) return p + sx / 2;						// Already lined up
+	int n = (parity + w + 1) / 2;									// Bytes the pixels cover
+	int b = (sx - parity) >> 1;										// Bitmap byte of first high nibble
+	for (int k = 0; k < n; k++, b++)								// Each byte is two half bytes
+	{
+		uint8_t hi = (b >= 0) ? p[b] << 4 : 0;						// Right pixel of one byte
+		uint8_t lo = (b + 1 < bmp->stride) ? p[b + 1] >> 4 : 0;		// Left pixel of the next
+		tmp[k] = hi | lo;
+	}
+	return tmp;
+}
+
+/*-[ INTERNAL: blt_stretchrow ]---------------------------------------------}
+. Gives w pixels of bitmap row sy sampled so pixel i is the bitmap pixel at
+. sx + (i0 + i) * cxs / cx, lined up as blt_srcrow in tmp.
+. RETURN: pointer to the lined up pixels
+.--------------------------------------------------------------------------*/
+static const uint8_t* blt_stretchrow (const struct memory_bitmap* bmp, int sy, int sx, int i0, int w, int cx, int cxs, int parity, uint8_t* tmp)
+{
+	const uint8_t* p = bmp->bits + (uint32_t)sy * bmp->stride;		// Start of bitmap row
+	uint32_t q = (uint32_t)i0 * cxs / cx, r = (uint32_t)i0 * cxs % cx;// Whole and part source position
+	memset(tmp, 0, (parity + w + 1) / 2);
+	for (int i = 0; i < w; i++)
+	{
+		int s = sx + q;												// Source pixel
+		uint8_t v = (s & 1) ? p[s >> 1] & 0x0F : p[s >> 1] >> 4;
+		int d = parity + i;											// Destination nibble
+		tmp[d >> 1] |= (d & 1) ? v : v << 4;
+		for (r += cxs; r >= (uint32_t)cx; r -= cx) q++;				// Step source by cxs/cx
+	}
+	return tmp;
+}
+
+/*-[ INTERNAL: blt_row ]----------------------------------------------------}
+. Combines w lined up source pixels with shadow row y from pixel x a byte
+. at a time, then marks the bytes damaged. Edge bytes only change the
+. nibble inside the span and transparent pixels are masked out.
+.--------------------------------------------------------------------------*/
+static void blt_row (SSD1327_HANDLE dev, int y, int x, int w, const uint8_t* s, uint8_t op, uint8_t key)
+{
+	uint8_t* d = &dev->shadow[y][x / 2];							// First shadow byte
+	int n = ((x & 1) + w + 1) / 2;									// Bytes the span covers
+	for (int k = 0; k < n; k++)
+	{
+		uint8_t m = 0xFF, r;										// Nibbles to change
+		if (k == 0 && (x & 1)) m = 0x0F;							// Span starts on right pixel
+		if (k == n - 1 && ((x + w - 1) & 1) == 0) m &= 0xF0;		// Span ends on left pixel
+		switch (op)
+		{
+			case BLT_PAINT: r = d[k] | s[k]; break;
+			case BLT_AND: r = d[k] & s[k]; break;
+			case BLT_INVERT: r = d[k] ^ s[k]; break;
+			case BLT_TRANSPARENT:
+				if ((s[k] >> 4) == key) m &= 0x0F;					// Left pixel is transparent
+				if ((s[k] & 0x0F) == key) m &= 0xF0;				// Right pixel is transparent
+				/* fall through */
+			default: r = s[k]; break;
+		}
+		d[k] = (d[k] & ~m) | (r & m);
+	}
+	damage_add(dev, y, x / 2, (x + w - 1) / 2);						// Mark bytes damaged
+}
+
+/*-[ INTERNAL: blt ]--------------------------------------------------------}
+. Does the work of BitBlt, StretchBlt and TransparentBlt. The bitmap area
+. is clipped to the bitmap when not scaling and must fit it when scaling,
+. the screen area is clipped to the screen.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+static bool blt (HDC Dc, int x, int y, int cx, int cy, const struct memory_bitmap* bmp, int xs, int ys, int cxs, int cys, int op, uint8_t key)
+{
+	if (!Dc || !Dc->inuse || !Dc->dev->spi || !bmp || !bmp->inuse || op < 0)
+		return false;												// Device open, DC and bitmap valid
+	bool stretch = (cx != cxs || cy != cys);
+	if (!stretch)													// Clip area to bitmap
+	{
+		if (xs + cx > bmp->wth) cx = cxs = bmp->wth - xs;
+		if (ys + cy > bmp->ht) cy = cys = bmp->ht - ys;
+	} else if (xs + cxs > bmp->wth || ys + cys > bmp->ht || cxs == 0 || cys == 0)
+		return false;												// Scaled area must be in bitmap
+	int i0 = (x < 0) ? -x : 0, i1 = cx;								// Columns of area on screen
+	int j0 = (y < 0) ? -y : 0, j1 = cy;								// Rows of area on screen
+	if (x + i1 > Dc->dev->screenwth) i1 = Dc->dev->screenwth - x;
+	if (y + j1 > Dc->dev->screenht) j1 = Dc->dev->screenht - y;
+	if (i0 >= i1 || j0 >= j1) return true;							// Nothing on screen
+	int w = i1 - i0, dx = x + i0;									// Clipped span of each row
+	if (!stretch && op == BLT_COPY && (dx & 1) == 0 && ((xs + i0) & 1) == 0 && (w & 1) == 0
+		&& !shadow_only(Dc->dev, dx, y + j0, dx + w, y + j1))
+	{																// Lined up copy goes straight out
+		const uint8_t* p = bmp->bits + (uint32_t)(ys + j0) * bmp->stride + (xs + i0) / 2;
+		if (!SSD1327_SetWindow(Dc->dev, dx, y + j0, dx + w, y + j1)) return false;	// Set the window area
+		GPIO_Output(Dc->dev->gpio, Dc->dev->data_cmd_gpio, 1);		// Make sure Data#Cmd high
+		if (!SpiWriteRows(Dc->dev->spi, p, w / 2, bmp->stride, j1 - j0, false))
+			return false;											// Send bitmap rows in place
+		for (int j = j0; j < j1; j++, p += bmp->stride)				// Shadow follows the screen
+			memcpy(&Dc->dev->shadow[y + j][dx / 2], p, w / 2);
+		return true;
+	}
+	uint8_t tmp[SSD1327_WTH / 2 + 1];								// One lined up source row
+	int lastsy = -1;
+	const uint8_t* s = 0;
+	for (int j = j0; j < j1; j++)
+	{
+		int sy = ys + (stretch ? j * cys / cy : j);					// Bitmap row for screen row
+		if (!stretch) s = blt_srcrow(bmp, sy, xs + i0, w, dx & 1, &tmp[0]);
+		else if (sy != lastsy) s = blt_stretchrow(bmp, sy, xs, i0, w, cx, cxs, dx & 1, &tmp[0]);
+		lastsy = sy;												// Repeated rows reuse the sample
+		blt_row(Dc->dev, y + j, dx, w, s, op, key);
+	}
+	return damage_commit(Dc->dev);									// Send the changed bytes
+}
+
+/*-[ BitBlt ]---------------------------------------------------------------}
+. Combines the cx x cy area of the bitmap at (xsrc,ysrc) with the screen at
+. (x,y) using a raster operation (SRCCOPY, SRCPAINT, SRCAND, SRCINVERT).
+. An SRCCOPY with x, xsrc and cx all even streams the bitmap rows straight
+. to the screen, anything else is combined a byte at a time in the shadow
+. of the screen and only the changed bytes sent.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool BitBlt (HDC Dc, int16_t x, int16_t y, uint16_t cx, uint16_t cy, HBITMAP src, uint16_t xsrc, uint16_t ysrc, uint32_t rop)
+{
+	if (src && (xsrc >= src->wth || ysrc >= src->ht)) return false;// Area starts outside bitmap
+	return blt(Dc, x, y, cx, cy, src, xsrc, ysrc, cx, cy, blt_rop(rop), 0);
+}
+
+/*-[ StretchBlt ]-----------------------------------------------------------}
+. As BitBlt but the cxsrc x cysrc area of the bitmap is scaled to cover the
+. cx x cy area of the screen, pixels are repeated or dropped as needed.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool StretchBlt (HDC Dc, int16_t x, int16_t y, uint16_t cx, uint16_t cy, HBITMAP src, uint16_t xsrc, uint16_t ysrc, uint16_t cxsrc, uint16_t cysrc, uint32_t rop)
+{
+	if (src && (xsrc >= src->wth || ysrc >= src->ht)) return false;// Area starts outside bitmap
+	return blt(Dc, x, y, cx, cy, src, xsrc, ysrc, cxsrc, cysrc, blt_rop(rop), 0);
+}
+
+/*-[ TransparentBlt ]-------------------------------------------------------}
+. As StretchBlt copying the bitmap except pixels of the transparent colour
+. which leave the screen unchanged, for icons over a background.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool TransparentBlt (HDC Dc, int16_t x, int16_t y, uint16_t cx, uint16_t cy, HBITMAP src, uint16_t xsrc, uint16_t ysrc, uint16_t cxsrc, uint16_t cysrc, COLORREF transparent)
+{
+	if (src && (xsrc >= src->wth || ysrc >= src->ht)) return false;// Area starts outside bitmap
+	return blt(Dc, x, y, cx, cy, src, xsrc, ysrc, cxsrc, cysrc, BLT_TRANSPARENT, transparent & 0x0F);
 }
@@ -9,7 +9,7 @@ extern "C" {									// Put extern C directive wrapper around
 {																			}
 {       Filename: ssd1327.h													}
 {       Copyright: Leon de Boer(LdB) 2020									}
-{       Version: 1.10														}
+{       Version: 1.20														}
 {		Release under MIT license (https://opensource.org/licenses/MIT)     }
 {																			}
 {***************************************************************************}
@@ -19,17 +19,16 @@ extern "C" {									// Put extern C directive wrapper around
 {++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
 {  1.00 Initial version														}
 {  1.10 Added device context and more primitives							}
+{  1.20 Several devices open at once, each DC bound to its device			}
 {++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 #include <stdbool.h>							// C standard unit for bool, true, false
 #include <stdint.h>								// C standard unit for uint32_t etc
 #include "spi.h"								// SPI device unit as we will be using SPI
+#include "font.h"								// Font registry, fonts are selected by id
+#include "expand.h"								// DITHERMODE for grey images
 
-#define SSD1327_DRIVER_VERSION 1100				// Version number 1.10 build 0
-
-#define FONT8x16	( 0 )
-#define FONT8x8		( 1 )
-#define FONT6x8		( 2 )
+#define SSD1327_DRIVER_VERSION 1200				// Version number 1.20 build 0
 
 /*--------------------------------------------------------------------------}
 {						 COLORREF defined as a byte							}
@@ -41,6 +40,92 @@ typedef uint8_t COLORREF;
 {--------------------------------------------------------------------------*/
 typedef struct device_context* HDC;
 
+/*--------------------------------------------------------------------------}
+{   SSD1327_HANDLE is an opaque ptr to one open panel, each HDC is bound to	}
+{   the panel it was got on.												}
+{--------------------------------------------------------------------------*/
+typedef struct ssd1327_device* SSD1327_HANDLE;
+
+/*--------------------------------------------------------------------------}
+{   HFLUSHGROUP is an opaque ptr to devices flushed together in parallel	}
+{--------------------------------------------------------------------------*/
+typedef struct flush_group* HFLUSHGROUP;
+
+#define SSD1327_MAX_GROUP ( 8 )					// Most devices in a flush group
+
+/*--------------------------------------------------------------------------}
+{     RECT right and bottom are exclusive as with Rectangle and SetWindow	}
+{--------------------------------------------------------------------------*/
+typedef struct tagRECT {
+	uint16_t left;
+	uint16_t top;
+	uint16_t right;
+	uint16_t bottom;
+} RECT;
+
+typedef struct tagSIZE {
+	uint16_t cx;
+	uint16_t cy;
+} SIZE;
+
+/*--------------------------------------------------------------------------}
+{   HBITMAP is an opaque struct ptr to a memory bitmap of packed 4bpp		}
+{   pixels in the screen format, two per byte with the high nibble the		}
+{   left pixel and each row starting on a byte.								}
+{--------------------------------------------------------------------------*/
+typedef struct memory_bitmap* HBITMAP;
+
+/*--------------------------------------------------------------------------}
+{			  BitBlt raster operations, values match Win32					}
+{--------------------------------------------------------------------------*/
+#define SRCCOPY			0x00CC0020				// Destination = source
+#define SRCPAINT		0x00EE0086				// Destination = destination OR source
+#define SRCAND			0x008800C6				// Destination = destination AND source
+#define SRCINVERT		0x00660046				// Destination = destination XOR source
+
+/*--------------------------------------------------------------------------}
+{						 DrawText format flags								}
+{--------------------------------------------------------------------------*/
+#define DT_TOP			0x0000					// Lines start at top of rectangle
+#define DT_LEFT			0x0000					// Lines are left aligned
+#define DT_CENTER		0x0001					// Lines are centred
+#define DT_RIGHT		0x0002					// Lines are right aligned
+#define DT_VCENTER		0x0004					// Lines are centred vertically
+#define DT_BOTTOM		0x0008					// Lines end at bottom of rectangle
+#define DT_WORDBREAK	0x0010					// Wrap lines between words at rectangle width
+#define DT_SINGLELINE	0x0020					// One line only, newlines are not breaks
+#define DT_CALCRECT		0x0400					// Only measure, set rectangle to text size
+#define DT_END_ELLIPSIS	0x8000					// Lines that do not fit end with "..."
+
+/*--------------------------------------------------------------------------}
+{						 DrawNumber format flags							}
+{--------------------------------------------------------------------------*/
+#define DN_RIGHT		0x0000					// Number is right justified in width
+#define DN_LEFT			0x0001					// Number is left justified in width
+#define DN_ZEROPAD		0x0002					// Pad with leading zeros after any sign
+#define DN_SIGN			0x0004					// Positive numbers show a + sign
+#define DN_DECIMALS(n)	(((n) & 0xF) << 8)		// Value is fixed point with n (0..9) decimal places
+#define DN_MAXWIDTH		( 32 )					// Widest field DrawNumber pads to
+
+/*--------------------------------------------------------------------------}
+{			Hardware scroll direction and step interval codes				}
+{--------------------------------------------------------------------------*/
+typedef enum {
+	SCROLL_RIGHT = 0x26,						// Continuous horizontal scroll right
+	SCROLL_LEFT = 0x27,							// Continuous horizontal scroll left
+} SCROLLDIR;
+
+typedef enum {
+	SCROLL_6FRAMES = 0,							// One step every 6 frames
+	SCROLL_10FRAMES = 1,						// One step every 10 frames
+	SCROLL_100FRAMES = 2,						// One step every 100 frames
+	SCROLL_200FRAMES = 3,						// One step every 200 frames
+	SCROLL_2FRAMES = 4,							// One step every 2 frames
+	SCROLL_3FRAMES = 5,							// One step every 3 frames
+	SCROLL_4FRAMES = 6,							// One step every 4 frames
+	SCROLL_5FRAMES = 7,							// One step every 5 frames
+} SCROLLSPEED;
+
 /***************************************************************************}
 {						 DEVICE SPECIFIC ROUTINES	                        }
 {***************************************************************************/
@@ -50,35 +135,145 @@ typedef struct device_context* HDC;
 . should be opened with desired speed settings and SPI_MODE3 before call.
 . It is also assumed a valid reset cycle on reset pin was completed and the
 . reset operation lies outside this code scope as it involves long delays.
-. RETURN: valid SSD1327 for success, NULL for any failure
+. Any number of devices can be open, each on its own SPI handle. Different
+. devices may be drawn on from different threads but drawing on one device
+. must come from one thread at a time. Fonts must not be added or removed
+. while any device is being drawn on.
+. RETURN: valid SSD1327_HANDLE for success, NULL for any failure
+.--------------------------------------------------------------------------*/
+SSD1327_HANDLE SSD1327_Open (SPI_HANDLE spi, GPIO_HANDLE gpio, uint8_t data_cmd_gpio);
+
+/*-[ SSD1327_Close ]--------------------------------------------------------}
+. Frees the device, anything deferred is sent first. Every DC got on it
+. must have been released, while any is still in use the device is left
+. open and false returned. The SPI and GPIO handles stay open.
+. RETURN: true for success, false for any failure
 .--------------------------------------------------------------------------*/
-bool SSD1327_Open (SPI_HANDLE spi, GPIO_HANDLE gpio, uint8_t data_cmd_gpio);
+bool SSD1327_Close (SSD1327_HANDLE dev);
 
 /*-[ SSD1327_ScreenOnOff ]--------------------------------------------------}
 . Sends the command to turn the screen on/off.
 . RETURN: true for success, false for any failure
 .--------------------------------------------------------------------------*/
-bool SSD1327_ScreenOnOff (bool ScreenOn);
+bool SSD1327_ScreenOnOff (SSD1327_HANDLE dev, bool ScreenOn);
 
 /*-[ SSD1327_SetWindow ]----------------------------------------------------}
 . Sets the window area to (x1,y1, x2, y2) so the next data commands are
 . into that area.
 .--------------------------------------------------------------------------*/
-bool SSD1327_SetWindow (uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
+bool SSD1327_SetWindow (SSD1327_HANDLE dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
 
 /*-[ SSD1327_ClearScreen ]--------------------------------------------------}
 . Puts a colour on entire screen
 . RETURN: true for success, false for any failure
 .--------------------------------------------------------------------------*/
-bool SSD1327_ClearScreen (uint8_t colour);
+bool SSD1327_ClearScreen (SSD1327_HANDLE dev, uint8_t colour);
+
+/*-[ SSD1327_DrawGrey ]-----------------------------------------------------}
+. Draws a wth x ht image of 8 bit grey pixels (rows stride bytes apart) at
+. (x,y) dithered to the 16 screen levels. Each row is dithered straight
+. into the GDDRAM shadow and the rows are sent from there, so the image is
+. never held twice. The area is clipped to the screen.
+. **** Note x and wth are rounded down to even values like WriteText.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool SSD1327_DrawGrey (HDC Dc, uint16_t x, uint16_t y, uint16_t wth, uint16_t ht, const uint8_t* grey, uint16_t stride, DITHERMODE mode);
+
+/*-[ SSD1327_SetScroll ]----------------------------------------------------}
+. Sets the area (right and bottom exclusive) the controller scrolls around
+. by itself once SSD1327_StartScroll is called, left and right are rounded
+. out to even pixels. Any scroll running is stopped first.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool SSD1327_SetScroll (SSD1327_HANDLE dev, uint16_t left, uint16_t top, uint16_t right, uint16_t bottom, SCROLLDIR dir, SCROLLSPEED speed);
+
+/*-[ SSD1327_StartScroll ]--------------------------------------------------}
+. Starts the scroll set by SSD1327_SetScroll. While it runs drawing in the
+. scroll area is only kept in the shadow and never sent, as the controller
+. does not support writes there, so the animation costs no SPI traffic.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool SSD1327_StartScroll (SSD1327_HANDLE dev);
+
+/*-[ SSD1327_StopScroll ]---------------------------------------------------}
+. Stops a running scroll and rewrites the scroll area from the shadow, so
+. it shows what was last drawn there unscrolled.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool SSD1327_StopScroll (SSD1327_HANDLE dev);
+
+/*-[ SSD1327_SetStartLine ]-------------------------------------------------}
+. Sets the GDDRAM row shown at the top of the screen, the rows below follow
+. on from it wrapping around at the last row.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool SSD1327_SetStartLine (SSD1327_HANDLE dev, uint8_t line);
+
+/*-[ SSD1327_SetDeferred ]--------------------------------------------------}
+. With defer true drawing only changes the GDDRAM shadow and marks it
+. damaged, nothing goes to the screen until SSD1327_Flush. Anything drawn
+. over twice before the flush is only sent once as its last value. Setting
+. it false flushes anything still waiting.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool SSD1327_SetDeferred (SSD1327_HANDLE dev, bool defer);
+
+/*-[ SSD1327_Flush ]--------------------------------------------------------}
+. Sends everything drawn since the last flush, damaged rows are merged
+. into as few windows as is cheapest.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool SSD1327_Flush (SSD1327_HANDLE dev);
+
+/*-[ SSD1327_FlushRows ]----------------------------------------------------}
+. As SSD1327_Flush but only sends what was drawn on rows top to bottom-1,
+. the rest stays waiting for a later flush. Urgent areas can go first.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool SSD1327_FlushRows (SSD1327_HANDLE dev, uint16_t top, uint16_t bottom);
+
+/*-[ SSD1327_CreateFlushGroup ]---------------------------------------------}
+. Creates a group that flushes count devices in parallel. Devices on the
+. same SPI bus, or sharing a Data/Cmd pin, are flushed one after the other
+. in one lane and each other lane gets a worker thread. The workers take
+. the scheduling and cpus of the thread creating the group.
+. RETURN: valid HFLUSHGROUP for success, NULL for any failure
+.--------------------------------------------------------------------------*/
+HFLUSHGROUP SSD1327_CreateFlushGroup (const SSD1327_HANDLE* dev, uint8_t count);
+
+/*-[ SSD1327_FlushGroup ]---------------------------------------------------}
+. Flushes every device of the group, the lanes at the same time, and only
+. returns once all are sent so a frame across the panels completes
+. together. Only one thread may flush a group at a time.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool SSD1327_FlushGroup (HFLUSHGROUP group);
+
+/*-[ SSD1327_DestroyFlushGroup ]--------------------------------------------}
+. Stops the workers and frees the group, the devices stay open.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool SSD1327_DestroyFlushGroup (HFLUSHGROUP group);
+
+/*-[ SSD1327_ConsoleWrite ]-------------------------------------------------}
+. Adds the UTF-8 text to the bottom of the screen as a scrolling console,
+. each newline starting another line and a final newline being ignored.
+. GDDRAM is used as a ring, each new line is written over the rows about
+. to leave the top and the start line moved on, so one line costs only its
+. own pixels and a two byte command. Lines are clipped at the screen edge.
+. While deferred the lines and the new start line go out with the flush.
+. **** Note other drawing still uses GDDRAM rows, so once the console has
+. moved the start line, y positions are relative to it.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool SSD1327_ConsoleWrite (HDC Dc, const char* txt);
 
 /*-[ SSD1327_WriteChar ]----------------------------------------------------}
 . Writes the character in the current font to the screen at position (x,y)
 . **** Note x can only be even value 0,2,4 etc due to two pixel per byte
 . format and me being to lazy to deal with odds. If you do ask for an odd X
 . value it will write at the value one less so x = 3 would write at x = 2.
-. Fonts also have restriction they must be of even width .. the demo fonts
-. being 6 and 8 pixels wide.
+. Font glyph cells are always an even number of pixels wide.
 . RETURN: true for success, false for any failure
 .--------------------------------------------------------------------------*/
 bool SSD1327_WriteChar (HDC Dc, uint16_t x, uint16_t y, char Ch);
@@ -88,24 +283,28 @@ bool SSD1327_WriteChar (HDC Dc, uint16_t x, uint16_t y, char Ch);
 . **** Note x can only be even value 0,2,4 etc due to two pixel per byte
 . format and me being to lazy to deal with odds. If you do ask for an odd X
 . value it will write at the value one less so x = 3 would write at x = 2.
-. Fonts also have restriction they must be of even width .. the demo font
-. being 8 pixels wide.
+. The text is UTF-8 and each character advances by its own glyph width.
+. The whole string is expanded row by row into one buffer and sent as a
+. single window, text past the screen edge is clipped. Text is scaled up
+. by the device context text scale.
 . RETURN: true for success, false for any failure
 .--------------------------------------------------------------------------*/
-bool SSD1327_WriteText (HDC Dc, uint16_t x, uint16_t y, char* txt);
+bool SSD1327_WriteText (HDC Dc, uint16_t x, uint16_t y, const char* txt);
 
 /***************************************************************************}
 {						 DEVICE CONTEXT ROUTINES	                        }
 {***************************************************************************/
 
 /*-[ GetDc ]----------------------------------------------------------------}
-. Fetches the next available device context handle (HDC).
-. If all handles are currently in use it will return NULL.
+. Fetches the next available device context handle (HDC) bound to the
+. device, safe from any thread. If all SSD1327_MAX_DC handles are in use
+. it will return NULL. DCs on the same device must not draw at the same
+. time, DCs on different devices may.
 .--------------------------------------------------------------------------*/
-HDC GetDC (void);
+HDC GetDC (SSD1327_HANDLE dev);
 
 /*-[ ReleaseDc ]------------------------------------------------------------}
-.  Releases the device context
+.  Releases the device context, safe from any thread
 .--------------------------------------------------------------------------*/
 void ReleaseDC (HDC Dc);
 
@@ -133,18 +332,198 @@ COLORREF SetDCPenColor (HDC Dc, COLORREF Color);
 .--------------------------------------------------------------------------*/
 COLORREF SetDCBrushColor (HDC Dc, COLORREF Color);
 
+/*-[ SetDCPriority ]--------------------------------------------------------}
+. Sets the flush priority of what is drawn with the device context, 0 is
+. background and higher is more urgent, and returns the previous priority.
+. The deadline is how many milliseconds after it is queued the drawing
+. should be on screen, 0 for none. Both are carried with drawing queued to
+. a compositor.
+.--------------------------------------------------------------------------*/
+uint8_t SetDCPriority (HDC Dc, uint8_t priority, uint16_t deadline);
+
+/*-[ GetDCPriority ]--------------------------------------------------------}
+. RETURN: the device context flush priority
+.--------------------------------------------------------------------------*/
+uint8_t GetDCPriority (HDC Dc);
+
+/*-[ GetDCDeadline ]--------------------------------------------------------}
+. RETURN: the device context deadline in milliseconds, 0 for none
+.--------------------------------------------------------------------------*/
+uint16_t GetDCDeadline (HDC Dc);
+
+/*-[ GetBkColor ]-----------------------------------------------------------}
+. RETURN: the current device context background color
+.--------------------------------------------------------------------------*/
+COLORREF GetBkColor (HDC Dc);
+
+/*-[ GetTextColor ]---------------------------------------------------------}
+. RETURN: the current device context text color
+.--------------------------------------------------------------------------*/
+COLORREF GetTextColor (HDC Dc);
+
+/*-[ GetDCPenColor ]--------------------------------------------------------}
+. RETURN: the current device context pen color
+.--------------------------------------------------------------------------*/
+COLORREF GetDCPenColor (HDC Dc);
+
+/*-[ GetDCBrushColor ]------------------------------------------------------}
+. RETURN: the current device context brush color
+.--------------------------------------------------------------------------*/
+COLORREF GetDCBrushColor (HDC Dc);
+
 /*-[ Rectangle ]------------------------------------------------------------}
 . Draws a rectangle using the current brush color.
+. **** Note left and right are rounded down to even values like WriteText.
 . RETURN: true for success, false for any failure
 .--------------------------------------------------------------------------*/
 bool Rectangle(HDC Dc, uint16_t left, uint16_t top, uint16_t right, uint16_t bottom);
 
+/*-[ MoveTo ]---------------------------------------------------------------}
+. Moves the current position of the device context to (x,y).
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool MoveTo (HDC Dc, int16_t x, int16_t y);
+
+/*-[ LineTo ]---------------------------------------------------------------}
+. Draws a line in the pen colour from the current position up to but not
+. including (x,y), which becomes the current position. Each row of the
+. line is one span and the spans go to the screen as a few windows.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool LineTo (HDC Dc, int16_t x, int16_t y);
+
+/*-[ FrameRect ]------------------------------------------------------------}
+. Draws a one pixel border in the pen colour just inside the rectangle,
+. right and bottom are exclusive as with Rectangle.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool FrameRect (HDC Dc, uint16_t left, uint16_t top, uint16_t right, uint16_t bottom);
+
+/*-[ Ellipse ]--------------------------------------------------------------}
+. Draws the ellipse that fits the rectangle, outlined in the pen colour and
+. filled with the brush colour. Right and bottom are exclusive.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Ellipse (HDC Dc, int16_t left, int16_t top, int16_t right, int16_t bottom);
+
+/*-[ Arc ]------------------------------------------------------------------}
+. Draws in the pen colour the part of the outline of the ellipse fitting
+. the rectangle that runs anticlockwise from where the line from its centre
+. to (xstart,ystart) crosses it to where the line to (xend,yend) does. If
+. the two points are in the same direction the whole outline is drawn.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool Arc (HDC Dc, int16_t left, int16_t top, int16_t right, int16_t bottom, int16_t xstart, int16_t ystart, int16_t xend, int16_t yend);
+
 /*-[ SelectFont ]-----------------------------------------------------------}
 . Set the current font on the device context to the specified font and
-. returns the previosuly selected font.
+. returns the previosuly selected font. The font number is any id returned
+. by the font registry, an unknown id selects FONT8x16.
 .--------------------------------------------------------------------------*/
 uint8_t SelectFont (HDC Dc, uint8_t fontnum);
 
+/*-[ GetCurrentFont ]-------------------------------------------------------}
+. RETURN: the font number currently selected on the device context
+.--------------------------------------------------------------------------*/
+uint8_t GetCurrentFont (HDC Dc);
+
+/*-[ SetTextScale ]---------------------------------------------------------}
+. Sets the device context text scale, 1 to 4, and returns the previous
+. scale. Each font pixel is drawn as a scale x scale block so large
+. readouts need no large fonts.
+.--------------------------------------------------------------------------*/
+uint8_t SetTextScale (HDC Dc, uint8_t scale);
+
+/*-[ GetTextScale ]---------------------------------------------------------}
+. RETURN: the device context text scale, 1 to 4
+.--------------------------------------------------------------------------*/
+uint8_t GetTextScale (HDC Dc);
+
+/*-[ DrawNumber ]-----------------------------------------------------------}
+. Draws an integer at (x,y) like WriteText, padded to width characters by
+. the DN_ flags. With DN_DECIMALS(n) the value is fixed point, so 1234 with
+. two decimals draws 12.34. The digits are converted directly with no
+. format string to parse.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool DrawNumber (HDC Dc, uint16_t x, uint16_t y, int32_t value, uint8_t width, uint16_t flags);
+
+/*-[ DrawText ]-------------------------------------------------------------}
+. Draws UTF-8 text in the current font laid out in the rectangle by the DT_
+. flags. Lines break at newlines and with DT_WORDBREAK between words at the
+. rectangle width. The rectangle is filled with the background colour, the
+. text drawn over it and the whole rectangle sent as a single window. Line
+. breaks are cached by a hash of the text so redrawing the same text does
+. no measuring. With DT_CALCRECT nothing is drawn and the rectangle right
+. and bottom are set to fit the text.
+. **** Note rect left is rounded down to an even value like WriteText.
+. RETURN: height of the text in pixels, 0 for any failure
+.--------------------------------------------------------------------------*/
+uint16_t DrawText (HDC Dc, RECT* rect, const char* txt, uint16_t flags);
+
+/*-[ GetTextExtent ]--------------------------------------------------------}
+. Measures UTF-8 text in the current font as one line, the result shares
+. the DrawText layout cache.
+. RETURN: true for success and size set, false for any failure
+.--------------------------------------------------------------------------*/
+bool GetTextExtent (HDC Dc, const char* txt, SIZE* size);
+
+/***************************************************************************}
+{						 BITMAP ROUTINES			                        }
+{***************************************************************************/
+
+/*-[ CreateCompatibleBitmap ]-----------------------------------------------}
+. Creates a wth x ht memory bitmap in the screen pixel format, cleared to
+. colour 0. Draw into it through GetBitmapBits.
+. RETURN: valid HBITMAP for success, NULL for any failure
+.--------------------------------------------------------------------------*/
+HBITMAP CreateCompatibleBitmap (HDC Dc, uint16_t wth, uint16_t ht);
+
+/*-[ CreateBitmap ]---------------------------------------------------------}
+. Creates a wth x ht bitmap over existing packed 4bpp pixels such as an
+. icon compiled into the program, rows are (wth+1)/2 bytes. The pixels are
+. not copied so must stay valid until the bitmap is deleted.
+. RETURN: valid HBITMAP for success, NULL for any failure
+.--------------------------------------------------------------------------*/
+HBITMAP CreateBitmap (uint16_t wth, uint16_t ht, const uint8_t* bits);
+
+/*-[ DeleteObject ]---------------------------------------------------------}
+. Deletes a bitmap freeing any pixel memory it created.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool DeleteObject (HBITMAP bmp);
+
+/*-[ GetBitmapBits ]--------------------------------------------------------}
+. Gives the pixels of a bitmap made by CreateCompatibleBitmap so they can be
+. drawn into, the bytes between rows are put in stride.
+. RETURN: pointer to the first row, NULL for any failure or read only bitmap
+.--------------------------------------------------------------------------*/
+uint8_t* GetBitmapBits (HBITMAP bmp, uint16_t* stride);
+
+/*-[ BitBlt ]---------------------------------------------------------------}
+. Combines the cx x cy area of the bitmap at (xsrc,ysrc) with the screen at
+. (x,y) using a raster operation (SRCCOPY, SRCPAINT, SRCAND, SRCINVERT).
+. An SRCCOPY with x, xsrc and cx all even streams the bitmap rows straight
+. to the screen, anything else is combined a byte at a time in the shadow
+. of the screen and only the changed bytes sent.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool BitBlt (HDC Dc, int16_t x, int16_t y, uint16_t cx, uint16_t cy, HBITMAP src, uint16_t xsrc, uint16_t ysrc, uint32_t rop);
+
+/*-[ StretchBlt ]-----------------------------------------------------------}
+. As BitBlt but the cxsrc x cysrc area of the bitmap is scaled to cover the
+. cx x cy area of the screen, pixels are repeated or dropped as needed.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool StretchBlt (HDC Dc, int16_t x, int16_t y, uint16_t cx, uint16_t cy, HBITMAP src, uint16_t xsrc, uint16_t ysrc, uint16_t cxsrc, uint16_t cysrc, uint32_t rop);
+
+/*-[ TransparentBlt ]-------------------------------------------------------}
+. As StretchBlt copying the bitmap except pixels of the transparent colour
+. which leave the screen unchanged, for icons over a background.
+. RETURN: true for success, false for any failure
+.--------------------------------------------------------------------------*/
+bool TransparentBlt (HDC Dc, int16_t x, int16_t y, uint16_t cx, uint16_t cy, HBITMAP src, uint16_t xsrc, uint16_t ysrc, uint16_t cxsrc, uint16_t cysrc, COLORREF transparent);
+
 #ifdef __cplusplus								// If we are including to a C++ file
 }												// Close the extern C directive wrapper
 #endif
@@ -0,0 +1,311 @@
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++}
+{																			}
+{       Filename: fontconv.c												}
+{       Copyright(c): Leon de Boer(LdB) 2020								}
+{       Version: 1.00														}
+{		Release under MIT license (https://opensource.org/licenses/MIT)     }
+{																			}
+{***************************************************************************}
+{                                                                           }
+{      Offline converter from PSF2 or BDF fonts to the packed font file		}
+{      that Font_Load maps at runtime. Runs on the build host. With -aa the	}
+{      font is box filtered to half size giving 4 bit coverage glyphs. Only	}
+{      glyphs present are written, found through the sparse page index.		}
+{																            }
+{      usage: fontconv [-aa] input.psf|input.bdf output.fnt [first [last]]	}
+{																            }
+{++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
+{  1.00 Initial version														}
+{++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "font.h"
+
+#define MAX_CODE ( FONT_PAGES * 256 - 1 )		// Highest character the file can hold
+
+typedef struct {
+	bool present;								// Glyph exists in source font
+	uint8_t wth;								// Glyph width in pixels
+	uint8_t ht;									// Glyph height in pixels
+	uint8_t top;								// Rows from top of cell
+	uint8_t advance;							// Pen advance in pixels
+	uint8_t* pix;								// One byte per pixel (bit or coverage), wth x ht
+} GLYPH;
+
+static GLYPH glyph[MAX_CODE + 1];
+static int cellht = 0;							// Font cell height
+static bool aa = false;							// Write anti-aliased coverage font
+
+static void fail (const char* msg)
+{
+	fprintf(stderr, "fontconv: %s\n", msg);
+	exit(1);
+}
+
+/*-[ set_glyph ]------------------------------------------------------------}
+. Stores a glyph from byte aligned rows, clipping it to the cell. The cell
+. starts at the pen so a glyph with a negative x offset (j, y, italics) is
+. shifted right to keep its left pixels and its advance grows to match.
+.--------------------------------------------------------------------------*/
+static void set_glyph (uint32_t code, const uint8_t* rows, int rowbytes, int w, int h, int xoff, int top, int advance)
+{
+	if (code > MAX_CODE || glyph[code].present) return;				// Out of range or already have it
+	if (xoff < 0)													// Pixels left of the pen
+	{
+		advance -= xoff;											// Shift glyph right keeping its spacing
+		xoff = 0;
+	}
+	int gw = w + xoff;												// Positive x offset widens the glyph
+	if (gw > FONT_MAXWTH) gw = FONT_MAXWTH;
+	if (advance > FONT_MAXWTH) advance = FONT_MAXWTH;
+	GLYPH* g = &glyph[code];
+	g->pix = calloc(gw * cellht + 1, 1);							// Whole cell height, trimmed later
+	if (g->pix == 0) fail("out of memory");
+	for (int y = 0; y < h; y++)
+	{
+		int cy = top + y;											// Row in cell
+		if (cy < 0 || cy >= cellht) continue;						// Clipped off cell
+		for (int x = 0; x < w; x++)
+		{
+			int cx = x + xoff;										// Column in glyph
+			if (cx < 0 || cx >= gw) continue;						// Clipped off glyph
+			if (rows[y * rowbytes + x / 8] & (0x80 >> (x & 7)))
+				g->pix[cy * gw + cx] = 1;
+		}
+	}
+	g->present = true;
+	g->wth = gw;
+	g->ht = cellht;
+	g->top = 0;
+	g->advance = advance;
+}
+
+/*-[ read_psf2 ]------------------------------------------------------------}
+. Reads a PC Screen Font version 2 with or without unicode table.
+.--------------------------------------------------------------------------*/
+static void read_psf2 (const uint8_t* d, size_t len)
+{
+	uint32_t hdr[8];
+	if (len < 32) fail("file too short");
+	for (int i = 0; i < 8; i++)
+		hdr[i] = d[i * 4] | (d[i * 4 + 1] << 8) | (d[i * 4 + 2] << 16) | ((uint32_t)d[i * 4 + 3] << 24);
+	uint32_t hsize = hdr[2], flags = hdr[3], count = hdr[4], csize = hdr[5], h = hdr[6], w = hdr[7];
+	if (h == 0 || h > FONT_MAXHT || w == 0 || w > FONT_MAXWTH) fail("unsupported glyph size");
+	if (csize < (w + 7) / 8 * h || hsize + (size_t)count * csize > len) fail("bad psf2 header");
+	cellht = h;
+	const uint8_t* tbl = d + hsize + (size_t)count * csize;			// Unicode table follows glyphs
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const uint8_t* bits = d + hsize + (size_t)i * csize;
+		if ((flags & 1) == 0)										// No unicode table, glyph i is code i
+		{
+			set_glyph(i, bits, (w + 7) / 8, w, h, 0, 0, w);
+			continue;
+		}
+		bool seq = false;											// Inside a combining sequence
+		while (tbl < d + len && *tbl != 0xFF)						// Code points until terminator
+		{
+			if (*tbl == 0xFE) { seq = true; tbl++; continue; }		// Sequences are not supported, skip
+			uint32_t cp = *tbl++;
+			int more = (cp >= 0xF0) ? 3 : (cp >= 0xE0) ? 2 : (cp >= 0xC0) ? 1 : 0;
+			cp &= (more == 3) ? 0x07 : (more == 2) ? 0x0F : (more == 1) ? 0x1F : 0x7F;
+			while (more-- && tbl < d + len) cp = (cp << 6) | (*tbl++ & 0x3F);
+			if (!seq) set_glyph(cp, bits, (w + 7) / 8, w, h, 0, 0, w);
+		}
+		tbl++;														// Skip terminator
+	}
+}
+
+/*-[ read_bdf ]-------------------------------------------------------------}
+. Reads a Glyph Bitmap Distribution Format font.
+.--------------------------------------------------------------------------*/
+static void read_bdf (char* text)
+{
+	int ascent = -1, descent = -1, fbw = 0, fbh = 0, fbx = 0, fby = 0;
+	int enc = -1, dw = -1, bw = 0, bh = 0, bx = 0, by = 0;
+	uint8_t rows[FONT_MAXHT * 2][FONT_MAXWTH / 8 * 2];
+	for (char* line = strtok(text, "\r\n"); line; line = strtok(0, "\r\n"))
+	{
+		if (sscanf(line, "FONTBOUNDINGBOX %d %d %d %d", &fbw, &fbh, &fbx, &fby) == 4) continue;
+		if (sscanf(line, "FONT_ASCENT %d", &ascent) == 1) continue;
+		if (sscanf(line, "FONT_DESCENT %d", &descent) == 1) continue;
+		if (strncmp(line, "STARTCHAR", 9) == 0) { enc = -1; dw = -1; bw = bh = bx = by = 0; continue; }
+		if (sscanf(line, "ENCODING %d", &enc) == 1) continue;
+		if (sscanf(line, "DWIDTH %d", &dw) == 1) continue;
+		if (sscanf(line, "BBX %d %d %d %d", &bw, &bh, &bx, &by) == 4) continue;
+		if (strcmp(line, "BITMAP") == 0)
+		{
+			if (cellht == 0)										// First glyph fixes the cell
+			{
+				if (ascent < 0) ascent = fbh + fby;
+				if (descent < 0) descent = -fby;
+				cellht = ascent + descent;
+				if (cellht <= 0 || cellht > FONT_MAXHT) fail("unsupported font height");
+			}
+			if (bw < 0 || bw > FONT_MAXWTH * 2 || bh < 0 || bh > FONT_MAXHT * 2) fail("glyph too large");
+			memset(rows, 0, sizeof(rows));
+			for (int y = 0; y < bh; y++)							// Hex bitmap rows
+			{
+				char* hex = strtok(0, "\r\n");
+				if (hex == 0) fail("truncated bitmap");
+				for (int x = 0; x < (bw + 7) / 8 && hex[x * 2] && hex[x * 2 + 1]; x++)
+				{
+					unsigned int v;
+					sscanf(&hex[x * 2], "%2x", &v);
+					rows[y][x] = v;
+				}
+			}
+			if (enc >= 0)
+				set_glyph(enc, &rows[0][0], sizeof(rows[0]), bw, bh, bx,
+					ascent - (by + bh), (dw >= 0) ? dw : fbw);		// Baseline relative to cell top
+		}
+	}
+}
+
+/*-[ make_aa ]--------------------------------------------------------------}
+. Box filters every 2x2 block of a 1bpp glyph into one 4 bit coverage pixel.
+.--------------------------------------------------------------------------*/
+static void make_aa (GLYPH* g)
+{
+	int w = (g->wth + 1) / 2, h = (cellht + 1) / 2;					// Half size glyph
+	uint8_t* pix = calloc(w * h + 1, 1);
+	if (pix == 0) fail("out of memory");
+	for (int y = 0; y < g->ht; y++)
+		for (int x = 0; x < g->wth; x++)
+			pix[(y / 2) * w + x / 2] += g->pix[y * g->wth + x];		// Count set pixels in each block
+	for (int i = 0; i < w * h; i++)
+		pix[i] = (pix[i] * 15 + 2) / 4;								// Scale 0..4 to coverage 0..15
+	free(g->pix);
+	g->pix = pix;
+	g->wth = w;
+	g->ht = h;
+	g->advance = (g->advance + 1) / 2;
+}
+
+static bool row_blank (const GLYPH* g, int y)
+{
+	for (int x = 0; x < g->wth; x++)
+		if (g->pix[y * g->wth + x]) return false;
+	return true;
+}
+
+static void put16 (FILE* f, uint16_t v) { fputc(v & 0xFF, f); fputc(v >> 8, f); }
+static void put32 (FILE* f, uint32_t v) { put16(f, v & 0xFFFF); put16(f, v >> 16); }
+
+int main (int argc, char* argv[])
+{
+	if (argc > 1 && strcmp(argv[1], "-aa") == 0) { aa = true; argc--; argv++; }
+	if (argc < 3) fail("usage: fontconv [-aa] input.psf|input.bdf output.fnt [first [last]]");
+	FILE* f = fopen(argv[1], "rb");
+	if (f == 0) fail("can not open input");
+	fseek(f, 0, SEEK_END);
+	size_t len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t* d = malloc(len + 1);
+	if (d == 0 || fread(d, 1, len, f) != len) fail("can not read input");
+	d[len] = 0;
+	fclose(f);
+	if (len >= 4 && d[0] == 0x72 && d[1] == 0xB5 && d[2] == 0x4A && d[3] == 0x86) read_psf2(d, len);
+	else if (strncmp((char*)d, "STARTFONT", 9) == 0) read_bdf((char*)d);
+	else fail("input is not a PSF2 or BDF font");
+
+	uint32_t first = (argc > 3) ? strtoul(argv[3], 0, 0) : 0;
+	uint32_t last = (argc > 4) ? strtoul(argv[4], 0, 0) : MAX_CODE;
+	if (last > MAX_CODE) last = MAX_CODE;
+	while (first <= last && !glyph[first].present) first++;			// Trim range to glyphs present
+	while (last > first && !glyph[last].present) last--;
+	if (first > last) fail("no glyphs in range");
+	uint32_t defchar = ('?' >= first && '?' <= last && glyph['?'].present) ? '?' : first;
+
+	if (aa)															// Half size coverage glyphs
+	{
+		for (uint32_t c = first; c <= last; c++)
+			if (glyph[c].present) make_aa(&glyph[c]);
+		cellht = (cellht + 1) / 2;
+	}
+	for (uint32_t c = first; c <= last; c++)						// Trim blank rows top and bottom
+	{
+		GLYPH* g = &glyph[c];
+		if (!g->present) continue;
+		int t = 0, b = g->ht;
+		while (t < b && row_blank(g, t)) t++;
+		while (b > t && row_blank(g, b - 1)) b--;
+		memmove(g->pix, &g->pix[t * g->wth], (b - t) * g->wth);
+		g->top = t;
+		g->ht = b - t;
+	}
+
+	static uint16_t pagedir[FONT_PAGES];							// Sparse index page directory
+	static uint16_t pages[FONT_PAGES][256];							// Sparse index pages
+	uint16_t numglyphs = 0, numpages = 0;
+	uint32_t bits = 0;												// Total packed bits or coverage bytes
+	memset(pagedir, 0xFF, sizeof(pagedir));							// No pages yet
+	for (uint32_t c = first; c <= last; c++)						// Give each glyph present an index
+	{
+		if (!glyph[c].present) continue;
+		if (pagedir[c >> 8] == FONT_NOPAGE)							// First glyph in this page
+		{
+			memset(pages[numpages], 0xFF, sizeof(pages[0]));		// Page starts with no glyphs
+			pagedir[c >> 8] = numpages++;
+		}
+		pages[pagedir[c >> 8]][c & 0xFF] = numglyphs++;
+		bits += aa ? (glyph[c].wth + 1) / 2 * glyph[c].ht : glyph[c].wth * glyph[c].ht;
+	}
+	if (numglyphs == FONT_NOGLYPH) fail("too many glyphs");
+	uint32_t bytes = aa ? bits : (bits + 7) / 8;					// Bitmap size in bytes
+
+	f = fopen(argv[2], "wb");
+	if (f == 0) fail("can not create output");
+	fwrite(aa ? FONTFILE_MAGIC_AA4 : FONTFILE_MAGIC, 1, 4, f);		// FONTFILEHEADER
+	fputc(FONTFILE_VERSION, f);
+	fputc(cellht, f);
+	put16(f, defchar);
+	put16(f, first);
+	put16(f, numglyphs);
+	put32(f, bytes);
+	put16(f, numpages);
+	for (int i = 0; i < 6; i++) fputc(0, f);						// Reserved
+	bits = 0;														// Offset of each glyph
+	for (uint32_t c = first; c <= last; c++)						// Glyph table
+	{
+		const GLYPH* g = &glyph[c];
+		if (!g->present) continue;
+		put32(f, bits);
+		fputc(g->wth, f);
+		fputc(g->ht, f);
+		fputc(g->top, f);
+		fputc(g->advance, f);
+		bits += aa ? (g->wth + 1) / 2 * g->ht : g->wth * g->ht;
+	}
+	for (int i = 0; i < FONT_PAGES; i++) put16(f, pagedir[i]);		// Sparse index
+	for (int i = 0; i < numpages; i++)
+		for (int j = 0; j < 256; j++) put16(f, pages[i][j]);
+	uint8_t acc = 0;
+	int n = 0;
+	for (uint32_t c = first; aa && c <= last; c++)					// Coverage atlas, two pixels per byte
+	{
+		const GLYPH* g = &glyph[c];
+		if (!g->present) continue;
+		for (int y = 0; y < g->ht; y++)
+			for (int x = 0; x < g->wth; x += 2)
+				fputc((g->pix[y * g->wth + x] << 4) |
+					((x + 1 < g->wth) ? g->pix[y * g->wth + x + 1] : 0), f);
+	}
+	for (uint32_t c = first; !aa && c <= last; c++)					// Bit packed bitmap
+	{
+		if (!glyph[c].present) continue;
+		for (int i = 0; i < glyph[c].wth * glyph[c].ht; i++)
+		{
+			acc = (acc << 1) | glyph[c].pix[i];
+			if (++n == 8) { fputc(acc, f); acc = 0; n = 0; }
+		}
+	}
+	if (n) fputc(acc << (8 - n), f);
+	fclose(f);
+	printf("%s: %u glyphs U+%04X..U+%04X, height %d, %u bitmap bytes, %u index pages\n",
+		argv[2], numglyphs, first, last, cellht, bytes, numpages);
+	return 0;
+}